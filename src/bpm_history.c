@@ -0,0 +1,189 @@
+/**
+ * @file bpm_history.c
+ * @brief Fixed rate tempo history with min/max/mean buckets per zoom level.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260309
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bpm_history.h"
+#include "model.h"
+
+/* Samples per bucket for 10 s, 1 min and 10 min over 100 points */
+static const uint16_t samples_per_bucket[BPM_HISTORY_LEVELS] = {
+	(10 * BPM_HISTORY_RATE_HZ) / BPM_HISTORY_POINTS,
+	(60 * BPM_HISTORY_RATE_HZ) / BPM_HISTORY_POINTS,
+	(600 * BPM_HISTORY_RATE_HZ) / BPM_HISTORY_POINTS,
+};
+
+BUILD_ASSERT((10 * BPM_HISTORY_RATE_HZ) % BPM_HISTORY_POINTS == 0,
+	     "the 10 s level needs a whole number of samples per bucket");
+
+/* Bucket under construction */
+struct bpm_history_acc {
+	uint32_t sum[BPM_HISTORY_SERIES];
+	uint16_t min[BPM_HISTORY_SERIES];
+	uint16_t max[BPM_HISTORY_SERIES];
+	/* Samples with a value, per series */
+	uint16_t valid[BPM_HISTORY_SERIES];
+	uint16_t samples;
+};
+
+struct bpm_history_ring {
+	struct bpm_history_bucket bucket[BPM_HISTORY_POINTS][BPM_HISTORY_SERIES];
+	uint32_t count;
+	struct bpm_history_acc acc;
+};
+
+/* All preallocated, about 5.5 kB */
+static struct bpm_history_ring rings[BPM_HISTORY_LEVELS];
+static struct k_spinlock history_lock;
+/* The level the chart shows, only its buckets wake up the GUI */
+static atomic_t notify_level = ATOMIC_INIT(BPM_HISTORY_10S);
+
+static void acc_reset(struct bpm_history_acc *acc)
+{
+	for (int s = 0; s < BPM_HISTORY_SERIES; s++) {
+		acc->sum[s] = 0;
+		acc->min[s] = UINT16_MAX;
+		acc->max[s] = 0;
+		acc->valid[s] = 0;
+	}
+	acc->samples = 0;
+}
+
+/* Returns true when the sample completed a bucket */
+static bool ring_add(struct bpm_history_ring *ring, uint16_t samples,
+		     const uint16_t value[BPM_HISTORY_SERIES])
+{
+	struct bpm_history_acc *acc = &ring->acc;
+
+	for (int s = 0; s < BPM_HISTORY_SERIES; s++) {
+		if (value[s] == 0) {
+			continue;
+		}
+		acc->sum[s] += value[s];
+		acc->min[s] = MIN(acc->min[s], value[s]);
+		acc->max[s] = MAX(acc->max[s], value[s]);
+		acc->valid[s]++;
+	}
+
+	if (++acc->samples < samples) {
+		return false;
+	}
+
+	struct bpm_history_bucket *b = ring->bucket[ring->count % BPM_HISTORY_POINTS];
+
+	for (int s = 0; s < BPM_HISTORY_SERIES; s++) {
+		if (acc->valid[s]) {
+			b[s].min = acc->min[s];
+			b[s].max = acc->max[s];
+			b[s].mean = (uint16_t)(acc->sum[s] / acc->valid[s]);
+		} else {
+			b[s] = (struct bpm_history_bucket){0};
+		}
+	}
+	ring->count++;
+	acc_reset(acc);
+	return true;
+}
+
+static void history_sample(struct k_timer *timer)
+{
+	human_bpm_model_t mod;
+	uint16_t value[BPM_HISTORY_SERIES];
+	bool completed = false;
+
+	/* The model read is lock free and fine in the timer ISR */
+	model_get(&mod);
+	value[BPM_HISTORY_PLL] = mod.pll_sbpm;
+	value[BPM_HISTORY_MEAS] = mod.meas_sbpm;
+	value[BPM_HISTORY_HR] = mod.hr_sbpm ? mod.hr_sbpm : mod.hr_bpm * 100U;
+
+	k_spinlock_key_t key = k_spin_lock(&history_lock);
+
+	for (int l = 0; l < BPM_HISTORY_LEVELS; l++) {
+		if (ring_add(&rings[l], samples_per_bucket[l], value) &&
+		    l == atomic_get(&notify_level)) {
+			completed = true;
+		}
+	}
+	k_spin_unlock(&history_lock, key);
+
+	/* A new point for the chart, let the GUI know */
+	if (completed) {
+		model_notify();
+	}
+}
+
+K_TIMER_DEFINE(history_timer, history_sample, NULL);
+
+void bpm_history_start(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&history_lock);
+
+	for (int l = 0; l < BPM_HISTORY_LEVELS; l++) {
+		acc_reset(&rings[l].acc);
+	}
+	k_spin_unlock(&history_lock, key);
+
+	k_timer_start(&history_timer, K_MSEC(1000 / BPM_HISTORY_RATE_HZ),
+		      K_MSEC(1000 / BPM_HISTORY_RATE_HZ));
+}
+
+void bpm_history_set_notify_level(enum bpm_history_level level)
+{
+	if (level < BPM_HISTORY_LEVELS) {
+		atomic_set(&notify_level, level);
+	}
+}
+
+uint32_t bpm_history_count(enum bpm_history_level level)
+{
+	uint32_t count;
+
+	if (level >= BPM_HISTORY_LEVELS) {
+		return 0;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&history_lock);
+
+	count = rings[level].count;
+	k_spin_unlock(&history_lock, key);
+	return count;
+}
+
+bool bpm_history_get(enum bpm_history_level level, uint32_t index,
+		     enum bpm_history_series series, struct bpm_history_bucket *out)
+{
+	bool ok = false;
+
+	if (level >= BPM_HISTORY_LEVELS || series >= BPM_HISTORY_SERIES) {
+		return false;
+	}
+
+	struct bpm_history_ring *ring = &rings[level];
+	k_spinlock_key_t key = k_spin_lock(&history_lock);
+
+	if (index < ring->count && ring->count - index <= BPM_HISTORY_POINTS) {
+		*out = ring->bucket[index % BPM_HISTORY_POINTS][series];
+		ok = true;
+	}
+	k_spin_unlock(&history_lock, key);
+	return ok;
+}
+
+uint32_t bpm_history_span_s(enum bpm_history_level level)
+{
+	if (level >= BPM_HISTORY_LEVELS) {
+		return 0;
+	}
+	return (uint32_t)samples_per_bucket[level] * BPM_HISTORY_POINTS / BPM_HISTORY_RATE_HZ;
+}
+
+/* EOF */
@@ -0,0 +1,79 @@
+/**
+ * @file bpm_history.h
+ * @brief Fixed rate tempo history with min/max/mean buckets per zoom level.
+ *
+ * The model is sampled BPM_HISTORY_RATE_HZ times a second from a kernel
+ * timer, so the time axis no longer depends on how often the GUI runs.
+ * The samples are decimated into BPM_HISTORY_POINTS buckets for every
+ * zoom level, exactly the number of points the chart shows.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260309
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef BPM_HISTORY_H
+#define BPM_HISTORY_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#define BPM_HISTORY_RATE_HZ 10
+/* Points per zoom level, the chart point count */
+#define BPM_HISTORY_POINTS 100
+
+enum bpm_history_level {
+	BPM_HISTORY_10S = 0,
+	BPM_HISTORY_1MIN,
+	BPM_HISTORY_10MIN,
+	BPM_HISTORY_LEVELS
+};
+
+enum bpm_history_series {
+	BPM_HISTORY_PLL = 0,
+	BPM_HISTORY_MEAS,
+	/* hr_sbpm or hr_bpm * 100 */
+	BPM_HISTORY_HR,
+	BPM_HISTORY_SERIES
+};
+
+/* Scaled BPM, all 0 when there was no value in the bucket */
+struct bpm_history_bucket {
+	uint16_t min;
+	uint16_t max;
+	uint16_t mean;
+};
+
+/**
+ * @brief Start sampling the model.
+ */
+void bpm_history_start(void);
+
+/**
+ * @brief Level whose completed buckets call model_notify().
+ *
+ * The GUI sets the level the chart shows, the 10 s level by default.
+ * A bucket of another level does not wake it up.
+ */
+void bpm_history_set_notify_level(enum bpm_history_level level);
+
+/**
+ * @brief Number of buckets completed on a level since the start.
+ *
+ * The buckets count - BPM_HISTORY_POINTS up to count - 1 are available.
+ */
+uint32_t bpm_history_count(enum bpm_history_level level);
+
+/**
+ * @brief Copy one bucket.
+ *
+ * @param index bucket number as counted by bpm_history_count()
+ * @return false when the bucket is not available (anymore)
+ */
+bool bpm_history_get(enum bpm_history_level level, uint32_t index,
+		     enum bpm_history_series series, struct bpm_history_bucket *out);
+
+/**
+ * @brief Time span of a level in seconds, e.g. for the chart legend.
+ */
+uint32_t bpm_history_span_s(enum bpm_history_level level);
+
+#endif /* BPM_HISTORY_H */
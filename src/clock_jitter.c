@@ -0,0 +1,236 @@
+/**
+ * @file clock_jitter.c
+ * @brief Jitter and drift of the generated and the received clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260316
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/counter.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/shell/shell.h>
+
+/* sbpm_to_ticks() */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "clock_jitter.h"
+#include "usb_midi_tx.h"
+
+/* The free running counter, also used for the received pulses */
+static const struct device *const jitter_counter =
+	DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi1_clock_meas_cntr), counter));
+
+struct jitter_acc {
+	uint32_t count;
+	int64_t sum;
+	uint64_t sum_sq;
+	int32_t min;
+	int32_t max;
+	uint64_t elapsed;
+	uint64_t ideal;
+};
+
+static struct k_spinlock jitter_lock;
+static struct jitter_acc acc[CLOCK_JITTER_COUNT];
+static uint32_t counter_top = UINT32_MAX;
+static uint32_t jitter_freq;
+static bool ready;
+
+/* Generated clock, only touched from the clock callback */
+static uint32_t gen_last;
+static uint32_t gen_ideal_next;
+static uint8_t gen_seq;
+
+int clock_jitter_init(void)
+{
+	if (!device_is_ready(jitter_counter)) {
+		return -ENODEV;
+	}
+	counter_top = counter_get_top_value(jitter_counter);
+	jitter_freq = counter_get_frequency(jitter_counter);
+	clock_jitter_reset();
+	ready = true;
+	return 0;
+}
+
+static void acc_add(struct jitter_acc *a, int32_t error, uint32_t elapsed, uint32_t ideal)
+{
+	k_spinlock_key_t key = k_spin_lock(&jitter_lock);
+
+	if (a->count == 0 || error < a->min) {
+		a->min = error;
+	}
+	if (a->count == 0 || error > a->max) {
+		a->max = error;
+	}
+	a->sum += error;
+	a->sum_sq += (uint64_t)((int64_t)error * error);
+	a->elapsed += elapsed;
+	a->ideal += ideal;
+	a->count++;
+	k_spin_unlock(&jitter_lock, key);
+}
+
+#ifdef CONFIG_MIDI_JITTER_USB_STREAM
+/*
+ * One UMP Data 64 (SysEx7 complete in one packet) per pulse:
+ * 0x7D (non commercial ID), record type, 7 bit sequence and the error in
+ * ticks as 21 bit two's complement, most significant 7 bits first.
+ */
+#define JITTER_SYSEX_ID   0x7D
+#define JITTER_RECORD_LEN 6
+
+static void stream_record(uint8_t type, uint8_t seq, int32_t error)
+{
+	uint32_t e = (uint32_t)CLAMP(error, -(1 << 20), (1 << 20) - 1) & 0x1fffff;
+	struct midi_ump ump = {
+		.data = {(UMP_MT_DATA_64 << 28) | (JITTER_RECORD_LEN << 16) |
+				 (JITTER_SYSEX_ID << 8) | type,
+			 ((seq & 0x7fU) << 24) | (((e >> 14) & 0x7fU) << 16) |
+				 (((e >> 7) & 0x7fU) << 8) | (e & 0x7fU)},
+	};
+
+	/* Not in the middle of a tempo log export */
+	if (usb_midi_tx_is_ready() && !usb_midi_tx_sysex_held()) {
+		usb_midi_tx_send(ump);
+	}
+}
+#else
+#define stream_record(type, seq, error) do { } while (0)
+#endif
+
+void clock_jitter_gen_pulse(uint16_t sbpm)
+{
+	uint32_t now = 0;
+
+	if (!ready) {
+		return;
+	}
+	(void)counter_get_value(jitter_counter, &now);
+
+	if (gen_ideal_next) {
+		uint32_t elapsed;
+
+		if (now >= gen_last || counter_top == UINT32_MAX) {
+			elapsed = now - gen_last;
+		} else {
+			elapsed = now + (counter_top - gen_last) + 1U;
+		}
+		int32_t error = (int32_t)(elapsed - gen_ideal_next);
+
+		acc_add(&acc[CLOCK_JITTER_GEN], error, elapsed, gen_ideal_next);
+		stream_record(CLOCK_JITTER_GEN + 1, gen_seq++, error);
+	}
+
+	gen_last = now;
+	/* The period of the interval starting now */
+	gen_ideal_next = sbpm ? sbpm_to_ticks(sbpm, jitter_freq) : 0;
+}
+
+void clock_jitter_rx_error(int32_t phase_error_ticks)
+{
+	static uint8_t rx_seq;
+
+	if (!ready) {
+		return;
+	}
+	acc_add(&acc[CLOCK_JITTER_RX], phase_error_ticks, 0, 0);
+	stream_record(CLOCK_JITTER_RX + 1, rx_seq++, phase_error_ticks);
+}
+
+static uint32_t isqrt64(uint64_t v)
+{
+	uint64_t res = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > v) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (v >= res + bit) {
+			v -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)res;
+}
+
+void clock_jitter_get(enum clock_jitter_id id, struct clock_jitter_report *out)
+{
+	struct jitter_acc a;
+
+	memset(out, 0, sizeof(*out));
+	if (id >= CLOCK_JITTER_COUNT) {
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&jitter_lock);
+
+	a = acc[id];
+	k_spin_unlock(&jitter_lock, key);
+
+	out->clock_freq = jitter_freq;
+	out->count = a.count;
+	if (a.count == 0) {
+		return;
+	}
+	out->mean = (int32_t)(a.sum / a.count);
+	out->rms = isqrt64(a.sum_sq / a.count);
+	out->min = a.min;
+	out->max = a.max;
+	out->p2p = (uint32_t)(a.max - a.min);
+	if (a.ideal) {
+		out->drift_ppm = (int32_t)((((int64_t)a.elapsed - (int64_t)a.ideal) * 1000000) /
+					   (int64_t)a.ideal);
+	}
+}
+
+void clock_jitter_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&jitter_lock);
+
+	memset(acc, 0, sizeof(acc));
+	k_spin_unlock(&jitter_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int32_t ticks_to_ns(int32_t ticks, uint32_t freq)
+{
+	return freq ? (int32_t)(((int64_t)ticks * 1000000000LL) / freq) : 0;
+}
+
+static int cmd_midi_jitter(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const names[CLOCK_JITTER_COUNT] = {"generated", "received"};
+	struct clock_jitter_report r;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		clock_jitter_reset();
+		shell_print(sh, "jitter reset");
+		return 0;
+	}
+
+	shell_print(sh, "%-9s %8s %9s %9s %9s %9s %9s  (ns) %7s", "clock", "pulses", "mean",
+		    "rms", "min", "max", "p2p", "ppm");
+	for (int i = 0; i < CLOCK_JITTER_COUNT; i++) {
+		clock_jitter_get(i, &r);
+		shell_print(sh, "%-9s %8u %9d %9d %9d %9d %9d      %7d", names[i], r.count,
+			    ticks_to_ns(r.mean, r.clock_freq), ticks_to_ns(r.rms, r.clock_freq),
+			    ticks_to_ns(r.min, r.clock_freq), ticks_to_ns(r.max, r.clock_freq),
+			    ticks_to_ns(r.p2p, r.clock_freq), r.drift_ppm);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), jitter, NULL, "Clock jitter and drift [reset]", cmd_midi_jitter, 1, 1);
+#endif
+
+/* EOF */
@@ -0,0 +1,62 @@
+/**
+ * @file clock_jitter.h
+ * @brief Jitter and drift of the generated clock against an ideal
+ * timeline, and of the received clock against its PLL.
+ *
+ * Generated: every pulse of midi1_clock_cntr_callback() is timestamped
+ * and its interval compared with sbpm_to_ticks() of the tempo that was
+ * programmed for it.  Received: the phase error of the serial input
+ * against the phase locking PLL.  Both give the mean and RMS error, the
+ * peak to peak error and the long term drift in ppm (generated only).
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260316
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CLOCK_JITTER_H
+#define CLOCK_JITTER_H
+#include <stdint.h>
+
+enum clock_jitter_id {
+	CLOCK_JITTER_GEN = 0,
+	CLOCK_JITTER_RX,
+	CLOCK_JITTER_COUNT
+};
+
+/* Errors in ticks of the timestamp counter */
+struct clock_jitter_report {
+	uint32_t count;
+	int32_t mean;
+	uint32_t rms;
+	int32_t min;
+	int32_t max;
+	/* Peak to peak, max - min */
+	uint32_t p2p;
+	/* (elapsed - ideal) / ideal in ppm, generated clock only */
+	int32_t drift_ppm;
+	uint32_t clock_freq;
+};
+
+/**
+ * @brief Prepare the timestamp counter.
+ *
+ * @return 0 or -ENODEV
+ */
+int clock_jitter_init(void);
+
+/**
+ * @brief A generated pulse, call from the clock callback (ISR).
+ *
+ * @param sbpm tempo programmed for the interval that starts now
+ */
+void clock_jitter_gen_pulse(uint16_t sbpm);
+
+/**
+ * @brief Phase error of a received pulse against the PLL, receive thread.
+ */
+void clock_jitter_rx_error(int32_t phase_error_ticks);
+
+void clock_jitter_get(enum clock_jitter_id id, struct clock_jitter_report *out);
+void clock_jitter_reset(void);
+
+#endif /* CLOCK_JITTER_H */
@@ -0,0 +1,132 @@
+/**
+ * @file clock_phase.c
+ * @brief Lock the phase of the generated clock to the serial MIDI clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260412
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/counter.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+
+#include "clock_phase.h"
+
+/* The counter the serial pulses are timestamped with */
+static const struct device *const phase_counter =
+	DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi1_clock_meas_cntr), counter));
+
+/*
+ * sbpm = 60 s * 100 / 24 pulses * freq / period, 250 * freq / period.
+ * In Q16 the shift is split over both sides so it fits 64 bits up to
+ * a 1 GHz counter.
+ */
+#define CLOCK_PHASE_SBPM_K 250ULL
+
+static struct k_spinlock phase_lock;
+static uint32_t phase_freq;
+/* Copy of the PI loop, written by clock_phase_rx() */
+static uint64_t rx_period_q16;
+static uint32_t rx_next;
+static bool rx_locked;
+static struct clock_phase_stats stats;
+/* Last generated pulse, clock callback only */
+static atomic_t gen_timestamp;
+
+void clock_phase_init(uint32_t clock_freq)
+{
+	phase_freq = clock_freq;
+}
+
+void clock_phase_gen_pulse(void)
+{
+	uint32_t now = 0;
+
+	(void)counter_get_value(phase_counter, &now);
+	atomic_set(&gen_timestamp, (atomic_val_t)now);
+}
+
+void clock_phase_rx(struct midi1_pll_pi_data *pi)
+{
+	k_spinlock_key_t key = k_spin_lock(&phase_lock);
+
+	rx_period_q16 = midi1_pll_pi_get_interval_q16(pi);
+	rx_next = midi1_pll_pi_get_next_pulse(pi);
+	rx_locked = midi1_pll_pi_is_locked(pi);
+	k_spin_unlock(&phase_lock, key);
+}
+
+uint16_t clock_phase_target(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&phase_lock);
+	uint64_t period_q16 = rx_period_q16;
+	uint32_t next = rx_next;
+	bool locked = rx_locked;
+
+	k_spin_unlock(&phase_lock, key);
+
+	int32_t period = (int32_t)(period_q16 >> 16);
+
+	if (!locked || period <= 0 || !phase_freq) {
+		stats.locked = false;
+		return 0;
+	}
+
+	/* Timestamps wrap at 32 bits, the offset is taken modulo a pulse */
+	int32_t offset = (int32_t)((uint32_t)atomic_get(&gen_timestamp) - next) % period;
+
+	if (offset >= period / 2) {
+		offset -= period;
+	} else if (offset < -(period / 2)) {
+		offset += period;
+	}
+
+	/* In Q16 and rounded once at the end, 0.01 BPM is about 80 ppm */
+	int64_t sbpm_q16 =
+		(int64_t)(((CLOCK_PHASE_SBPM_K * phase_freq) << 24) / MAX(period_q16 >> 8, 1U));
+	/* Late pulses (positive offset) need a slightly higher tempo */
+	int64_t corr_q16 = (sbpm_q16 * offset) / ((int64_t)period * CLOCK_PHASE_PULSES);
+	int64_t max_q16 = (sbpm_q16 * CLOCK_PHASE_MAX_PM) / 1000;
+
+	corr_q16 = CLAMP(corr_q16, -max_q16, max_q16);
+	stats = (struct clock_phase_stats){
+		.offset_ticks = offset,
+		.pll_sbpm = (uint16_t)MIN((sbpm_q16 + 0x8000) >> 16, UINT16_MAX),
+		.gen_sbpm = (uint16_t)CLAMP((sbpm_q16 + corr_q16 + 0x8000) >> 16, 1, UINT16_MAX),
+		.locked = true,
+	};
+	return stats.gen_sbpm;
+}
+
+void clock_phase_get_stats(struct clock_phase_stats *out)
+{
+	/* Diagnostics only, written by the main thread */
+	*out = stats;
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_phase(const struct shell *sh, size_t argc, char **argv)
+{
+	struct clock_phase_stats st;
+
+	clock_phase_get_stats(&st);
+	if (!st.locked) {
+		shell_print(sh, "Serial clock not phase locked");
+		return 0;
+	}
+	shell_print(sh, "offset %d ticks (%d us), PLL %u.%02u BPM, generator %u.%02u BPM",
+		    st.offset_ticks,
+		    phase_freq ? (int32_t)(((int64_t)st.offset_ticks * 1000000) / phase_freq) : 0,
+		    st.pll_sbpm / 100U, st.pll_sbpm % 100U, st.gen_sbpm / 100U, st.gen_sbpm % 100U);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), phase, NULL, "Phase of the generated to the serial clock", cmd_midi_phase,
+		 1, 0);
+#endif
+
+/* EOF */
@@ -0,0 +1,67 @@
+/**
+ * @file clock_phase.h
+ * @brief Lock the phase of the generated clock to the serial MIDI clock.
+ *
+ * The phase locking PLL (g_pll_pi) predicts when the next serial clock
+ * pulse comes in, the clock callback timestamps every generated pulse
+ * on the same counter.  While the serial source drives the generator
+ * the tempo handed to tempo_slew is the one of the PI loop period plus
+ * a correction that pulls the generated pulses onto the incoming ones:
+ * 1/CLOCK_PHASE_PULSES of the phase offset per pulse, at most
+ * CLOCK_PHASE_MAX_PM per mille of the tempo.  The generator tempo has
+ * 0.01 BPM steps so the pulses stay within about 0.1..0.3 ms.
+ *
+ * The phase is locked per 24pqn pulse, which pulse is the first of a
+ * beat is not known without Song Position Pointer and is not aligned.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260412
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CLOCK_PHASE_H
+#define CLOCK_PHASE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "midi1_pll.h"
+
+#define CLOCK_PHASE_PULSES CONFIG_CLOCK_PHASE_PULSES
+#define CLOCK_PHASE_MAX_PM CONFIG_CLOCK_PHASE_MAX_PM
+
+struct clock_phase_stats {
+	/* Generated - incoming pulse in counter ticks, positive is late */
+	int32_t offset_ticks;
+	/* Tempo of the PI loop and the corrected one, scaled BPM */
+	uint16_t pll_sbpm;
+	uint16_t gen_sbpm;
+	bool locked;
+};
+
+/**
+ * @brief Set the frequency of the timestamp counter.
+ */
+void clock_phase_init(uint32_t clock_freq);
+
+/**
+ * @brief A generated pulse went out now, call from the clock callback.
+ */
+void clock_phase_gen_pulse(void);
+
+/**
+ * @brief Take over the state of the PI loop after it processed a pulse.
+ *
+ * Called by the thread that feeds the PI loop, the other threads only
+ * see this copy.
+ */
+void clock_phase_rx(struct midi1_pll_pi_data *pi);
+
+/**
+ * @brief Tempo for the generator that follows the serial clock in phase.
+ *
+ * @return scaled BPM or 0 when the PI loop is not locked
+ */
+uint16_t clock_phase_target(void);
+
+void clock_phase_get_stats(struct clock_phase_stats *stats);
+
+#endif /* CLOCK_PHASE_H */
@@ -0,0 +1,271 @@
+/**
+ * @file clock_source.c
+ * @brief Tempo sources with one PLL each, a lock quality metric and a
+ * source selector.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260305
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/counter.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/logging/log.h>
+
+/* sbpm_to_ticks() and pqn24_to_sbpm() */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "clock_source.h"
+#include "midi1_pll.h"
+#include "midi_probe.h"
+
+LOG_MODULE_REGISTER(clock_source, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define CLOCK_SOURCE_PPQN 24
+
+/* The timestamp counter shared with the pulse ingest */
+static const struct device *const source_counter =
+	DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi1_clock_meas_cntr), counter));
+
+struct clock_source {
+	const char *name;
+	struct k_spinlock lock;
+	struct midi1_pll_data pll;
+	/* Without events for this long the source is stale */
+	uint32_t timeout_ms;
+	uint32_t last_event_ms;
+	uint32_t last_timestamp;
+	bool have_last;
+	/* Mean absolute interval error against the PLL, ticks */
+	uint32_t jitter_ticks;
+	uint32_t pulses;
+	uint8_t priority;
+};
+
+static struct clock_source sources[CLOCK_SOURCE_COUNT] = {
+	[CLOCK_SOURCE_SERIAL] = {.name = "serial", .timeout_ms = 500, .priority = 1},
+	[CLOCK_SOURCE_USB] = {.name = "usb", .timeout_ms = 500, .priority = 2},
+	/* One notification per second, allow a couple to get lost */
+	[CLOCK_SOURCE_HR] = {.name = "hr", .timeout_ms = 3000, .priority = 0},
+};
+
+BUILD_ASSERT(MIDI_PROBE_PLL_HR - MIDI_PROBE_PLL_SERIAL + 1 == CLOCK_SOURCE_COUNT,
+	     "one PLL probe per clock source");
+
+static atomic_t ready;
+static uint32_t counter_top = UINT32_MAX;
+static uint32_t source_freq;
+static enum clock_source_id selected = CLOCK_SOURCE_NONE;
+
+int clock_source_init(uint32_t clock_freq)
+{
+	if (!device_is_ready(source_counter)) {
+		return -ENODEV;
+	}
+	counter_top = counter_get_top_value(source_counter);
+	source_freq = clock_freq;
+
+	for (int i = 0; i < CLOCK_SOURCE_COUNT; i++) {
+		midi1_pll_init(&sources[i].pll, 12000, clock_freq);
+	}
+	atomic_set(&ready, 1);
+	return 0;
+}
+
+uint32_t clock_source_clock_freq(void)
+{
+	return source_freq;
+}
+
+/* Feed one interval, the lock has to be held */
+static void source_interval(struct clock_source *src, uint32_t interval_ticks, bool measure)
+{
+	if (measure) {
+		int32_t error = (int32_t)interval_ticks - midi1_pll_get_interval_ticks(&src->pll);
+		uint32_t abs_error = error < 0 ? (uint32_t)-error : (uint32_t)error;
+
+		/* 1/8 exponential average */
+		src->jitter_ticks = src->jitter_ticks - (src->jitter_ticks >> 3) + (abs_error >> 3);
+	}
+	MIDI_PROBE_BEGIN(PLL);
+	midi1_pll_process_interval(&src->pll, interval_ticks);
+	/* Sources interrupt each other, every one records its own probe */
+	MIDI_PROBE_END_TO(PLL, MIDI_PROBE_PLL_SERIAL + (src - sources));
+	src->pulses++;
+}
+
+void clock_source_pulse(enum clock_source_id id, uint32_t timestamp)
+{
+	if (id >= CLOCK_SOURCE_COUNT || !atomic_get(&ready)) {
+		return;
+	}
+
+	struct clock_source *src = &sources[id];
+	k_spinlock_key_t key = k_spin_lock(&src->lock);
+	uint32_t now_ms = k_uptime_get_32();
+
+	/* After a pause the first interval is meaningless */
+	if (src->have_last && now_ms - src->last_event_ms < src->timeout_ms) {
+		uint32_t interval;
+
+		if (timestamp >= src->last_timestamp || counter_top == UINT32_MAX) {
+			interval = timestamp - src->last_timestamp;
+		} else {
+			interval = timestamp + (counter_top - src->last_timestamp) + 1U;
+		}
+		source_interval(src, interval, true);
+	}
+	src->last_timestamp = timestamp;
+	src->last_event_ms = now_ms;
+	src->have_last = true;
+	k_spin_unlock(&src->lock, key);
+}
+
+void clock_source_pulse_now(enum clock_source_id id)
+{
+	uint32_t now = 0;
+
+	if (!atomic_get(&ready)) {
+		return;
+	}
+	(void)counter_get_value(source_counter, &now);
+	clock_source_pulse(id, now);
+}
+
+void clock_source_beat(enum clock_source_id id, uint32_t pulse_ticks)
+{
+	if (id >= CLOCK_SOURCE_COUNT || !atomic_get(&ready) || pulse_ticks == 0) {
+		return;
+	}
+
+	struct clock_source *src = &sources[id];
+	k_spinlock_key_t key = k_spin_lock(&src->lock);
+
+	/*
+	 * A beat is 24 equal pulses so the PLL converges per beat like the
+	 * 24pqn inputs, the jitter is only measured once per beat.
+	 */
+	for (int i = 0; i < CLOCK_SOURCE_PPQN; i++) {
+		source_interval(src, pulse_ticks, i == 0);
+	}
+	src->last_event_ms = k_uptime_get_32();
+	k_spin_unlock(&src->lock, key);
+}
+
+uint16_t clock_source_get_sbpm(enum clock_source_id id)
+{
+	uint32_t us;
+
+	if (id >= CLOCK_SOURCE_COUNT || !atomic_get(&ready)) {
+		return 0;
+	}
+
+	struct clock_source *src = &sources[id];
+	k_spinlock_key_t key = k_spin_lock(&src->lock);
+
+	us = src->pulses >= CLOCK_SOURCE_MIN_PULSES ? midi1_pll_get_interval_us(&src->pll) : 0;
+	k_spin_unlock(&src->lock, key);
+
+	return us ? pqn24_to_sbpm(us) : 0;
+}
+
+uint8_t clock_source_get_quality(enum clock_source_id id)
+{
+	uint32_t permille = 1000;
+
+	if (id >= CLOCK_SOURCE_COUNT || !atomic_get(&ready)) {
+		return 0;
+	}
+
+	struct clock_source *src = &sources[id];
+	k_spinlock_key_t key = k_spin_lock(&src->lock);
+	int32_t interval = midi1_pll_get_interval_ticks(&src->pll);
+
+	if (src->pulses >= CLOCK_SOURCE_MIN_PULSES &&
+	    k_uptime_get_32() - src->last_event_ms < src->timeout_ms && interval > 0) {
+		/* Jitter relative to the interval, 1% jitter gives 90 */
+		permille = (uint32_t)(((uint64_t)src->jitter_ticks * 1000U) / (uint32_t)interval);
+	}
+	k_spin_unlock(&src->lock, key);
+
+	return (uint8_t)(100U - MIN(permille, 100U));
+}
+
+void clock_source_set_priority(enum clock_source_id id, uint8_t priority)
+{
+	if (id < CLOCK_SOURCE_COUNT) {
+		sources[id].priority = priority;
+	}
+}
+
+static enum clock_source_id select_priority(const uint8_t *quality)
+{
+	enum clock_source_id best = CLOCK_SOURCE_NONE;
+
+	for (int i = 0; i < CLOCK_SOURCE_COUNT; i++) {
+		if (quality[i] < CLOCK_SOURCE_LOCK_QUALITY) {
+			continue;
+		}
+		if (best == CLOCK_SOURCE_NONE || sources[i].priority < sources[best].priority) {
+			best = i;
+		}
+	}
+	return best;
+}
+
+static enum clock_source_id select_auto(const uint8_t *quality)
+{
+	enum clock_source_id best = CLOCK_SOURCE_NONE;
+
+	for (int i = 0; i < CLOCK_SOURCE_COUNT; i++) {
+		if (quality[i] < CLOCK_SOURCE_LOCK_QUALITY) {
+			continue;
+		}
+		/* Equal quality goes to the higher priority */
+		if (best == CLOCK_SOURCE_NONE || quality[i] > quality[best] ||
+		    (quality[i] == quality[best] &&
+		     sources[i].priority < sources[best].priority)) {
+			best = i;
+		}
+	}
+
+	/* Stay with a locked source unless the other one is clearly better */
+	if (best != CLOCK_SOURCE_NONE && selected != CLOCK_SOURCE_NONE && best != selected &&
+	    quality[selected] >= CLOCK_SOURCE_LOCK_QUALITY &&
+	    quality[best] < quality[selected] + CLOCK_SOURCE_HYSTERESIS) {
+		best = selected;
+	}
+	return best;
+}
+
+enum clock_source_id clock_source_select(void)
+{
+	uint8_t quality[CLOCK_SOURCE_COUNT];
+	enum clock_source_id best;
+
+	for (int i = 0; i < CLOCK_SOURCE_COUNT; i++) {
+		quality[i] = clock_source_get_quality(i);
+	}
+
+	best = IS_ENABLED(CONFIG_CLOCK_SOURCE_AUTO) ? select_auto(quality)
+						   : select_priority(quality);
+	if (best != selected) {
+		LOG_INF("Clock source %s --> %s", clock_source_name(selected),
+			clock_source_name(best));
+		selected = best;
+	}
+	return selected;
+}
+
+const char *clock_source_name(enum clock_source_id id)
+{
+	if (id >= CLOCK_SOURCE_COUNT) {
+		return "none";
+	}
+	return sources[id].name;
+}
+
+/* EOF */
@@ -0,0 +1,93 @@
+/**
+ * @file clock_source.h
+ * @brief Tempo sources (serial DIN, USB UMP and BLE heart rate) with one
+ * PLL each, a lock quality metric and a source selector.
+ *
+ * Every source measures its own pulse intervals, the serial and USB
+ * inputs per 24pqn clock and the heart rate per beat.  The selector
+ * picks one and main() hands its tempo to tempo_slew, so switching never
+ * moves the phase of the generated clock, only the tempo it ramps to.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260305
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef CLOCK_SOURCE_H
+#define CLOCK_SOURCE_H
+#include <stdbool.h>
+#include <stdint.h>
+
+enum clock_source_id {
+	CLOCK_SOURCE_SERIAL = 0,
+	CLOCK_SOURCE_USB,
+	CLOCK_SOURCE_HR,
+	CLOCK_SOURCE_COUNT,
+	CLOCK_SOURCE_NONE = CLOCK_SOURCE_COUNT
+};
+
+/* A source is usable from this quality (0 --> 100) on */
+#define CLOCK_SOURCE_LOCK_QUALITY 20
+/* Auto mode only switches to a source that is this much better */
+#define CLOCK_SOURCE_HYSTERESIS 10
+/* Intervals before the quality is computed at all */
+#define CLOCK_SOURCE_MIN_PULSES 24
+
+/**
+ * @brief Set up the per source PLLs.
+ *
+ * Events that arrive before this are ignored.
+ *
+ * @param clock_freq frequency of the timestamp counter (midi1_clock_meas_cntr)
+ * @return 0 or -ENODEV when the timestamp counter is not ready
+ */
+int clock_source_init(uint32_t clock_freq);
+
+uint32_t clock_source_clock_freq(void);
+
+/**
+ * @brief One 24pqn clock received at timestamp (counter ticks).
+ */
+void clock_source_pulse(enum clock_source_id id, uint32_t timestamp);
+
+/**
+ * @brief One 24pqn clock received now, for inputs without a timestamp.
+ */
+void clock_source_pulse_now(enum clock_source_id id);
+
+/**
+ * @brief One beat (quarter note), for sources that measure whole beats.
+ *
+ * @param pulse_ticks beat interval / 24 in counter ticks
+ */
+void clock_source_beat(enum clock_source_id id, uint32_t pulse_ticks);
+
+/**
+ * @brief Filtered tempo of a source.
+ *
+ * @return scaled BPM or 0 when the source never had enough pulses
+ */
+uint16_t clock_source_get_sbpm(enum clock_source_id id);
+
+/**
+ * @brief Lock quality, 0 (stale or unusable) --> 100 (jitter free).
+ */
+uint8_t clock_source_get_quality(enum clock_source_id id);
+
+/**
+ * @brief Order used by the priority mode, 0 is tried first.
+ */
+void clock_source_set_priority(enum clock_source_id id, uint8_t priority);
+
+/**
+ * @brief Let the selector choose the source.
+ *
+ * Priority mode takes the first locked source in priority order, auto
+ * mode the best locked one.  Call periodically from one thread.
+ *
+ * @return the selected source or CLOCK_SOURCE_NONE
+ */
+enum clock_source_id clock_source_select(void);
+
+const char *clock_source_name(enum clock_source_id id);
+
+#endif /* CLOCK_SOURCE_H */
@@ -9,5 +9,5 @@
 #include "common.h"
 #include "midi1_pll.h"
 
-/* Global pll */
-struct midi1_pll_data g_pll;
+/* Global phase locking pll of the serial input */
+struct midi1_pll_pi_data g_pll_pi;
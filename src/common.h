@@ -23,12 +23,30 @@
 
 #define MIDI_LINE_MAX 128
 
-#define MIDI_MSGQ_MAX 32
+/* Must be a power of two, one event is 8 bytes */
+#define MIDI_EVENT_RING_SIZE 64
 /* Defined in midi1_receive_thread */
-extern struct k_msgq midi_msgq;
+#include "midi1_event.h"
+extern struct midi1_event_ring midi_event_ring;
+/* Completed SysEx messages (struct midi1_sysex *) towards the LVGL thread */
+#define MIDI_SYSEX_QUEUE_SIZE 4
+extern struct k_msgq midi_sysex_q;
 
-/* Global pll */
+/* Display statistics, kept by lvgl_thread */
+struct gui_stats {
+	uint32_t frames;
+	uint32_t last_frame_us;
+	uint32_t max_frame_us;
+	/* Bytes of all invalidated areas, what a refresh has to flush */
+	uint64_t invalidated_bytes;
+	uint32_t model_wakeups;
+};
+void gui_get_stats(struct gui_stats *stats);
+/* Chart zoom, an enum bpm_history_level */
+void gui_set_history_level(int level);
+
+/* Global phase locking pll of the serial input, see 'clock_source.h' for the others */
 #include "midi1_pll.h"
-extern struct midi1_pll_data g_pll;
+extern struct midi1_pll_pi_data g_pll_pi;
 
 #endif
@@ -0,0 +1,1291 @@
+/**
+ * @file hr_central.c
+ * @brief BLE central for up to HR_MAX_SENSORS heart rate sensors.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260318
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Bluetooth hr central example used is:
+ * Copyright (c) 2015-2016 Intel Corporation
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/types.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/uuid.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/settings/settings.h>
+#include <zephyr/shell/shell.h>
+
+/* sbpm_to_ticks() */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "clock_source.h"
+#include "hr_central.h"
+#include "hr_latency.h"
+#include "hrm.h"
+
+LOG_MODULE_REGISTER(hr_central, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* A directed connect to a remembered sensor gives up after this long */
+#define HR_DIRECT_TIMEOUT_MS 2000
+
+/*
+ * Connection parameters requested once subscribed, interval in 1.25 ms
+ * units.  Peripheral latency only while the tempo of the sensor is
+ * stable: within HR_STABLE_SBPM for HR_STABLE_NOTIFY notifications.
+ */
+#define HR_CONN_INTERVAL       CONFIG_HR_CONN_INTERVAL
+#define HR_CONN_STABLE_LATENCY CONFIG_HR_CONN_STABLE_LATENCY
+/* Supervision timeout in 10 ms units */
+#define HR_CONN_TIMEOUT        400
+#define HR_STABLE_SBPM         200
+#define HR_STABLE_NOTIFY       5
+
+/* What is needed to subscribe without a GATT discovery */
+struct hr_cache {
+	bt_addr_le_t addr;
+	uint16_t value_handle;
+	uint16_t ccc_handle;
+};
+
+struct hr_sensor {
+	/* Only touched from the BLE callbacks */
+	struct bt_conn *conn;
+	struct bt_uuid_16 discover_uuid;
+	struct bt_gatt_discover_params discover_params;
+	struct bt_gatt_subscribe_params subscribe_params;
+	struct hrm_beat_est beats;
+	/* Directed connect done since the sensor was lost */
+	bool direct_tried;
+	/* Subscribed with the cached handles */
+	bool fast;
+	uint32_t connect_ms;
+	/* Peripheral latency of the last parameter request, -1 for none */
+	int16_t req_latency;
+	uint16_t stable_ref;
+	uint8_t stable_count;
+	/* Also read by main() and the shell, under hr_lock */
+	struct hr_cache cache;
+	bt_addr_le_t addr;
+	bool connected;
+	uint8_t bpm;
+	/* From the RR intervals when the sensor sends them, else BPM * 100 */
+	uint16_t sbpm;
+	uint8_t weight;
+	uint32_t last_notify_ms;
+	uint32_t notifications;
+	/* From creating the connection to the first notification */
+	uint32_t first_notify_ms;
+	/* Connection parameters in use, from the controller */
+	uint16_t conn_interval;
+	uint16_t conn_latency;
+	uint16_t conn_timeout;
+};
+
+static struct hr_sensor sensors[HR_MAX_SENSORS];
+static struct k_spinlock hr_lock;
+static enum hr_policy agg_policy = CONFIG_HR_AGGREGATE_POLICY;
+static int agg_leader;
+
+static struct k_event *hr_events;
+/*
+ * Scan and connection state, from the BLE callbacks and the scan backoff
+ * work.  A k_mutex can be taken again by the thread holding it.
+ */
+static K_MUTEX_DEFINE(scan_mutex);
+static bool scanning;
+/* The controller creates one connection at a time, no scanning meanwhile */
+static struct hr_sensor *connecting;
+
+/*
+ * Scan duty cycle, stepped down while nothing is found.  Interval and
+ * window in 0.625 ms units, the last level is kept.
+ */
+static const struct scan_level {
+	uint16_t interval;
+	uint16_t window;
+	uint16_t hold_s;
+} scan_levels[] = {
+	/* 60 ms / 30 ms, right after losing a sensor */
+	{BT_GAP_SCAN_FAST_INTERVAL, BT_GAP_SCAN_FAST_WINDOW, 30},
+	/* 320 ms / 30 ms */
+	{0x0200, 0x0030, 90},
+	/* 1.28 s / 11.25 ms */
+	{BT_GAP_SCAN_SLOW_INTERVAL_1, BT_GAP_SCAN_SLOW_WINDOW_1, 0},
+};
+
+static uint8_t scan_level;
+static bool scan_filtered = IS_ENABLED(CONFIG_HR_SCAN_FILTER);
+static bool scan_accept_list;
+static bool scan_active;
+static atomic_t scan_reports;
+static atomic_t scan_hr_reports;
+static atomic_t scan_reports_per_s;
+uint64_t total_rx_count; /* This value is exposed to test code */
+
+static void start_scan(void);
+static void scan_restart(void);
+static void cache_save(struct hr_sensor *s);
+
+static int sensor_slot(const struct hr_sensor *s)
+{
+	return (int)(s - sensors);
+}
+
+static struct hr_sensor *sensor_find(const struct bt_conn *conn)
+{
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (sensors[i].conn == conn) {
+			return &sensors[i];
+		}
+	}
+	return NULL;
+}
+
+static struct hr_sensor *sensor_free(void)
+{
+	return sensor_find(NULL);
+}
+
+static bool cache_valid(const struct hr_sensor *s)
+{
+	return s->cache.value_handle != 0U && s->cache.ccc_handle != 0U;
+}
+
+/* A free slot, the one that remembers addr or one that remembers nothing first */
+static struct hr_sensor *sensor_free_for(const bt_addr_le_t *addr)
+{
+	struct hr_sensor *unused = NULL;
+
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		struct hr_sensor *s = &sensors[i];
+
+		if (s->conn != NULL) {
+			continue;
+		}
+		if (cache_valid(s) && bt_addr_le_cmp(&s->cache.addr, addr) == 0) {
+			return s;
+		}
+		if (unused == NULL && !cache_valid(s)) {
+			unused = s;
+		}
+	}
+	return unused ? unused : sensor_free();
+}
+
+/* ---------------------------- AGGREGATION -------------------------------- */
+
+static bool sensor_active(const struct hr_sensor *s, uint32_t now)
+{
+	return s->connected && s->sbpm && (now - s->last_notify_ms) < HR_SENSOR_TIMEOUT_MS;
+}
+
+static uint16_t median(uint16_t *v, int n)
+{
+	/* At most HR_MAX_SENSORS values, an insertion sort will do */
+	for (int i = 1; i < n; i++) {
+		uint16_t x = v[i];
+		int j = i - 1;
+
+		while (j >= 0 && v[j] > x) {
+			v[j + 1] = v[j];
+			j--;
+		}
+		v[j + 1] = x;
+	}
+	if (n & 1) {
+		return v[n / 2];
+	}
+	return (uint16_t)((v[n / 2 - 1] + v[n / 2] + 1U) / 2U);
+}
+
+static uint16_t weighted(const uint16_t *v, const uint8_t *w, int n)
+{
+	uint32_t sum = 0;
+	uint32_t wsum = 0;
+
+	for (int i = 0; i < n; i++) {
+		sum += (uint32_t)v[i] * w[i];
+		wsum += w[i];
+	}
+	return (uint16_t)((sum + wsum / 2U) / wsum);
+}
+
+/* Call with hr_lock held */
+static uint16_t aggregate_locked(uint32_t now, uint8_t *bpm)
+{
+	uint16_t v_sbpm[HR_MAX_SENSORS];
+	uint16_t v_bpm[HR_MAX_SENSORS];
+	uint8_t w[HR_MAX_SENSORS];
+	int n = 0;
+
+	if (agg_policy == HR_POLICY_LEADER && sensor_active(&sensors[agg_leader], now)) {
+		if (bpm) {
+			*bpm = sensors[agg_leader].bpm;
+		}
+		return sensors[agg_leader].sbpm;
+	}
+
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (sensor_active(&sensors[i], now)) {
+			v_sbpm[n] = sensors[i].sbpm;
+			v_bpm[n] = sensors[i].bpm;
+			w[n] = sensors[i].weight;
+			n++;
+		}
+	}
+
+	if (n == 0) {
+		if (bpm) {
+			*bpm = 0;
+		}
+		return 0;
+	}
+
+	/* Without its leader the leader policy continues on the median */
+	if (agg_policy == HR_POLICY_WEIGHTED) {
+		if (bpm) {
+			*bpm = (uint8_t)weighted(v_bpm, w, n);
+		}
+		return weighted(v_sbpm, w, n);
+	}
+	if (bpm) {
+		*bpm = (uint8_t)median(v_bpm, n);
+	}
+	return median(v_sbpm, n);
+}
+
+uint16_t hr_central_get_sbpm(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&hr_lock);
+	uint16_t sbpm = aggregate_locked(k_uptime_get_32(), NULL);
+
+	k_spin_unlock(&hr_lock, key);
+	return sbpm;
+}
+
+uint8_t hr_central_get_bpm(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&hr_lock);
+	uint8_t bpm;
+
+	(void)aggregate_locked(k_uptime_get_32(), &bpm);
+	k_spin_unlock(&hr_lock, key);
+	return bpm;
+}
+
+int hr_central_active(void)
+{
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key = k_spin_lock(&hr_lock);
+	int n = 0;
+
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (sensor_active(&sensors[i], now)) {
+			n++;
+		}
+	}
+	k_spin_unlock(&hr_lock, key);
+	return n;
+}
+
+void hr_central_set_policy(enum hr_policy policy)
+{
+	k_spinlock_key_t key;
+
+	if (policy >= HR_POLICY_COUNT) {
+		return;
+	}
+	key = k_spin_lock(&hr_lock);
+	agg_policy = policy;
+	k_spin_unlock(&hr_lock, key);
+}
+
+enum hr_policy hr_central_get_policy(void)
+{
+	return agg_policy;
+}
+
+const char *hr_central_policy_name(enum hr_policy policy)
+{
+	static const char *const names[HR_POLICY_COUNT] = {"median", "weighted", "leader"};
+
+	return policy < HR_POLICY_COUNT ? names[policy] : "?";
+}
+
+int hr_central_set_leader(int slot)
+{
+	k_spinlock_key_t key;
+
+	if (slot < 0 || slot >= HR_MAX_SENSORS) {
+		return -EINVAL;
+	}
+	key = k_spin_lock(&hr_lock);
+	agg_leader = slot;
+	k_spin_unlock(&hr_lock, key);
+	return 0;
+}
+
+int hr_central_get_leader(void)
+{
+	return agg_leader;
+}
+
+int hr_central_get_sensor(int slot, struct hr_sensor_info *info)
+{
+	uint32_t now = k_uptime_get_32();
+	k_spinlock_key_t key;
+	const struct hr_sensor *s;
+
+	if (slot < 0 || slot >= HR_MAX_SENSORS) {
+		return -EINVAL;
+	}
+	s = &sensors[slot];
+
+	key = k_spin_lock(&hr_lock);
+	bt_addr_le_copy(&info->addr, &s->addr);
+	info->connected = s->connected;
+	info->active = sensor_active(s, now);
+	info->bpm = s->bpm;
+	info->sbpm = s->sbpm;
+	info->weight = s->weight;
+	info->notifications = s->notifications;
+	info->age_ms = s->notifications ? now - s->last_notify_ms : 0;
+	info->first_notify_ms = s->first_notify_ms;
+	info->cached = s->fast;
+	info->remembered = cache_valid(s);
+	info->conn_interval_us = s->conn_interval * 1250U;
+	info->conn_latency = s->conn_latency;
+	info->conn_timeout_ms = s->conn_timeout * 10U;
+	k_spin_unlock(&hr_lock, key);
+	return 0;
+}
+
+/* ---------------------------- SENSOR CACHE ------------------------------- */
+
+/*
+ * The BLE callbacks only mark a slot, the flash write is done from the
+ * system work queue.  Without CONFIG_HR_CACHE the sensors are still
+ * remembered until the next reboot.
+ */
+static atomic_t cache_dirty;
+
+static void cache_work_handler(struct k_work *work)
+{
+	uint32_t dirty = (uint32_t)atomic_clear(&cache_dirty);
+
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		struct hr_cache cache;
+		k_spinlock_key_t key;
+		char name[16];
+		int err;
+
+		if (!(dirty & BIT(i))) {
+			continue;
+		}
+		key = k_spin_lock(&hr_lock);
+		cache = sensors[i].cache;
+		k_spin_unlock(&hr_lock, key);
+
+		snprintk(name, sizeof(name), "hr/%d", i);
+		if (cache.value_handle) {
+			err = settings_save_one(name, &cache, sizeof(cache));
+		} else {
+			err = settings_delete(name);
+		}
+		if (err) {
+			LOG_WRN("Saving %s failed (err %d)", name, err);
+		}
+	}
+}
+
+static K_WORK_DEFINE(cache_work, cache_work_handler);
+
+static void cache_save(struct hr_sensor *s)
+{
+	if (IS_ENABLED(CONFIG_HR_CACHE)) {
+		atomic_or(&cache_dirty, BIT(sensor_slot(s)));
+		k_work_submit(&cache_work);
+	}
+}
+
+#ifdef CONFIG_HR_CACHE
+static int hr_settings_set(const char *name, size_t len, settings_read_cb read_cb, void *cb_arg)
+{
+	const char *next;
+	struct hr_cache cache;
+	long slot;
+	ssize_t n;
+
+	if (settings_name_next(name, &next) == 0 || next != NULL) {
+		return -ENOENT;
+	}
+	slot = strtol(name, NULL, 10);
+	if (slot < 0 || slot >= HR_MAX_SENSORS || len != sizeof(cache)) {
+		/* Left over from a build with more sensors */
+		return 0;
+	}
+
+	n = read_cb(cb_arg, &cache, sizeof(cache));
+	if (n != sizeof(cache)) {
+		return n < 0 ? (int)n : -EINVAL;
+	}
+	sensors[slot].cache = cache;
+	return 0;
+}
+
+SETTINGS_STATIC_HANDLER_DEFINE(hr_central, "hr", NULL, hr_settings_set, NULL, NULL);
+#endif
+
+void hr_central_forget(void)
+{
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		k_spinlock_key_t key = k_spin_lock(&hr_lock);
+
+		(void)memset(&sensors[i].cache, 0, sizeof(sensors[i].cache));
+		k_spin_unlock(&hr_lock, key);
+		cache_save(&sensors[i]);
+	}
+	scan_restart();
+}
+
+/* ---------------------------- BLE CALLBACKS ------------------------------ */
+
+/* Only asks the peripheral when the latency differs from the last request */
+static void conn_param_request(struct hr_sensor *s, uint16_t latency)
+{
+	int err;
+
+	if (s->req_latency == (int16_t)latency) {
+		return;
+	}
+	s->req_latency = (int16_t)latency;
+
+	err = bt_conn_le_param_update(s->conn, BT_LE_CONN_PARAM(HR_CONN_INTERVAL, HR_CONN_INTERVAL,
+								latency, HR_CONN_TIMEOUT));
+	if (err) {
+		/* Asked again on the next notification */
+		LOG_WRN("Sensor %d parameter update failed (err %d)", sensor_slot(s), err);
+		s->req_latency = -1;
+	} else {
+		LOG_INF("Sensor %d requests interval %u us, latency %u", sensor_slot(s),
+			HR_CONN_INTERVAL * 1250U, latency);
+	}
+}
+
+/* Latency is allowed once the tempo stays put, dropped on a change */
+static void conn_param_track(struct hr_sensor *s, uint16_t sbpm)
+{
+	uint16_t diff = sbpm > s->stable_ref ? sbpm - s->stable_ref : s->stable_ref - sbpm;
+
+	if (diff <= HR_STABLE_SBPM) {
+		if (s->stable_count < HR_STABLE_NOTIFY) {
+			s->stable_count++;
+		}
+	} else {
+		s->stable_ref = sbpm;
+		s->stable_count = 0;
+	}
+	conn_param_request(s, s->stable_count >= HR_STABLE_NOTIFY ? HR_CONN_STABLE_LATENCY : 0U);
+}
+
+static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
+			   const void *data, uint16_t length)
+{
+	struct hr_sensor *s = CONTAINER_OF(params, struct hr_sensor, subscribe_params);
+
+	if (!data) {
+		LOG_ERR("[UNSUBSCRIBED] sensor %d", sensor_slot(s));
+		params->value_handle = 0U;
+		return BT_GATT_ITER_STOP;
+	}
+
+	/* Start of the path to gen_sbpm(), see 'midi latency' */
+	hr_latency_notify();
+
+	struct hrm_measurement m;
+
+	if (hrm_parse(data, length, &m) == 0) {
+		uint32_t now = k_uptime_get_32();
+		k_spinlock_key_t key;
+		uint16_t sbpm;
+		uint16_t agg;
+
+		hrm_beat_est_process(&s->beats, &m, now);
+		sbpm = hrm_beat_est_get_sbpm(&s->beats);
+		if (sbpm == 0) {
+			/* No RR intervals from this sensor (yet) */
+			sbpm = MIN(m.bpm, 300U) * 100U;
+		}
+
+		key = k_spin_lock(&hr_lock);
+		s->bpm = (uint8_t)MIN(m.bpm, UINT8_MAX);
+		s->sbpm = sbpm;
+		/* A sensor without RR intervals counts as one beat */
+		s->weight = 1U + s->beats.count;
+		s->last_notify_ms = now;
+		if (s->notifications++ == 0U) {
+			s->first_notify_ms = now - s->connect_ms;
+		}
+		agg = aggregate_locked(now, NULL);
+		k_spin_unlock(&hr_lock, key);
+
+		conn_param_track(s, sbpm);
+
+		/*
+		 * Every notification is a beat of the aggregated tempo for the
+		 * heart rate clock source, its quality shows how steady the
+		 * sensors together are.
+		 */
+		if (agg) {
+			clock_source_beat(CLOCK_SOURCE_HR,
+					  sbpm_to_ticks(agg, clock_source_clock_freq()));
+		}
+
+		if (s->notifications == 1U) {
+			LOG_INF("Sensor %d first notification %u ms after connecting (%s)",
+				sensor_slot(s), s->first_notify_ms,
+				s->fast ? "cached handles" : "discovered");
+		}
+		LOG_INF("HR Notification [%d]: BPM=%u SBPM=%u RR=%u flags=0x%02x len=%u",
+			sensor_slot(s), m.bpm, sbpm, m.rr_count, m.flags, length);
+		k_event_post(hr_events, HR_CENTRAL_EVT_UPDATE);
+	} else {
+		LOG_WRN("HR Notification malformed len=%u", length);
+	}
+	total_rx_count++;
+
+	return BT_GATT_ITER_CONTINUE;
+}
+
+static void discover_start(struct hr_sensor *s);
+
+/* The CCC write of a subscription completed */
+static void subscribe_func(struct bt_conn *conn, uint8_t err,
+			   struct bt_gatt_subscribe_params *params)
+{
+	struct hr_sensor *s = CONTAINER_OF(params, struct hr_sensor, subscribe_params);
+	k_spinlock_key_t key;
+
+	if (err && s->fast) {
+		/* Different firmware or another sensor on the same address */
+		LOG_WRN("Cached handles of sensor %d invalid (ATT err 0x%02x), discovering",
+			sensor_slot(s), err);
+		s->fast = false;
+		key = k_spin_lock(&hr_lock);
+		(void)memset(&s->cache, 0, sizeof(s->cache));
+		k_spin_unlock(&hr_lock, key);
+		cache_save(s);
+		discover_start(s);
+		return;
+	}
+	if (err) {
+		LOG_ERR("Subscribe of sensor %d failed (ATT err 0x%02x)", sensor_slot(s), err);
+		return;
+	}
+
+	/* Short interval from now on, latency follows the tempo */
+	conn_param_request(s, 0U);
+
+	if (s->fast) {
+		return;
+	}
+
+	/* Found by discovery, remember it for the next connection */
+	key = k_spin_lock(&hr_lock);
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (&sensors[i] != s && cache_valid(&sensors[i]) &&
+		    bt_addr_le_cmp(&sensors[i].cache.addr, bt_conn_get_dst(conn)) == 0) {
+			(void)memset(&sensors[i].cache, 0, sizeof(sensors[i].cache));
+			cache_save(&sensors[i]);
+		}
+	}
+	bt_addr_le_copy(&s->cache.addr, bt_conn_get_dst(conn));
+	s->cache.value_handle = params->value_handle;
+	s->cache.ccc_handle = params->ccc_handle;
+	k_spin_unlock(&hr_lock, key);
+	cache_save(s);
+}
+
+static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
+			     struct bt_gatt_discover_params *params)
+{
+	struct hr_sensor *s = CONTAINER_OF(params, struct hr_sensor, discover_params);
+	int err;
+
+	if (!attr) {
+		LOG_INF("Discover complete");
+		(void)memset(params, 0, sizeof(*params));
+		return BT_GATT_ITER_STOP;
+	}
+
+	LOG_INF("[ATTRIBUTE] handle %u", attr->handle);
+
+	if (!bt_uuid_cmp(s->discover_params.uuid, BT_UUID_HRS)) {
+		memcpy(&s->discover_uuid, BT_UUID_HRS_MEASUREMENT, sizeof(s->discover_uuid));
+		s->discover_params.uuid = &s->discover_uuid.uuid;
+		s->discover_params.start_handle = attr->handle + 1;
+		s->discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
+
+		err = bt_gatt_discover(conn, &s->discover_params);
+		if (err) {
+			LOG_ERR("Discover failed (err %d)", err);
+		}
+	} else if (!bt_uuid_cmp(s->discover_params.uuid, BT_UUID_HRS_MEASUREMENT)) {
+		memcpy(&s->discover_uuid, BT_UUID_GATT_CCC, sizeof(s->discover_uuid));
+		s->discover_params.uuid = &s->discover_uuid.uuid;
+		s->discover_params.start_handle = attr->handle + 2;
+		s->discover_params.type = BT_GATT_DISCOVER_DESCRIPTOR;
+		s->subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
+
+		err = bt_gatt_discover(conn, &s->discover_params);
+		if (err) {
+			LOG_ERR("Discover failed (err %d)", err);
+		}
+	} else {
+		s->subscribe_params.notify = notify_func;
+		s->subscribe_params.subscribe = subscribe_func;
+		s->subscribe_params.value = BT_GATT_CCC_NOTIFY;
+		s->subscribe_params.ccc_handle = attr->handle;
+
+		err = bt_gatt_subscribe(conn, &s->subscribe_params);
+		if (err && err != -EALREADY) {
+			LOG_ERR("Subscribe failed (err %d)", err);
+		} else {
+			LOG_INF("[SUBSCRIBED] sensor %d", sensor_slot(s));
+		}
+
+		return BT_GATT_ITER_STOP;
+	}
+
+	return BT_GATT_ITER_STOP;
+}
+
+/* Primary service, measurement characteristic and then its CCC */
+static void discover_start(struct hr_sensor *s)
+{
+	int err;
+
+	memcpy(&s->discover_uuid, BT_UUID_HRS, sizeof(s->discover_uuid));
+	s->discover_params.uuid = &s->discover_uuid.uuid;
+	s->discover_params.func = discover_func;
+	s->discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
+	s->discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
+	s->discover_params.type = BT_GATT_DISCOVER_PRIMARY;
+
+	err = bt_gatt_discover(s->conn, &s->discover_params);
+	if (err) {
+		LOG_ERR("Discover failed (err %d)", err);
+	}
+}
+
+/*
+ * Scanned: wait for any advertising report of addr.  Directed: the
+ * controller initiates on the first advertising packet of a remembered
+ * sensor without scanning first, and gives up after HR_DIRECT_TIMEOUT_MS.
+ */
+static int create_conn(struct hr_sensor *s, const bt_addr_le_t *addr, bool directed)
+{
+	struct bt_conn_le_create_param *create_param;
+	struct bt_le_conn_param *param;
+	struct bt_conn *existing;
+	int err;
+
+	/* Still advertising while we are connected to it */
+	existing = bt_conn_lookup_addr_le(BT_ID_DEFAULT, addr);
+	if (existing) {
+		bt_conn_unref(existing);
+		return -EALREADY;
+	}
+
+	if (scanning) {
+		err = bt_le_scan_stop();
+		if (err) {
+			LOG_ERR("Stop LE scan failed (err %d)", err);
+			return err;
+		}
+		scanning = false;
+	}
+
+	LOG_INF("Creating %s connection with Coded PHY support, sensor %d",
+		directed ? "directed" : "scanned", sensor_slot(s));
+	param = BT_LE_CONN_PARAM_DEFAULT;
+	create_param = BT_CONN_LE_CREATE_CONN;
+	create_param->options |= BT_CONN_LE_OPT_CODED;
+	create_param->timeout = directed ? HR_DIRECT_TIMEOUT_MS / 10U : 0U;
+	s->connect_ms = k_uptime_get_32();
+	err = bt_conn_le_create(addr, create_param, param, &s->conn);
+	if (err) {
+		LOG_INF("Coded PHY connection failed (err %d), trying non-Coded", err);
+
+		create_param->options &= ~BT_CONN_LE_OPT_CODED;
+		err = bt_conn_le_create(addr, create_param, param, &s->conn);
+		if (err) {
+			LOG_ERR("Create connection failed (err %d)", err);
+			s->conn = NULL;
+			return err;
+		}
+	}
+	connecting = s;
+	return 0;
+}
+
+static void connect_sensor(const bt_addr_le_t *addr)
+{
+	struct hr_sensor *s;
+
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	s = sensor_free_for(addr);
+	if (s != NULL && !connecting && create_conn(s, addr, false) && !scanning) {
+		start_scan();
+	}
+	k_mutex_unlock(&scan_mutex);
+}
+
+/* Directed connect to the next remembered sensor that is not connected */
+static bool connect_cached(void)
+{
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		struct hr_sensor *s = &sensors[i];
+
+		if (s->conn != NULL || s->direct_tried || !cache_valid(s)) {
+			continue;
+		}
+		s->direct_tried = true;
+		if (create_conn(s, &s->cache.addr, true) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static bool eir_found(struct bt_data *data, void *user_data)
+{
+	bt_addr_le_t *addr = user_data;
+	int i;
+
+	LOG_DBG("[AD]: %u data_len %u", data->type, data->data_len);
+
+	switch (data->type) {
+	case BT_DATA_UUID16_SOME:
+	case BT_DATA_UUID16_ALL:
+		if (data->data_len % sizeof(uint16_t) != 0U) {
+			LOG_INF("AD malformed");
+			return true;
+		}
+
+		for (i = 0; i < data->data_len; i += sizeof(uint16_t)) {
+			const struct bt_uuid *uuid;
+			uint16_t u16;
+
+			memcpy(&u16, &data->data[i], sizeof(u16));
+			uuid = BT_UUID_DECLARE_16(sys_le16_to_cpu(u16));
+			if (bt_uuid_cmp(uuid, BT_UUID_HRS)) {
+				continue;
+			}
+
+			atomic_inc(&scan_hr_reports);
+			connect_sensor(addr);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
+			 struct net_buf_simple *ad)
+{
+	/*
+	 * Every advertising report in range ends up here, keep it cheap:
+	 * no address formatting or logging per report.
+	 */
+	atomic_inc(&scan_reports);
+
+	/* We're only interested in legacy connectable events or
+	 * possible extended advertising that are connectable.
+	 */
+	if (type != BT_GAP_ADV_TYPE_ADV_IND && type != BT_GAP_ADV_TYPE_ADV_DIRECT_IND &&
+	    type != BT_GAP_ADV_TYPE_EXT_ADV) {
+		return;
+	}
+
+	if (scan_accept_list) {
+		/* The controller only reports the remembered sensors */
+		atomic_inc(&scan_hr_reports);
+		connect_sensor(addr);
+		return;
+	}
+	bt_data_parse(ad, eir_found, (void *)addr);
+}
+
+/*
+ * Only the remembered sensors that are not connected go on the accept
+ * list.  The list can only change while not scanning or connecting.
+ *
+ * @return number of addresses on the list
+ */
+static int accept_list_update(void)
+{
+	int n = 0;
+	int err;
+
+	err = bt_le_filter_accept_list_clear();
+	if (err) {
+		LOG_WRN("Clearing the accept list failed (err %d)", err);
+		return 0;
+	}
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (sensors[i].conn != NULL || !cache_valid(&sensors[i])) {
+			continue;
+		}
+		err = bt_le_filter_accept_list_add(&sensors[i].cache.addr);
+		if (err) {
+			LOG_WRN("Accept list add failed (err %d)", err);
+			continue;
+		}
+		n++;
+	}
+	return n;
+}
+
+static bool any_remembered(void)
+{
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		if (cache_valid(&sensors[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void scan_backoff_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(scan_backoff_work, scan_backoff_handler);
+
+/*
+ * Reconnects the remembered sensors first, then scans as long as a sensor
+ * slot is free and no connection is being made.
+ *
+ * Filtered: once a sensor is remembered only the remembered sensors are
+ * looked for, with the controller accept list and a passive scan.  When
+ * they are all connected and a slot is still free it falls back to an
+ * open scan at the slowest level.  Open: any HRS advertiser, passive
+ * unless CONFIG_HR_SCAN_ACTIVE.  Both filter duplicates in the
+ * controller.
+ */
+static void start_scan(void)
+{
+	const struct scan_level *level;
+	int err;
+
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	if (scanning || connecting || connect_cached() || sensor_free() == NULL) {
+		goto out;
+	}
+
+	scan_accept_list = false;
+	if (scan_filtered && any_remembered()) {
+		if (accept_list_update() > 0) {
+			scan_accept_list = true;
+		} else {
+			/*
+			 * The remembered sensors are all connected, a free slot
+			 * is still filled by a new one at the lowest duty.
+			 */
+			scan_level = ARRAY_SIZE(scan_levels) - 1U;
+		}
+	}
+	scan_active = !scan_accept_list && IS_ENABLED(CONFIG_HR_SCAN_ACTIVE);
+	level = &scan_levels[scan_level];
+
+	struct bt_le_scan_param scan_param = {
+		.type = scan_active ? BT_LE_SCAN_TYPE_ACTIVE : BT_LE_SCAN_TYPE_PASSIVE,
+		.options = BT_LE_SCAN_OPT_CODED | BT_LE_SCAN_OPT_FILTER_DUPLICATE |
+			   (scan_accept_list ? BT_LE_SCAN_OPT_FILTER_ACCEPT_LIST : 0),
+		.interval = level->interval,
+		.window = level->window,
+	};
+
+	err = bt_le_scan_start(&scan_param, device_found);
+	if (err) {
+		LOG_INF("Scanning with Coded PHY failed (err %d), trying without", err);
+
+		scan_param.options &= ~BT_LE_SCAN_OPT_CODED;
+		err = bt_le_scan_start(&scan_param, device_found);
+		if (err) {
+			LOG_ERR("Scanning failed to start (err %d)", err);
+			goto out;
+		}
+	}
+	scanning = true;
+
+	if (level->hold_s) {
+		k_work_reschedule(&scan_backoff_work, K_SECONDS(level->hold_s));
+	}
+
+	LOG_INF("Scanning successfully started (%s %s, level %u)",
+		scan_accept_list ? "accept list" : "open", scan_active ? "active" : "passive",
+		scan_level);
+out:
+	k_mutex_unlock(&scan_mutex);
+}
+
+/* Nothing found for a while, scan again with less duty */
+static void scan_backoff_handler(struct k_work *work)
+{
+	int err;
+
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	if (scanning && scan_level < ARRAY_SIZE(scan_levels) - 1U) {
+		err = bt_le_scan_stop();
+		if (err) {
+			LOG_ERR("Stop LE scan failed (err %d)", err);
+		} else {
+			scanning = false;
+			scan_level++;
+			start_scan();
+		}
+	}
+	k_mutex_unlock(&scan_mutex);
+}
+
+/* Fast again after losing a sensor, slow when only spare slots are free */
+static void scan_backoff_reset(bool urgent)
+{
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	scan_level = urgent ? 0U : ARRAY_SIZE(scan_levels) - 1U;
+	k_mutex_unlock(&scan_mutex);
+}
+
+static void scan_rate_handler(struct k_timer *timer)
+{
+	static atomic_val_t last;
+	atomic_val_t now = atomic_get(&scan_reports);
+
+	atomic_set(&scan_reports_per_s, now - last);
+	last = now;
+}
+
+K_TIMER_DEFINE(scan_rate_timer, scan_rate_handler, NULL);
+
+void hr_central_get_scan_stats(struct hr_scan_stats *stats)
+{
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	stats->scanning = scanning;
+	stats->filtered = scan_filtered;
+	stats->accept_list = scan_accept_list;
+	stats->active = scan_active;
+	stats->level = scan_level;
+	stats->interval_us = scan_levels[scan_level].interval * 625U;
+	stats->window_us = scan_levels[scan_level].window * 625U;
+	k_mutex_unlock(&scan_mutex);
+	stats->reports = (uint32_t)atomic_get(&scan_reports);
+	stats->reports_per_s = (uint32_t)atomic_get(&scan_reports_per_s);
+	stats->hr_reports = (uint32_t)atomic_get(&scan_hr_reports);
+}
+
+/* Again from the fastest level, e.g. with another accept list */
+static void scan_restart(void)
+{
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	scan_level = 0U;
+	if (scanning && bt_le_scan_stop() == 0) {
+		scanning = false;
+	}
+	start_scan();
+	k_mutex_unlock(&scan_mutex);
+}
+
+void hr_central_set_scan_filter(bool filtered)
+{
+	scan_filtered = filtered;
+	scan_restart();
+}
+
+static void connected(struct bt_conn *conn, uint8_t conn_err)
+{
+	struct hr_sensor *s = sensor_find(conn);
+	struct bt_conn_info conn_info;
+	char addr[BT_ADDR_LE_STR_LEN];
+	k_spinlock_key_t key;
+	bool first = true;
+	int err;
+
+	if (s == NULL) {
+		return;
+	}
+	k_mutex_lock(&scan_mutex, K_FOREVER);
+	if (connecting == s) {
+		connecting = NULL;
+	}
+	k_mutex_unlock(&scan_mutex);
+
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+
+	if (conn_err) {
+		/* Also a directed connect to a sensor that is not around */
+		LOG_ERR("Failed to connect to %s (%u)", addr, conn_err);
+
+		bt_conn_unref(s->conn);
+		s->conn = NULL;
+
+		start_scan();
+		return;
+	}
+
+	LOG_INF("Connected: %s, sensor %d", addr, sensor_slot(s));
+
+	hrm_beat_est_init(&s->beats);
+	(void)memset(&s->subscribe_params, 0, sizeof(s->subscribe_params));
+	s->fast = cache_valid(s) && bt_addr_le_cmp(&s->cache.addr, bt_conn_get_dst(conn)) == 0;
+	s->req_latency = -1;
+	s->stable_ref = 0;
+	s->stable_count = 0;
+	if (bt_conn_get_info(conn, &conn_info)) {
+		conn_info.le.interval = 0;
+		conn_info.le.latency = 0;
+		conn_info.le.timeout = 0;
+	}
+
+	key = k_spin_lock(&hr_lock);
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		first = first && !sensors[i].connected;
+	}
+	bt_addr_le_copy(&s->addr, bt_conn_get_dst(conn));
+	s->connected = true;
+	s->bpm = 0;
+	s->sbpm = 0;
+	s->weight = 0;
+	s->notifications = 0;
+	s->first_notify_ms = 0;
+	s->conn_interval = conn_info.le.interval;
+	s->conn_latency = conn_info.le.latency;
+	s->conn_timeout = conn_info.le.timeout;
+	k_spin_unlock(&hr_lock, key);
+
+	if (first) {
+		total_rx_count = 0U;
+	}
+
+	if (s->fast) {
+		/* Straight to the CCC write, subscribe_func() checks the handles */
+		s->subscribe_params.notify = notify_func;
+		s->subscribe_params.subscribe = subscribe_func;
+		s->subscribe_params.value = BT_GATT_CCC_NOTIFY;
+		s->subscribe_params.value_handle = s->cache.value_handle;
+		s->subscribe_params.ccc_handle = s->cache.ccc_handle;
+
+		err = bt_gatt_subscribe(conn, &s->subscribe_params);
+		if (err && err != -EALREADY) {
+			LOG_WRN("Cached subscribe failed (err %d), discovering", err);
+			s->fast = false;
+			(void)memset(&s->subscribe_params, 0, sizeof(s->subscribe_params));
+			discover_start(s);
+		}
+	} else {
+		discover_start(s);
+	}
+
+	/* Look for the next sensor while there is a free slot */
+	scan_backoff_reset(false);
+	start_scan();
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	struct hr_sensor *s = sensor_find(conn);
+	char addr[BT_ADDR_LE_STR_LEN];
+	k_spinlock_key_t key;
+
+	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
+
+	LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
+
+	if (s == NULL) {
+		return;
+	}
+
+	/* Out of the aggregate at once, the other sensors keep the clock */
+	key = k_spin_lock(&hr_lock);
+	s->connected = false;
+	s->sbpm = 0;
+	k_spin_unlock(&hr_lock, key);
+
+	bt_conn_unref(s->conn);
+	s->conn = NULL;
+	/* The first thing start_scan() tries is a directed reconnect */
+	s->direct_tried = false;
+	k_event_post(hr_events, HR_CENTRAL_EVT_LOST);
+
+	scan_backoff_reset(true);
+	start_scan();
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval, uint16_t latency,
+			     uint16_t timeout)
+{
+	struct hr_sensor *s = sensor_find(conn);
+	k_spinlock_key_t key;
+
+	if (s == NULL) {
+		return;
+	}
+	LOG_INF("Sensor %d interval %u us, latency %u, timeout %u ms", sensor_slot(s),
+		interval * 1250U, latency, timeout * 10U);
+
+	key = k_spin_lock(&hr_lock);
+	s->conn_interval = interval;
+	s->conn_latency = latency;
+	s->conn_timeout = timeout;
+	k_spin_unlock(&hr_lock, key);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.le_param_updated = le_param_updated,
+};
+
+int hr_central_start(struct k_event *events)
+{
+	int err;
+
+	hr_events = events;
+
+	err = bt_enable(NULL);
+	if (err) {
+		LOG_ERR("Bluetooth init failed (err %d)", err);
+		return err;
+	}
+
+	if (IS_ENABLED(CONFIG_SETTINGS)) {
+		/* The Bluetooth identity and bonds and the remembered sensors */
+		err = settings_load();
+		if (err) {
+			LOG_WRN("Loading settings failed (err %d)", err);
+		}
+	}
+
+	LOG_INF("Bluetooth initialized, up to %d heart rate sensors", HR_MAX_SENSORS);
+	k_timer_start(&scan_rate_timer, K_SECONDS(1), K_SECONDS(1));
+	start_scan();
+	return 0;
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_hr(const struct shell *sh, size_t argc, char **argv)
+{
+	struct hr_sensor_info info;
+	struct hr_scan_stats scan;
+	char addr[BT_ADDR_LE_STR_LEN];
+	uint16_t sbpm = hr_central_get_sbpm();
+
+	shell_print(sh, "policy %s, leader %d, %d of %d sensors active",
+		    hr_central_policy_name(hr_central_get_policy()), hr_central_get_leader(),
+		    hr_central_active(), HR_MAX_SENSORS);
+	shell_print(sh, "%-4s %-30s %4s %7s %6s %8s %7s %8s", "slot", "address", "bpm", "sbpm",
+		    "weight", "notify", "age ms", "first ms");
+	for (int i = 0; i < HR_MAX_SENSORS; i++) {
+		hr_central_get_sensor(i, &info);
+		if (!info.connected) {
+			shell_print(sh, "%-4d %-30s", i,
+				    info.remembered ? "(remembered)" : "(free)");
+			continue;
+		}
+		bt_addr_le_to_str(&info.addr, addr, sizeof(addr));
+		shell_print(sh, "%-4d %-30s %4u %7u %6u %8u %7u %8u %s%s", i, addr, info.bpm,
+			    info.sbpm, info.weight, info.notifications, info.age_ms,
+			    info.first_notify_ms, info.cached ? "cached" : "discovered",
+			    info.active ? "" : " (stale)");
+		shell_print(sh, "     interval %u us, latency %u, timeout %u ms",
+			    info.conn_interval_us, info.conn_latency, info.conn_timeout_ms);
+	}
+	shell_print(sh, "aggregate %u.%02u BPM", sbpm / 100U, sbpm % 100U);
+
+	hr_central_get_scan_stats(&scan);
+	shell_print(sh, "scan %s, %s mode%s%s, level %u (%u/%u us), %u reports/s, %u total, %u HRS",
+		    scan.scanning ? "on" : "off", scan.filtered ? "filtered" : "open",
+		    scan.accept_list ? ", accept list" : "",
+		    scan.active ? ", active" : ", passive", scan.level, scan.window_us,
+		    scan.interval_us, scan.reports_per_s, scan.reports, scan.hr_reports);
+	return 0;
+}
+
+static int cmd_midi_hr_scan(const struct shell *sh, size_t argc, char **argv)
+{
+	if (strcmp(argv[1], "filtered") == 0) {
+		hr_central_set_scan_filter(true);
+	} else if (strcmp(argv[1], "open") == 0) {
+		hr_central_set_scan_filter(false);
+	} else {
+		shell_error(sh, "use filtered or open");
+		return -EINVAL;
+	}
+	shell_print(sh, "scan %s", argv[1]);
+	return 0;
+}
+
+static int cmd_midi_hr_forget(const struct shell *sh, size_t argc, char **argv)
+{
+	hr_central_forget();
+	shell_print(sh, "remembered sensors cleared");
+	return 0;
+}
+
+static int cmd_midi_hr_policy(const struct shell *sh, size_t argc, char **argv)
+{
+	for (int p = 0; p < HR_POLICY_COUNT; p++) {
+		if (strcmp(argv[1], hr_central_policy_name(p)) == 0) {
+			hr_central_set_policy(p);
+			shell_print(sh, "policy %s", argv[1]);
+			return 0;
+		}
+	}
+	shell_error(sh, "unknown policy %s, use median, weighted or leader", argv[1]);
+	return -EINVAL;
+}
+
+static int cmd_midi_hr_leader(const struct shell *sh, size_t argc, char **argv)
+{
+	int slot = (int)strtol(argv[1], NULL, 10);
+
+	if (hr_central_set_leader(slot)) {
+		shell_error(sh, "slot 0..%d", HR_MAX_SENSORS - 1);
+		return -EINVAL;
+	}
+	shell_print(sh, "leader %d", slot);
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(midi_hr_cmds,
+	SHELL_CMD_ARG(policy, NULL, "Aggregation <median|weighted|leader>", cmd_midi_hr_policy,
+		      2, 0),
+	SHELL_CMD_ARG(leader, NULL, "Sensor followed by the leader policy <slot>",
+		      cmd_midi_hr_leader, 2, 0),
+	SHELL_CMD_ARG(scan, NULL, "Only remembered sensors or any sensor <filtered|open>",
+		      cmd_midi_hr_scan, 2, 0),
+	SHELL_CMD_ARG(forget, NULL, "Forget the remembered sensors and GATT handles",
+		      cmd_midi_hr_forget, 1, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((midi), hr, &midi_hr_cmds, "Heart rate sensors and their aggregate",
+		 cmd_midi_hr, 1, 0);
+#endif
+
+/* EOF */
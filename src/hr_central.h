@@ -0,0 +1,143 @@
+/**
+ * @file hr_central.h
+ * @brief BLE central for up to HR_MAX_SENSORS heart rate sensors.
+ *
+ * Every sensor has its own connection, GATT parameters and RR beat
+ * estimator.  The tempo handed to the clock is aggregated from all
+ * sensors that notified recently, so when one sensor drops the others
+ * keep controlling the clock while a free slot is scanned for again.
+ *
+ * The address and HRS handles of every sensor are remembered (in
+ * settings with CONFIG_HR_CACHE), a remembered sensor is reconnected
+ * with a directed connect and subscribed without a GATT discovery.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260318
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef HR_CENTRAL_H
+#define HR_CENTRAL_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/addr.h>
+
+#define HR_MAX_SENSORS CONFIG_HR_MAX_SENSORS
+
+/* A sensor without a notification for this long is left out */
+#define HR_SENSOR_TIMEOUT_MS 3000
+
+/* Posted to the event object given to hr_central_start() */
+#define HR_CENTRAL_EVT_UPDATE BIT(0)
+#define HR_CENTRAL_EVT_LOST   BIT(1)
+
+enum hr_policy {
+	/* Median of the sensors, one sensor that goes wild is ignored */
+	HR_POLICY_MEDIAN = 0,
+	/* Mean weighted by the number of RR intervals in the window */
+	HR_POLICY_WEIGHTED,
+	/* One chosen sensor, the median of the others when it is gone */
+	HR_POLICY_LEADER,
+	HR_POLICY_COUNT
+};
+
+struct hr_sensor_info {
+	bt_addr_le_t addr;
+	bool connected;
+	/* Notified within HR_SENSOR_TIMEOUT_MS */
+	bool active;
+	uint8_t bpm;
+	uint16_t sbpm;
+	uint8_t weight;
+	uint32_t notifications;
+	uint32_t age_ms;
+	/* From creating the connection to the first notification */
+	uint32_t first_notify_ms;
+	/* Subscribed with the remembered handles, without discovery */
+	bool cached;
+	/* Address and GATT handles remembered for this slot */
+	bool remembered;
+	uint32_t conn_interval_us;
+	/* Connection events the sensor may skip */
+	uint16_t conn_latency;
+	uint32_t conn_timeout_ms;
+};
+
+struct hr_scan_stats {
+	bool scanning;
+	/* Only the remembered sensors once one is remembered */
+	bool filtered;
+	bool accept_list;
+	bool active;
+	/* Backoff level, 0 is the fastest */
+	uint8_t level;
+	uint32_t interval_us;
+	uint32_t window_us;
+	/* Advertising reports seen by the host */
+	uint32_t reports;
+	uint32_t reports_per_s;
+	uint32_t hr_reports;
+};
+
+/**
+ * @brief Enable Bluetooth and start scanning for heart rate sensors.
+ *
+ * @param events HR_CENTRAL_EVT_* are posted here from the BLE callbacks
+ * @return 0 or the error of bt_enable()
+ */
+int hr_central_start(struct k_event *events);
+
+/**
+ * @brief Aggregated tempo of the active sensors.
+ *
+ * @return scaled BPM or 0 without an active sensor
+ */
+uint16_t hr_central_get_sbpm(void);
+
+/**
+ * @brief Aggregated heart rate of the active sensors, 0 without one.
+ */
+uint8_t hr_central_get_bpm(void);
+
+/**
+ * @brief Number of sensors that notified within HR_SENSOR_TIMEOUT_MS.
+ */
+int hr_central_active(void);
+
+void hr_central_set_policy(enum hr_policy policy);
+enum hr_policy hr_central_get_policy(void);
+const char *hr_central_policy_name(enum hr_policy policy);
+
+/**
+ * @brief Sensor slot followed by HR_POLICY_LEADER.
+ *
+ * @return 0 or -EINVAL for a slot out of range
+ */
+int hr_central_set_leader(int slot);
+int hr_central_get_leader(void);
+
+/**
+ * @brief Snapshot of one sensor slot.
+ *
+ * @return 0 or -EINVAL for a slot out of range
+ */
+int hr_central_get_sensor(int slot, struct hr_sensor_info *info);
+
+/**
+ * @brief Forget the remembered sensor addresses and GATT handles.
+ *
+ * The connected sensors stay connected, the next reconnect discovers
+ * again.
+ */
+void hr_central_forget(void);
+
+void hr_central_get_scan_stats(struct hr_scan_stats *stats);
+
+/**
+ * @brief Only look for the remembered sensors or for any sensor.
+ *
+ * Restarts the scan at the fastest level.
+ */
+void hr_central_set_scan_filter(bool filtered);
+
+#endif /* HR_CENTRAL_H */
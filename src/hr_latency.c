@@ -0,0 +1,126 @@
+/**
+ * @file hr_latency.c
+ * @brief Latency from a heart rate notification to the generated clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260320
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+
+#include "hr_latency.h"
+
+struct latency_acc {
+	uint32_t count;
+	uint32_t last;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+};
+
+static struct k_spinlock latency_lock;
+static struct latency_acc acc[HR_LATENCY_COUNT];
+
+/* Cycle counter of the latest notification */
+static atomic_t notify_cyc;
+/* Notification cycle counter of the target the clock has not applied yet */
+static atomic_t pending_cyc;
+static atomic_t pending;
+
+static uint32_t acc_add(struct latency_acc *a, uint32_t cycles)
+{
+	uint32_t us = k_cyc_to_us_floor32(cycles);
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	if (a->count == 0 || us < a->min) {
+		a->min = us;
+	}
+	if (a->count == 0 || us > a->max) {
+		a->max = us;
+	}
+	a->last = us;
+	a->sum += us;
+	a->count++;
+	k_spin_unlock(&latency_lock, key);
+	return us;
+}
+
+void hr_latency_notify(void)
+{
+	atomic_set(&notify_cyc, (atomic_val_t)k_cycle_get_32());
+}
+
+void hr_latency_target(void)
+{
+	uint32_t stamp = (uint32_t)atomic_get(&notify_cyc);
+
+	acc_add(&acc[HR_LATENCY_TARGET], k_cycle_get_32() - stamp);
+	atomic_set(&pending_cyc, (atomic_val_t)stamp);
+	atomic_set(&pending, 1);
+}
+
+uint32_t hr_latency_gen(void)
+{
+	uint32_t us;
+
+	if (!atomic_cas(&pending, 1, 0)) {
+		return 0;
+	}
+	us = acc_add(&acc[HR_LATENCY_TOTAL], k_cycle_get_32() - (uint32_t)atomic_get(&pending_cyc));
+	return MAX(us, 1U);
+}
+
+void hr_latency_get(enum hr_latency_stage stage, struct hr_latency_report *out)
+{
+	const struct latency_acc *a = &acc[stage];
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	out->count = a->count;
+	out->last_us = a->last;
+	out->min_us = a->min;
+	out->max_us = a->max;
+	out->mean_us = a->count ? (uint32_t)(a->sum / a->count) : 0;
+	k_spin_unlock(&latency_lock, key);
+}
+
+void hr_latency_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&latency_lock);
+
+	(void)memset(acc, 0, sizeof(acc));
+	k_spin_unlock(&latency_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_latency(const struct shell *sh, size_t argc, char **argv)
+{
+	static const char *const names[HR_LATENCY_COUNT] = {"target", "gen_sbpm"};
+	struct hr_latency_report r;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		hr_latency_reset();
+		shell_print(sh, "latency reset");
+		return 0;
+	}
+
+	shell_print(sh, "heart rate notification to (us)");
+	shell_print(sh, "%-9s %8s %9s %9s %9s %9s", "stage", "count", "last", "min", "mean", "max");
+	for (int i = 0; i < HR_LATENCY_COUNT; i++) {
+		hr_latency_get(i, &r);
+		shell_print(sh, "%-9s %8u %9u %9u %9u %9u", names[i], r.count, r.last_us, r.min_us,
+			    r.mean_us, r.max_us);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), latency, NULL, "Heart rate to clock latency [reset]", cmd_midi_latency,
+		 1, 1);
+#endif
+
+/* EOF */
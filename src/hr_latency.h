@@ -0,0 +1,57 @@
+/**
+ * @file hr_latency.h
+ * @brief Latency from a heart rate notification to the generated clock.
+ *
+ * Three points on the path are timestamped with the cycle counter: the
+ * notification arriving in the BLE callback, main() handing the new
+ * target tempo to the ramp, and the clock callback calling gen_sbpm()
+ * with it.  The first part shows the thread latency, the total also
+ * contains the wait for the next 24pqn pulse.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260320
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef HR_LATENCY_H
+#define HR_LATENCY_H
+#include <stdint.h>
+
+enum hr_latency_stage {
+	/* Notification to tempo_slew_set_target() */
+	HR_LATENCY_TARGET = 0,
+	/* Notification to gen_sbpm() */
+	HR_LATENCY_TOTAL,
+	HR_LATENCY_COUNT
+};
+
+struct hr_latency_report {
+	uint32_t count;
+	uint32_t last_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint32_t mean_us;
+};
+
+/**
+ * @brief A heart rate notification arrived, BLE callback.
+ */
+void hr_latency_notify(void);
+
+/**
+ * @brief The tempo of the latest notification is the new target, main().
+ */
+void hr_latency_target(void);
+
+/**
+ * @brief gen_sbpm() was called, clock callback (ISR).
+ *
+ * Only the first call after hr_latency_target() is measured.
+ *
+ * @return the total latency in us or 0 when nothing was pending
+ */
+uint32_t hr_latency_gen(void);
+
+void hr_latency_get(enum hr_latency_stage stage, struct hr_latency_report *out);
+void hr_latency_reset(void);
+
+#endif /* HR_LATENCY_H */
@@ -0,0 +1,109 @@
+/**
+ * @file hrm.c
+ * @brief Bluetooth Heart Rate Measurement parsing and RR beat estimator.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260228
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "hrm.h"
+
+int hrm_parse(const uint8_t *data, uint16_t length, struct hrm_measurement *m)
+{
+	uint16_t pos = 0;
+
+	memset(m, 0, sizeof(*m));
+	if (length < 2) {
+		return -EINVAL;
+	}
+
+	m->flags = data[pos++];
+
+	if (m->flags & HRM_FLAG_HR_UINT16) {
+		if (length < pos + 2) {
+			return -EINVAL;
+		}
+		m->bpm = sys_get_le16(&data[pos]);
+		pos += 2;
+	} else {
+		m->bpm = data[pos++];
+	}
+
+	if (m->flags & HRM_FLAG_ENERGY_EXPENDED) {
+		if (length < pos + 2) {
+			return -EINVAL;
+		}
+		m->energy_kj = sys_get_le16(&data[pos]);
+		pos += 2;
+	}
+
+	if (m->flags & HRM_FLAG_RR_INTERVAL) {
+		/* A trailing odd byte is ignored */
+		while (pos + 2 <= length && m->rr_count < HRM_RR_MAX) {
+			m->rr[m->rr_count++] = sys_get_le16(&data[pos]);
+			pos += 2;
+		}
+	}
+
+	return 0;
+}
+
+void hrm_beat_est_init(struct hrm_beat_est *est)
+{
+	memset(est, 0, sizeof(*est));
+}
+
+int hrm_beat_est_process(struct hrm_beat_est *est, const struct hrm_measurement *m,
+			 uint32_t now_ms)
+{
+	int accepted = 0;
+
+	for (int i = 0; i < m->rr_count; i++) {
+		uint16_t rr = m->rr[i];
+
+		/* Missed or double detected beats would pull the average */
+		if (rr < HRM_RR_MIN || rr > HRM_RR_MAX_VALUE) {
+			est->rejected++;
+			continue;
+		}
+
+		if (est->count == HRM_BEAT_WINDOW) {
+			est->rr_sum -= est->rr[est->pos];
+		} else {
+			est->count++;
+		}
+		est->rr[est->pos] = rr;
+		est->rr_sum += rr;
+		est->pos = (est->pos + 1) % HRM_BEAT_WINDOW;
+		est->beats++;
+		accepted++;
+	}
+
+	if (accepted) {
+		est->last_beat_ms = now_ms;
+	}
+	return accepted;
+}
+
+uint16_t hrm_beat_est_get_sbpm(const struct hrm_beat_est *est)
+{
+	if (est->count == 0 || est->rr_sum == 0) {
+		return 0;
+	}
+
+	/* Rounded, count <= 16 so this fits easily in 32 bits */
+	return (uint16_t)((HRM_RR_TO_SBPM * est->count + est->rr_sum / 2U) / est->rr_sum);
+}
+
+uint32_t hrm_beat_est_get_last_beat(const struct hrm_beat_est *est)
+{
+	return est->last_beat_ms;
+}
+
+/* EOF */
@@ -0,0 +1,102 @@
+/**
+ * @file hrm.h
+ * @brief Bluetooth Heart Rate Measurement parsing and RR beat estimator.
+ *
+ * The Heart Rate Measurement characteristic (0x2A37) carries a flags
+ * byte, an 8 or 16 bit heart rate, optionally the energy expended and
+ * zero or more RR intervals in 1/1024 s.  The RR intervals are what the
+ * sensor actually measured between beats, averaging them gives a tempo
+ * with 0.01 BPM resolution instead of the integer heart rate.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260228
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef HRM_H
+#define HRM_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+
+/* Flags byte of the Heart Rate Measurement characteristic */
+#define HRM_FLAG_HR_UINT16        BIT(0)
+#define HRM_FLAG_CONTACT_DETECTED BIT(1)
+#define HRM_FLAG_CONTACT_SUPPORT  BIT(2)
+#define HRM_FLAG_ENERGY_EXPENDED  BIT(3)
+#define HRM_FLAG_RR_INTERVAL      BIT(4)
+
+/* A 23 byte ATT MTU leaves room for at most 9 RR intervals */
+#define HRM_RR_MAX 9
+
+/* RR intervals are in 1/1024 s, 60 * 100 * 1024 gives scaled BPM */
+#define HRM_RR_UNITS_PER_S 1024U
+#define HRM_RR_TO_SBPM     (60U * 100U * HRM_RR_UNITS_PER_S)
+
+/* Plausible RR range, 20 --> 300 BPM */
+#define HRM_RR_MIN ((60U * HRM_RR_UNITS_PER_S) / 300U)
+#define HRM_RR_MAX_VALUE ((60U * HRM_RR_UNITS_PER_S) / 20U)
+
+/* Number of beats averaged by the estimator */
+#define HRM_BEAT_WINDOW CONFIG_HRM_BEAT_WINDOW
+
+struct hrm_measurement {
+	uint8_t flags;
+	uint16_t bpm;
+	/* Only valid with HRM_FLAG_ENERGY_EXPENDED, kJ */
+	uint16_t energy_kj;
+	uint8_t rr_count;
+	/* Oldest first, 1/1024 s */
+	uint16_t rr[HRM_RR_MAX];
+};
+
+/*
+ * Moving average over the last HRM_BEAT_WINDOW RR intervals, only
+ * touched from the BLE notification context.
+ */
+struct hrm_beat_est {
+	uint16_t rr[HRM_BEAT_WINDOW];
+	uint32_t rr_sum;
+	uint8_t pos;
+	uint8_t count;
+	/* k_uptime_get_32() of the most recent beat */
+	uint32_t last_beat_ms;
+	uint32_t beats;
+	uint32_t rejected;
+};
+
+/**
+ * @brief Parse a Heart Rate Measurement notification.
+ *
+ * @return 0 on success, -EINVAL when the data is too short for its flags
+ */
+int hrm_parse(const uint8_t *data, uint16_t length, struct hrm_measurement *m);
+
+void hrm_beat_est_init(struct hrm_beat_est *est);
+
+/**
+ * @brief Feed the RR intervals of one notification.
+ *
+ * The sensor sends the notification shortly after the last beat it
+ * measured, so that beat is placed at now_ms.
+ *
+ * @param now_ms k_uptime_get_32() when the notification arrived
+ * @return number of intervals accepted
+ */
+int hrm_beat_est_process(struct hrm_beat_est *est, const struct hrm_measurement *m,
+			 uint32_t now_ms);
+
+/**
+ * @brief Tempo of the averaged beat interval.
+ *
+ * @return scaled BPM (e.g. 7234 for 72.34 BPM) or 0 without RR intervals
+ */
+uint16_t hrm_beat_est_get_sbpm(const struct hrm_beat_est *est);
+
+/**
+ * @brief Time of the most recent beat.
+ *
+ * @return k_uptime_get_32() timestamp or 0 before the first beat
+ */
+uint32_t hrm_beat_est_get_last_beat(const struct hrm_beat_est *est);
+
+#endif /* HRM_H */
@@ -18,10 +18,14 @@
 #include <lvgl.h>
 #include <string.h>
 #include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
 
 /* Zephyr MIDI module from: https://github.com/jw-smaal/zephyr-midi1 */
 #include <zephyr/drivers/midi/midi1.h>
 
+#include "bpm_history.h"
+#include "midi1_sysex.h"
+#include "midi_probe.h"
 #include "common.h"
 #include "model.h"
 
@@ -33,12 +37,68 @@ static lv_obj_t *label_title;
 static lv_obj_t *label_bpm;
 static lv_obj_t *label_pll;
 static lv_obj_t *label_meas;
-static lv_obj_t *ta_midi;
+/* MIDI log, a fixed set of label rows that are reused */
+#define MAX_MIDI_LINES 8
+static lv_obj_t *midi_log;
+static lv_obj_t *midi_rows[MAX_MIDI_LINES];
+/* Row that is overwritten next, it is the oldest one */
+static int midi_row_oldest;
 
-/* Strip chart */
+/* Strip chart, a tap zooms out to the next level */
 static lv_obj_t *pll_chart;
+static lv_obj_t *label_span;
 static lv_chart_series_t *pll_ser;
 static lv_chart_series_t *meas_ser;
+static lv_chart_series_t *hr_ser;
+/* min/max envelope of the PLL */
+static lv_chart_series_t *pll_min_ser;
+static lv_chart_series_t *pll_max_ser;
+/* Zoom level of the chart, see 'bpm_history.h' */
+static atomic_t history_level = ATOMIC_INIT(BPM_HISTORY_1MIN);
+static const char *const history_level_names[BPM_HISTORY_LEVELS] = {
+	[BPM_HISTORY_10S] = "10s",
+	[BPM_HISTORY_1MIN] = "1min",
+	[BPM_HISTORY_10MIN] = "10min",
+};
+
+/* Written by the display events in the LVGL thread only */
+static struct gui_stats stats;
+static uint32_t refr_start_cycles;
+
+/*
+ * Display events: time every refresh and add up the invalidated areas,
+ * that is the pixel data that ends up being flushed to the display.
+ */
+static void display_event_cb(lv_event_t *e)
+{
+	switch (lv_event_get_code(e)) {
+	case LV_EVENT_INVALIDATE_AREA: {
+		const lv_area_t *area = lv_event_get_param(e);
+
+		if (area) {
+			stats.invalidated_bytes +=
+				(uint64_t)lv_area_get_size(area) * (LV_COLOR_DEPTH / 8);
+		}
+		break;
+	}
+	case LV_EVENT_REFR_START:
+		refr_start_cycles = k_cycle_get_32();
+		break;
+	case LV_EVENT_REFR_READY:
+		stats.last_frame_us = k_cyc_to_us_floor32(k_cycle_get_32() - refr_start_cycles);
+		stats.max_frame_us = MAX(stats.max_frame_us, stats.last_frame_us);
+		stats.frames++;
+		break;
+	default:
+		break;
+	}
+}
+
+void gui_get_stats(struct gui_stats *out)
+{
+	/* Diagnostics only, a torn read of a counter is fine */
+	*out = stats;
+}
 
 /*
  *  GUI INITIALIZATION (480×320 landscape)
@@ -62,6 +122,12 @@ static lv_chart_series_t *meas_ser;
 	lv_obj_align(label_title, LV_ALIGN_TOP_LEFT, 6, 4);
 }
 
+/* Zoom out on a tap, wraps around to the shortest span */
+static void chart_clicked_cb(lv_event_t *e)
+{
+	gui_set_history_level((atomic_get(&history_level) + 1) % BPM_HISTORY_LEVELS);
+}
+
 static void initialize_gui(void)
 {
 	lv_obj_set_style_bg_color(lv_screen_active(), lv_color_white(), LV_PART_MAIN);
@@ -114,60 +180,134 @@ static void initialize_gui(void)
 	lv_obj_align(pll_chart, LV_ALIGN_BOTTOM_LEFT, 20, -20);
 
 	lv_chart_set_type(pll_chart, LV_CHART_TYPE_LINE);
-	/* history window */
-	lv_chart_set_point_count(pll_chart, 100);
+	/* history window, one point per bucket of the zoom level */
+	lv_chart_set_point_count(pll_chart, BPM_HISTORY_POINTS);
 	lv_chart_set_update_mode(pll_chart, LV_CHART_UPDATE_MODE_SHIFT);
 	/* PLL values range from 4000 --> 30000 */
 	lv_chart_set_range(pll_chart, LV_CHART_AXIS_PRIMARY_Y, 4000, 30000);
+	pll_min_ser = lv_chart_add_series(pll_chart, lv_palette_main(LV_PALETTE_LIGHT_BLUE),
+					  LV_CHART_AXIS_PRIMARY_Y);
+	pll_max_ser = lv_chart_add_series(pll_chart, lv_palette_main(LV_PALETTE_LIGHT_BLUE),
+					  LV_CHART_AXIS_PRIMARY_Y);
 	pll_ser = lv_chart_add_series(pll_chart, lv_palette_main(LV_PALETTE_BLUE),
 				      LV_CHART_AXIS_PRIMARY_Y);
 	meas_ser = lv_chart_add_series(pll_chart, lv_palette_main(LV_PALETTE_RED),
 				       LV_CHART_AXIS_PRIMARY_Y);
+	hr_ser = lv_chart_add_series(pll_chart, lv_palette_main(LV_PALETTE_GREEN),
+				     LV_CHART_AXIS_PRIMARY_Y);
+	lv_obj_add_event_cb(pll_chart, chart_clicked_cb, LV_EVENT_CLICKED, NULL);
+
+	/* Time span of the chart, above its right edge */
+	label_span = lv_label_create(lv_screen_active());
+	lv_obj_set_style_text_font(label_span, &lv_font_montserrat_12, LV_PART_MAIN);
+	lv_label_set_text(label_span, "");
+	lv_obj_align_to(label_span, pll_chart, LV_ALIGN_OUT_TOP_RIGHT, 0, 0);
 
 	/* =====================================================
-	 *  CENTER: LARGE SCROLLABLE TEXT WINDOW
+	 *  CENTER: MIDI LOG, ONE LABEL PER LINE
 	 * ===================================================== */
-	ta_midi = lv_textarea_create(lv_screen_active());
-	lv_obj_set_style_text_font(ta_midi, &lv_font_montserrat_12, LV_PART_MAIN);
+	midi_log = lv_obj_create(lv_screen_active());
 	/* Size: nearly full screen minus top and bottom bar */
-	lv_obj_set_size(ta_midi, 390, 120);
-	lv_obj_align(ta_midi, LV_ALIGN_TOP_LEFT, 20, 60);
+	lv_obj_set_size(midi_log, 390, 120);
+	lv_obj_align(midi_log, LV_ALIGN_TOP_LEFT, 20, 60);
 	/* No transparency */
-	// lv_obj_set_style_bg_color(ta_midi, lv_color_black(), LV_PART_MAIN);
-	lv_obj_set_style_bg_opa(ta_midi, LV_OPA_COVER, LV_PART_MAIN);
-	/* Black text by default */
-	lv_obj_set_style_text_color(ta_midi, lv_color_black(), LV_PART_MAIN);
-	lv_textarea_set_text(ta_midi, "");
-	lv_textarea_set_max_length(ta_midi, 4096);
-	lv_textarea_set_cursor_click_pos(ta_midi, false);
+	lv_obj_set_style_bg_opa(midi_log, LV_OPA_COVER, LV_PART_MAIN);
+	lv_obj_set_style_pad_all(midi_log, 0, LV_PART_MAIN);
+	lv_obj_set_style_pad_row(midi_log, 0, LV_PART_MAIN);
+	lv_obj_remove_flag(midi_log, LV_OBJ_FLAG_SCROLLABLE);
+	lv_obj_set_flex_flow(midi_log, LV_FLEX_FLOW_COLUMN);
+
+	/*
+	 * The rows are created once, a new line only changes the text of
+	 * one clipped single line label so nothing else is laid out again.
+	 */
+	for (int i = 0; i < MAX_MIDI_LINES; i++) {
+		midi_rows[i] = lv_label_create(midi_log);
+		lv_obj_set_style_text_font(midi_rows[i], &lv_font_montserrat_12, LV_PART_MAIN);
+		/* Black text by default */
+		lv_obj_set_style_text_color(midi_rows[i], lv_color_black(), LV_PART_MAIN);
+		lv_label_set_long_mode(midi_rows[i], LV_LABEL_LONG_CLIP);
+		lv_obj_set_width(midi_rows[i], LV_PCT(100));
+		lv_label_set_text(midi_rows[i], "");
+	}
+	midi_row_oldest = 0;
 }
 
-#define MAX_MIDI_LINES 8
-static int midi_line_count = 0;
-
+/*
+ * Overwrite the oldest row and move it to the bottom, the other rows
+ * shift up one position which is a move of the label, not a reflow.
+ */
 static void ui_add_line(const char *msg)
 {
-	if (!ta_midi) {
+	lv_obj_t *row;
+
+	if (!midi_log) {
 		return;
 	}
 
-	/* If full, clear everything */
-	if (midi_line_count >= MAX_MIDI_LINES) {
-		lv_textarea_set_text(ta_midi, "");
-		midi_line_count = 0;
+	row = midi_rows[midi_row_oldest];
+	lv_label_set_text(row, msg);
+	lv_obj_move_to_index(row, -1);
+	midi_row_oldest = (midi_row_oldest + 1) % MAX_MIDI_LINES;
+}
+
+void gui_set_history_level(int level)
+{
+	if (level >= 0 && level < BPM_HISTORY_LEVELS) {
+		atomic_set(&history_level, level);
+		bpm_history_set_notify_level((enum bpm_history_level)level);
+		model_notify();
 	}
+}
 
-	/* Format new line */
-	char buf[MIDI_LINE_MAX];
-	snprintf(buf, sizeof(buf), "%s\n", msg);
+/* An empty bucket is a gap in the line */
+static int32_t chart_value(uint16_t sbpm)
+{
+	return sbpm ? sbpm : LV_CHART_POINT_NONE;
+}
 
-	/* Append */
-	lv_textarea_add_text(ta_midi, buf);
-	midi_line_count++;
+static void chart_append(enum bpm_history_level level, uint32_t index)
+{
+	struct bpm_history_bucket pll = {0};
+	struct bpm_history_bucket b = {0};
+
+	bpm_history_get(level, index, BPM_HISTORY_PLL, &pll);
+	lv_chart_set_next_value(pll_chart, pll_ser, chart_value(pll.mean));
+	lv_chart_set_next_value(pll_chart, pll_min_ser, chart_value(pll.min));
+	lv_chart_set_next_value(pll_chart, pll_max_ser, chart_value(pll.max));
+	bpm_history_get(level, index, BPM_HISTORY_MEAS, &b);
+	lv_chart_set_next_value(pll_chart, meas_ser, chart_value(b.mean));
+	b = (struct bpm_history_bucket){0};
+	bpm_history_get(level, index, BPM_HISTORY_HR, &b);
+	lv_chart_set_next_value(pll_chart, hr_ser, chart_value(b.mean));
 }
 
-/* We get this one from main */
-extern uint8_t atom_bpm_get(void);
+/*
+ * The chart only gets the buckets completed since the previous call,
+ * a complete reload only happens when the zoom level changed.
+ */
+static void chart_update(void)
+{
+	static enum bpm_history_level shown = BPM_HISTORY_LEVELS;
+	static uint32_t shown_count;
+	enum bpm_history_level level = (enum bpm_history_level)atomic_get(&history_level);
+	uint32_t count = bpm_history_count(level);
+
+	if (level != shown || count - shown_count > BPM_HISTORY_POINTS) {
+		lv_chart_set_all_value(pll_chart, pll_ser, LV_CHART_POINT_NONE);
+		lv_chart_set_all_value(pll_chart, pll_min_ser, LV_CHART_POINT_NONE);
+		lv_chart_set_all_value(pll_chart, pll_max_ser, LV_CHART_POINT_NONE);
+		lv_chart_set_all_value(pll_chart, meas_ser, LV_CHART_POINT_NONE);
+		lv_chart_set_all_value(pll_chart, hr_ser, LV_CHART_POINT_NONE);
+		shown = level;
+		shown_count = count > BPM_HISTORY_POINTS ? count - BPM_HISTORY_POINTS : 0;
+		lv_label_set_text(label_span, history_level_names[level]);
+	}
+
+	while (shown_count != count) {
+		chart_append(level, shown_count++);
+	}
+}
 
 #define MAX_MESSAGES_PER_TICK 3
 void lvgl_thread(void)
@@ -190,48 +330,148 @@ void lvgl_thread(void)
 	}
 	ui_add_line("...");
 	initialize_gui();
+	lv_display_add_event_cb(lv_display_get_default(), display_event_cb, LV_EVENT_ALL, NULL);
+	bpm_history_set_notify_level((enum bpm_history_level)atomic_get(&history_level));
+	bpm_history_start();
 
 	char line[MIDI_LINE_MAX];
-	// struct midi1_raw mid_raw;
+	struct midi1_event ev;
+	uint32_t dropped = 0;
 	struct human_bpm_model mod;
+	struct model_reader reader = {0};
 	while (1) {
 		int processed = 0;
 		uint32_t sleep_ms = 0;
+		uint32_t changed;
 		char buf[MIDI_LINE_MAX];
 		char bpm_str[16];
-		model_get(&mod);
-
-		snprintf(buf, sizeof(buf), "BLE hr: %d BPM", mod.hr_bpm);
-		LOG_DBG("%s", buf);
-		lv_label_set_text(label_bpm, buf);
-
-		sbpm_to_str(mod.meas_sbpm, bpm_str, sizeof(bpm_str));
-		snprintf(buf, sizeof(buf), "Meas: %s", bpm_str);
-		LOG_DBG("%s", buf);
-		lv_label_set_text(label_meas, buf);
-	
-		sbpm_to_str(mod.pll_sbpm, bpm_str, sizeof(bpm_str));
-		snprintf(buf, sizeof(buf), "PLL: %s", bpm_str);
-		LOG_DBG("%s", buf);
-		lv_label_set_text(label_pll, buf);
-
-		/* Add PLL value to chart */
-		lv_chart_set_next_value(pll_chart, pll_ser, mod.pll_sbpm);
-		lv_chart_set_next_value(pll_chart, meas_ser, mod.meas_sbpm);
+
+		/* Only widgets of changed fields are touched (and invalidated) */
+		changed = model_read(&mod, &reader);
+
+		if (changed & (MODEL_CHANGED(MODEL_HR_BPM) | MODEL_CHANGED(MODEL_HR_SBPM))) {
+			if (mod.hr_sbpm) {
+				/* RR interval based, 0.01 BPM resolution */
+				sbpm_to_str(mod.hr_sbpm, bpm_str, sizeof(bpm_str));
+				snprintf(buf, sizeof(buf), "BLE hr: %s", bpm_str);
+			} else {
+				snprintf(buf, sizeof(buf), "BLE hr: %d BPM", mod.hr_bpm);
+			}
+			LOG_DBG("%s", buf);
+			lv_label_set_text(label_bpm, buf);
+		}
+
+		if (changed & MODEL_CHANGED(MODEL_MEAS_SBPM)) {
+			sbpm_to_str(mod.meas_sbpm, bpm_str, sizeof(bpm_str));
+			snprintf(buf, sizeof(buf), "Meas: %s", bpm_str);
+			LOG_DBG("%s", buf);
+			lv_label_set_text(label_meas, buf);
+		}
+
+		if (changed & MODEL_CHANGED(MODEL_PLL_SBPM)) {
+			sbpm_to_str(mod.pll_sbpm, bpm_str, sizeof(bpm_str));
+			snprintf(buf, sizeof(buf), "PLL: %s", bpm_str);
+			LOG_DBG("%s", buf);
+			lv_label_set_text(label_pll, buf);
+		}
+
+		/* Fixed rate history, only new buckets are added */
+		chart_update();
+
+		/*
+		 * A burst is merged into one line, only the most recent events
+		 * are formatted and shown so a flood never stalls this thread.
+		 */
+		uint32_t pending = midi1_event_count(&midi_event_ring);
+
+		if (pending > MAX_MESSAGES_PER_TICK) {
+			uint32_t coalesced = pending - (MAX_MESSAGES_PER_TICK - 1);
+
+			for (uint32_t i = 0; i < coalesced; i++) {
+				midi1_event_get(&midi_event_ring, &ev);
+			}
+			snprintf(line, sizeof(line), "%u messages coalesced", coalesced);
+			ui_add_line(line);
+			processed++;
+		}
 
 		/* Process at most N messages per iteration */
-		while (processed < MAX_MESSAGES_PER_TICK &&
-		       k_msgq_get(&midi_msgq, line, K_NO_WAIT) == 0) {
+		while (processed < MAX_MESSAGES_PER_TICK && midi1_event_get(&midi_event_ring, &ev)) {
+			midi1_event_to_str(&ev, line, sizeof(line));
+			LOG_DBG("%s", line);
 			ui_add_line(line);
-			// ui_set_line(line);
 			processed++;
 		}
+
+		/* Message buffers go back to the pool right after the summary */
+		struct midi1_sysex *sysex;
+
+		while (k_msgq_get(&midi_sysex_q, &sysex, K_NO_WAIT) == 0) {
+			midi1_sysex_to_str(sysex, line, sizeof(line));
+			midi1_sysex_release(sysex);
+			ui_add_line(line);
+		}
+
+		if (midi1_event_dropped(&midi_event_ring) != dropped) {
+			dropped = midi1_event_dropped(&midi_event_ring);
+			LOG_WRN("MIDI event ring full, %u events dropped", dropped);
+		}
+
+		/*
+		 * Sleep until the model changes (or a MIDI event arrives) or the
+		 * next LVGL timer is due, whatever comes first.  Events left in
+		 * the ring are picked up by the next refresh at the latest.
+		 */
+		MIDI_PROBE_BEGIN(LVGL_FRAME);
 		sleep_ms = lv_timer_handler();
-		k_msleep(sleep_ms);
+		MIDI_PROBE_END(LVGL_FRAME);
+		if (model_wait(sleep_ms == LV_NO_TIMER_READY ? K_FOREVER : K_MSEC(sleep_ms)) == 0) {
+			stats.model_wakeups++;
+		}
 	}
 	return;
 }
 
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_gui(const struct shell *sh, size_t argc, char **argv)
+{
+	enum bpm_history_level level = (enum bpm_history_level)atomic_get(&history_level);
+	struct gui_stats st;
+
+	gui_get_stats(&st);
+	shell_print(sh, "frames %u, last %u us, max %u us, model wakeups %u", st.frames,
+		    st.last_frame_us, st.max_frame_us, st.model_wakeups);
+	shell_print(sh, "invalidated %u KiB, %u bytes per frame",
+		    (uint32_t)(st.invalidated_bytes / 1024U),
+		    st.frames ? (uint32_t)(st.invalidated_bytes / st.frames) : 0U);
+	shell_print(sh, "chart %s, %u s in %u points", history_level_names[level],
+		    bpm_history_span_s(level), BPM_HISTORY_POINTS);
+	return 0;
+}
+
+static int cmd_midi_gui_zoom(const struct shell *sh, size_t argc, char **argv)
+{
+	for (int level = 0; level < BPM_HISTORY_LEVELS; level++) {
+		if (strcmp(argv[1], history_level_names[level]) == 0) {
+			gui_set_history_level(level);
+			shell_print(sh, "chart %s, %u s", argv[1], bpm_history_span_s(level));
+			return 0;
+		}
+	}
+	shell_error(sh, "use 10s, 1min or 10min");
+	return -EINVAL;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(midi_gui_cmds,
+	SHELL_CMD_ARG(zoom, NULL, "Time span of the chart <10s|1min|10min>", cmd_midi_gui_zoom,
+		      2, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((midi), gui, &midi_gui_cmds, "Display refresh statistics and chart", cmd_midi_gui,
+		 1, 0);
+#endif
+
 /* For LVGL had to increase the stack size */
 K_THREAD_DEFINE(lvgl_thread_tid, 8192, lvgl_thread, NULL, NULL, NULL, 5, 0, 0);
 
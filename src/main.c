@@ -6,13 +6,6 @@
  *
  * license SPDX-License-Identifier: Apache-2.0
  */
-
-/*
- * Bluetooth hr central example used is:
- * Copyright (c) 2015-2016 Intel Corporation
- *
- * SPDX-License-Identifier: Apache-2.0
- */
 #include <stddef.h>
 #include <errno.h>
 #include <lvgl.h>
@@ -22,13 +15,6 @@
 #include <zephyr/logging/log.h>
 #include <zephyr/devicetree.h>
 #include <zephyr/drivers/display.h>
-#include <zephyr/bluetooth/bluetooth.h>
-#include <zephyr/bluetooth/hci.h>
-#include <zephyr/bluetooth/conn.h>
-#include <zephyr/bluetooth/uuid.h>
-#include <zephyr/bluetooth/gatt.h>
-#include <zephyr/sys/byteorder.h>
-#include <zephyr/sys/atomic.h>
 #include <zephyr/sys/printk.h>
 
 /*
@@ -37,9 +23,11 @@
  * /zephyr/lib/midi2/ump_stream_responder.h
  * it gets linked in and is required for the USB MIDI support.
  */
+#ifdef CONFIG_USBD_MIDI2_CLASS
 #include <sample_usbd.h>
 #include <zephyr/usb/class/usbd_midi2.h>
 #include <ump_stream_responder.h>
+#endif
 
 /* This is the MIDI module at: https://github.com/jw-smaal/zephyr-midi1  */
 #include <zephyr/drivers/midi/midi1_serial.h>
@@ -48,8 +36,20 @@
 #include <zephyr/drivers/midi/midi1_blockavg.h>
 
 /* Some MIDI1 helpers that are not drivers */
+#include "clock_jitter.h"
+#include "clock_phase.h"
+#include "clock_source.h"
+#include "hr_central.h"
+#include "hr_latency.h"
+#include "midi_probe.h"
 #include "midi1_pll.h"
+#include "midi1_tx_sched.h"
+#include "midi_router.h"
 #include "note.h"
+#include "pulse_out.h"
+#include "tempo_est.h"
+#include "tempo_slew.h"
+#include "usb_midi_tx.h"
 
 /* My application logic */
 #include "common.h"
@@ -57,287 +57,99 @@
 
 LOG_MODULE_REGISTER(midi1_human_clock, CONFIG_LOG_DEFAULT_LEVEL);
 
-#define USB_MIDI_DT_NODE DT_NODELABEL(usb_midi)
-static const struct device *const midi_usb = DEVICE_DT_GET(USB_MIDI_DT_NODE);
-
-static void start_scan(void);
-static struct bt_conn *default_conn;
-static struct bt_uuid_16 discover_uuid = BT_UUID_INIT_16(0);
-static struct bt_gatt_discover_params discover_params;
-static struct bt_gatt_subscribe_params subscribe_params;
-uint64_t total_rx_count; /* This value is exposed to test code */
-
-/* Global BPM set by the bluetooth HR service */
-static uint8_t g_bpm = 0;
-static atomic_t atom_bpm = ATOMIC_INIT(0);
-
-uint8_t atom_bpm_get(void)
-{
-	return (uint8_t)atomic_get(&atom_bpm);
-}
-
-static uint8_t notify_func(struct bt_conn *conn, struct bt_gatt_subscribe_params *params,
-			   const void *data, uint16_t length)
-{
-	if (!data) {
-		LOG_ERR("[UNSUBSCRIBED]");
-		params->value_handle = 0U;
-		return BT_GATT_ITER_STOP;
-	}
-
-	const uint8_t *d = data;
-
-	/* HRM format: d[0] = flags, d[1] = BPM */
-	if (length >= 2) {
-		uint8_t flags = d[0];
-		uint8_t bpm = d[1];
-
-		LOG_INF("HR Notification: BPM=%u flags=0x%02x len=%u", bpm, flags, length);
-		g_bpm = bpm;
-		atomic_set(&atom_bpm, bpm);
-	}
-	total_rx_count++;
-
-	return BT_GATT_ITER_CONTINUE;
-}
-
-static uint8_t discover_func(struct bt_conn *conn, const struct bt_gatt_attr *attr,
-			     struct bt_gatt_discover_params *params)
-{
-	int err;
-
-	if (!attr) {
-		LOG_INF("Discover complete");
-		(void)memset(params, 0, sizeof(*params));
-		return BT_GATT_ITER_STOP;
-	}
-
-	LOG_INF("[ATTRIBUTE] handle %u", attr->handle);
+/* MIDI clock generator, the callback reprograms it while ramping */
+static const struct device *const clk = DEVICE_DT_GET(DT_NODELABEL(midi1_clock_cntr));
+static const struct midi1_clock_cntr_api *mid_clk;
+/* Tempo the generator is programmed with, clock callback after init */
+static uint16_t programmed_sbpm;
 
-	if (!bt_uuid_cmp(discover_params.uuid, BT_UUID_HRS)) {
-		memcpy(&discover_uuid, BT_UUID_HRS_MEASUREMENT, sizeof(discover_uuid));
-		discover_params.uuid = &discover_uuid.uuid;
-		discover_params.start_handle = attr->handle + 1;
-		discover_params.type = BT_GATT_DISCOVER_CHARACTERISTIC;
-
-		err = bt_gatt_discover(conn, &discover_params);
-		if (err) {
-			LOG_ERR("Discover failed (err %d)", err);
-		}
-	} else if (!bt_uuid_cmp(discover_params.uuid, BT_UUID_HRS_MEASUREMENT)) {
-		memcpy(&discover_uuid, BT_UUID_GATT_CCC, sizeof(discover_uuid));
-		discover_params.uuid = &discover_uuid.uuid;
-		discover_params.start_handle = attr->handle + 2;
-		discover_params.type = BT_GATT_DISCOVER_DESCRIPTOR;
-		subscribe_params.value_handle = bt_gatt_attr_value_handle(attr);
-
-		err = bt_gatt_discover(conn, &discover_params);
-		if (err) {
-			LOG_ERR("Discover failed (err %d)", err);
-		}
-	} else {
-		subscribe_params.notify = notify_func;
-		subscribe_params.value = BT_GATT_CCC_NOTIFY;
-		subscribe_params.ccc_handle = attr->handle;
+/*
+ * Tempo events towards main(), posted by the BLE callbacks so a new heart
+ * rate is applied within one notification.
+ */
+#define TEMPO_EVT_HR_UPDATE HR_CENTRAL_EVT_UPDATE
+#define TEMPO_EVT_HR_LOST   HR_CENTRAL_EVT_LOST
+#define TEMPO_EVT_ALL       (TEMPO_EVT_HR_UPDATE | TEMPO_EVT_HR_LOST)
+K_EVENT_DEFINE(tempo_events);
 
-		err = bt_gatt_subscribe(conn, &subscribe_params);
-		if (err && err != -EALREADY) {
-			LOG_ERR("Subscribe failed (err %d)", err);
-		} else {
-			LOG_INF("[SUBSCRIBED]");
-		}
+/*
+ * Without events main() still evaluates the clock source selection and
+ * refreshes the model this often.
+ */
+#define TEMPO_IDLE_REFRESH_MS 250
 
-		return BT_GATT_ITER_STOP;
-	}
+/*
+ * USB MIDI2.0 is optional so the pipeline also builds for simulated
+ * boards without a USB device controller (tests/bsim/pipeline).
+ */
+#ifdef CONFIG_USBD_MIDI2_CLASS
+#define USB_MIDI_DT_NODE DT_NODELABEL(usb_midi)
+static const struct device *const midi_usb = DEVICE_DT_GET(USB_MIDI_DT_NODE);
 
-	return BT_GATT_ITER_STOP;
-}
+/* First UMP group of every group terminal block, e.g. midi_in_out@0 */
+#define USB_MIDI_BLOCK_GROUP(node) DT_REG_ADDR(node),
+static const uint8_t usb_midi_groups[] = {
+	DT_FOREACH_CHILD(USB_MIDI_DT_NODE, USB_MIDI_BLOCK_GROUP)};
 
-static bool eir_found(struct bt_data *data, void *user_data)
+static void on_ump_packet(const struct device *dev, const struct midi_ump ump)
 {
-	bt_addr_le_t *addr = user_data;
-	int i;
-
-	LOG_INF("[AD]: %u data_len %u", data->type, data->data_len);
-
-	switch (data->type) {
-	case BT_DATA_UUID16_SOME:
-	case BT_DATA_UUID16_ALL:
-		if (data->data_len % sizeof(uint16_t) != 0U) {
-			LOG_INF("AD malformed");
-			return true;
-		}
-
-		for (i = 0; i < data->data_len; i += sizeof(uint16_t)) {
-			struct bt_conn_le_create_param *create_param;
-			struct bt_le_conn_param *param;
-			const struct bt_uuid *uuid;
-			uint16_t u16;
-			int err;
-
-			memcpy(&u16, &data->data[i], sizeof(u16));
-			uuid = BT_UUID_DECLARE_16(sys_le16_to_cpu(u16));
-			if (bt_uuid_cmp(uuid, BT_UUID_HRS)) {
-				continue;
-			}
-
-			err = bt_le_scan_stop();
-			if (err) {
-				LOG_ERR("Stop LE scan failed (err %d)", err);
-				continue;
-			}
-
-			LOG_INF("Creating connection with Coded PHY support");
-			param = BT_LE_CONN_PARAM_DEFAULT;
-			create_param = BT_CONN_LE_CREATE_CONN;
-			create_param->options |= BT_CONN_LE_OPT_CODED;
-			err = bt_conn_le_create(addr, create_param, param, &default_conn);
-			if (err) {
-				LOG_INF("Coded PHY connection failed (err %d), trying non-Coded",
-					err);
-
-				create_param->options &= ~BT_CONN_LE_OPT_CODED;
-				err = bt_conn_le_create(addr, create_param, param, &default_conn);
-				if (err) {
-					LOG_ERR("Create connection failed (err %d)", err);
-					start_scan();
-				}
-			}
-
-			return false;
+	if (UMP_MT(ump) == UMP_MT_SYS_RT_COMMON) {
+		if (UMP_MIDI_STATUS(ump) == RT_TIMING_CLOCK) {
+			/* Timestamped on arrival, the USB frame jitter shows in its quality */
+			clock_source_pulse_now(CLOCK_SOURCE_USB);
 		}
+		return;
 	}
-
-	return true;
+	/* Channel voice from the host goes out on the DIN port */
+	(void)midi_router_usb(ump);
 }
 
-static void device_found(const bt_addr_le_t *addr, int8_t rssi, uint8_t type,
-			 struct net_buf_simple *ad)
+/**
+ * @brief Light up the LED (if any) when USB-MIDI2.0 is active towards the PC
+ */
+static void on_device_ready(const struct device *dev, const bool ready)
 {
-	char dev[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(addr, dev, sizeof(dev));
-	LOG_INF("[DEVICE]: %s, AD evt type %u, AD data len %u, RSSI %i", dev, type, ad->len, rssi);
-
-	/* We're only interested in legacy connectable events or
-	 * possible extended advertising that are connectable.
-	 */
-	if (type == BT_GAP_ADV_TYPE_ADV_IND || type == BT_GAP_ADV_TYPE_ADV_DIRECT_IND ||
-	    type == BT_GAP_ADV_TYPE_EXT_ADV) {
-		bt_data_parse(ad, eir_found, (void *)addr);
-	}
+	LOG_INF("MIDI USBD device %s", ready ? "ready!" : "not ready");
+	usb_midi_tx_set_ready(ready);
 }
 
-static void start_scan(void)
-{
-	int err;
-
-	/* Use active scanning and disable duplicate filtering to handle any
-	 * devices that might update their advertising data at runtime. */
-	struct bt_le_scan_param scan_param = {
-		.type = BT_LE_SCAN_TYPE_ACTIVE,
-		.options = BT_LE_SCAN_OPT_CODED,
-		.interval = BT_GAP_SCAN_FAST_INTERVAL,
-		.window = BT_GAP_SCAN_FAST_WINDOW,
-	};
-
-	err = bt_le_scan_start(&scan_param, device_found);
-	if (err) {
-		LOG_INF("Scanning with Coded PHY failed (err %d), trying without", err);
-
-		scan_param.options &= ~BT_LE_SCAN_OPT_CODED;
-		err = bt_le_scan_start(&scan_param, device_found);
-		if (err) {
-			LOG_ERR("Scanning failed to start (err %d)", err);
-			return;
-		}
-	}
-
-	LOG_INF("Scanning successfully started");
-}
+/* rx callback struct for the clock tests we use 'on_ump_packet' */
+static const struct usbd_midi_ops ump_ops = {
+	.rx_packet_cb = on_ump_packet,
+	.ready_cb = on_device_ready,
+};
 
-static void connected(struct bt_conn *conn, uint8_t conn_err)
+/* Initialize USBD MIDI2.0 */
+static void usb_midi_start(void)
 {
-	char addr[BT_ADDR_LE_STR_LEN];
+	struct usbd_context *sample_usbd;
 	int err;
 
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	if (conn_err) {
-		LOG_ERR("Failed to connect to %s (%u)", addr, conn_err);
-
-		bt_conn_unref(default_conn);
-		default_conn = NULL;
-
-		start_scan();
+	if (!midi_usb || !device_is_ready(midi_usb)) {
 		return;
 	}
-
-	LOG_INF("Connected: %s", addr);
-
-	total_rx_count = 0U;
-
-	if (conn == default_conn) {
-		memcpy(&discover_uuid, BT_UUID_HRS, sizeof(discover_uuid));
-		discover_params.uuid = &discover_uuid.uuid;
-		discover_params.func = discover_func;
-		discover_params.start_handle = BT_ATT_FIRST_ATTRIBUTE_HANDLE;
-		discover_params.end_handle = BT_ATT_LAST_ATTRIBUTE_HANDLE;
-		discover_params.type = BT_GATT_DISCOVER_PRIMARY;
-
-		err = bt_gatt_discover(default_conn, &discover_params);
-		if (err) {
-			LOG_ERR("Discover failed (err %d)", err);
-			return;
-		}
+	if (usb_midi_tx_init(midi_usb, usb_midi_groups, ARRAY_SIZE(usb_midi_groups))) {
+		LOG_ERR("USB MIDI TX init failed");
 	}
-}
-
-static void disconnected(struct bt_conn *conn, uint8_t reason)
-{
-	char addr[BT_ADDR_LE_STR_LEN];
-
-	bt_addr_le_to_str(bt_conn_get_dst(conn), addr, sizeof(addr));
-
-	LOG_INF("Disconnected: %s, reason 0x%02x %s", addr, reason, bt_hci_err_to_str(reason));
-
-	if (default_conn != conn) {
+	usb_midi_tx_tempo(tempo_slew_get_current());
+	usbd_midi_set_ops(midi_usb, &ump_ops);
+	sample_usbd = sample_usbd_init_device(NULL);
+	if (sample_usbd == NULL) {
+		LOG_ERR("Failed to initialize USB device");
 		return;
 	}
-
-	bt_conn_unref(default_conn);
-	default_conn = NULL;
-
-	start_scan();
-}
-
-BT_CONN_CB_DEFINE(conn_callbacks) = {
-	.connected = connected,
-	.disconnected = disconnected,
-};
-
-static void on_ump_packet(const struct device *dev, const struct midi_ump ump)
-{
-	if (UMP_MT(ump) == UMP_MT_SYS_RT_COMMON) {
-		if (UMP_MIDI_STATUS(ump) == RT_TIMING_CLOCK) {
-			/* MIDI Clock handled elsewhere */
-		}
+	err = usbd_enable(sample_usbd);
+	if (err) {
+		LOG_ERR("Failed to enable USBD (err %d)", err);
+	} else {
+		LOG_INF("USB device support enabled");
 	}
 }
-
-/**
- * @brief Light up the LED (if any) when USB-MIDI2.0 is active towards the PC
- */
-static void on_device_ready(const struct device *dev, const bool ready)
+#else
+static void usb_midi_start(void)
 {
-	LOG_INF("MIDI USBD device ready!");
 }
-
-/* rx callback struct for the clock tests we use 'on_ump_packet' */
-static const struct usbd_midi_ops ump_ops = {
-	.rx_packet_cb = on_ump_packet,
-	.ready_cb = on_device_ready,
-};
+#endif
 
 /*
  * This get's called every 24PQN from the driver.
@@ -347,10 +159,42 @@ static const struct usbd_midi_ops ump_ops = {
 void midi1_clock_cntr_callback(void)
 {
 	static uint8_t i;
+	uint32_t latency_us;
+	uint16_t sbpm;
+
+	MIDI_PROBE_BEGIN(CLOCK_CB);
+
+	/* Phase of this pulse for the serial clock lock, first thing */
+	clock_phase_gen_pulse();
+
+	/* Release the serial MIDI due on this pulse first, to the TX thread */
+	midi1_tx_sched_tick();
+
+	/* Ramp the generated tempo, this is only an add and compare */
+	sbpm = tempo_slew_pulse();
+	if (sbpm) {
+		mid_clk->gen_sbpm(clk, sbpm);
+		model_set_gen(sbpm);
+		/* First step towards a heart rate target ends its latency */
+		latency_us = hr_latency_gen();
+		if (latency_us) {
+			model_set_hr_latency(latency_us);
+		}
+		usb_midi_tx_tempo(sbpm);
+		programmed_sbpm = sbpm;
+	}
 
-	/* USBD MIDI */
-	if (midi_usb) {
-		usbd_midi_send(midi_usb, midi1_timing_clock());
+	/* The pulse outputs take a new tempo over on a beat, in phase with us */
+	if (i == 0) {
+		pulse_out_beat(programmed_sbpm);
+	}
+
+	/* Against the ideal period of the interval that starts now */
+	clock_jitter_gen_pulse(programmed_sbpm);
+
+	/* USBD MIDI, only queued here the TX thread does the sending */
+	if (usb_midi_tx_is_ready()) {
+		usb_midi_tx_clock();
 	}
 
 	/* 0 --> 23 = 24 pulses */
@@ -360,46 +204,37 @@ void midi1_clock_cntr_callback(void)
 		LOG_DBG("[P]");
 		i = 0;
 	}
+
+	MIDI_PROBE_END(CLOCK_CB);
 }
 
 int main(void)
 {
 	int err;
 
-	/* Initialize Bluetooth */
-	err = bt_enable(NULL);
+	/* Bluetooth, scans for heart rate sensors while a slot is free */
+	err = hr_central_start(&tempo_events);
 	if (err) {
-		LOG_ERR("Bluetooth init failed (err %d)", err);
 		return err;
 	}
 
-	LOG_INF("Bluetooth initialized");
-	start_scan();
-
-	/* Initialize Serial MIDI1 */
-	const struct device *midi_serial = DEVICE_DT_GET(DT_NODELABEL(midi0));
-	if (!device_is_ready(midi_serial)) {
-		LOG_ERR("Serial MIDI1 device not ready");
-		return -ENODEV;
-	}
-
-	const struct midi1_serial_api *mid_api = midi_serial->api;
-
-	LOG_INF("MIDI1 sending initial note...");
-	mid_api->note_on(midi_serial, CH16, 1, 60);
-	k_sleep(K_MSEC(290));
-	mid_api->note_off(midi_serial, CH16, 1, 60);
-	k_sleep(K_MSEC(290));
-
 	/* Initialize MIDI clock driver */
-	const struct device *clk = DEVICE_DT_GET(DT_NODELABEL(midi1_clock_cntr));
 	if (!device_is_ready(clk)) {
 		LOG_ERR("MIDI1 clock counter device not ready");
 		return -ENODEV;
 	}
 
-	const struct midi1_clock_cntr_api *mid_clk = clk->api;
-	mid_clk->gen_sbpm(clk, 12000); /* Initial 120.00 BPM */
+	mid_clk = clk->api;
+	tempo_slew_init(12000);
+	model_set_target(12000);
+	programmed_sbpm = 12000;
+	mid_clk->gen_sbpm(clk, programmed_sbpm); /* Initial 120.00 BPM */
+	if (clock_jitter_init()) {
+		LOG_ERR("Clock jitter timestamp counter not ready");
+	}
+	if (pulse_out_init()) {
+		LOG_ERR("Clock pulse outputs not ready");
+	}
 	mid_clk->register_callback(clk, midi1_clock_cntr_callback);
 
 	/* Initialize MIDI clock measurement driver */
@@ -409,57 +244,67 @@ int main(void)
 		return -ENODEV;
 	}
 
-	const struct midi1_clock_meas_cntr_api *mid_meas = meas->api;
-
-	/* Initialize USBD MIDI2.0 */
-	if (midi_usb && device_is_ready(midi_usb)) {
-		struct usbd_context *sample_usbd;
-
-		usbd_midi_set_ops(midi_usb, &ump_ops);
-		sample_usbd = sample_usbd_init_device(NULL);
-		if (sample_usbd == NULL) {
-			LOG_ERR("Failed to initialize USB device");
-		} else {
-			err = usbd_enable(sample_usbd);
-			if (err) {
-				LOG_ERR("Failed to enable USBD (err %d)", err);
-			} else {
-				LOG_INF("USB device support enabled");
-			}
-		}
-	}
+	usb_midi_start();
 
 	/* My application model */
 	model_init();
 
-	while (1) {
-		uint16_t gen_sbpm = (uint16_t)atom_bpm_get() * 100U;
-
-		LOG_DBG("Measured incoming SBPM %d, Target %d", mid_meas->get_sbpm(meas), gen_sbpm);
+	/* Predicted heart rate tempo, updated on every notification */
+	uint16_t hr_est_sbpm = 0;
 
-		if (gen_sbpm > 0) {
-			mid_clk->gen_sbpm(clk, gen_sbpm);
+	while (1) {
+		/*
+		 * Sleep until the BLE callbacks have something for us, events
+		 * are cleared before reading the value so none get lost.
+		 */
+		uint32_t events = k_event_wait(&tempo_events, TEMPO_EVT_ALL, false,
+					       K_MSEC(TEMPO_IDLE_REFRESH_MS));
+		k_event_clear(&tempo_events, events);
+
+		/*
+		 * A lost sensor is already out of the aggregate, the others
+		 * keep the clock going while its slot is scanned for again.
+		 */
+		bool hr_connected = hr_central_active() > 0;
+
+		if (!hr_connected) {
+			tempo_est_reset();
+			hr_est_sbpm = 0;
+		} else if ((events & TEMPO_EVT_ALL) && hr_central_get_sbpm()) {
+			/* Smoothed, spikes left out and a little ahead of the trend */
+			hr_est_sbpm = tempo_est_update(hr_central_get_sbpm(), k_uptime_get_32());
 		}
 
-		model_set(true, atom_bpm_get(), mid_meas->get_sbpm(meas), 0, 0);
-
-		k_sleep(K_MSEC(4000));
-
-#define MIDI_TEST_PATTERN 1
-#if MIDI_TEST_PATTERN
-		/* Test Pattern Logic */
-		for (uint8_t value = 0; value < 16; value++) {
-			mid_api->control_change(midi_serial, CH16, 1, value);
-			k_sleep(K_MSEC(290));
-		}
-		for (uint8_t value = 60; value < 66; value++) {
-			mid_api->note_on(midi_serial, CH7, value, 100);
-			k_sleep(K_MSEC(310));
+		/*
+		 * Hand the tempo of the selected source to the clock callback,
+		 * it ramps towards it so a switch never jumps the output.
+		 * Without a locked source the last tempo is kept.
+		 */
+		enum clock_source_id source = clock_source_select();
+		/* Locked in phase to the DIN clock by the PI loop, or 0 */
+		uint16_t phase_sbpm = source == CLOCK_SOURCE_SERIAL ? clock_phase_target() : 0;
+		uint16_t gen_sbpm;
+
+		if (source == CLOCK_SOURCE_HR) {
+			/* The RR estimators follow the heart faster than a PLL */
+			gen_sbpm = hr_est_sbpm;
+		} else if (phase_sbpm) {
+			gen_sbpm = phase_sbpm;
+		} else {
+			gen_sbpm = clock_source_get_sbpm(source);
 		}
-		for (uint8_t value = 60; value < 66; value++) {
-			mid_api->note_off(midi_serial, CH7, value, 100);
+
+		if (gen_sbpm > 0 && gen_sbpm != tempo_slew_get_target()) {
+			LOG_DBG("Source %s quality %d, Target %d", clock_source_name(source),
+				clock_source_get_quality(source), gen_sbpm);
+			tempo_slew_set_target(gen_sbpm);
+			if (source == CLOCK_SOURCE_HR && (events & TEMPO_EVT_HR_UPDATE)) {
+				hr_latency_target();
+			}
+			model_set_target(gen_sbpm);
 		}
-#endif
+
+		model_set_hr(hr_connected, hr_central_get_bpm(), hr_central_get_sbpm());
 	}
 
 	return 0;
@@ -0,0 +1,84 @@
+/**
+ * @file midi1_event.c
+ * @brief Compact binary MIDI event records and a lock-free SPSC ring.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260214
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+#include <zephyr/kernel.h>
+
+/* PITCHWHEEL_CENTER is defined in https://github.com/jw-smaal/zephyr-midi1 */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "midi1_event.h"
+#include "note.h"
+
+bool midi1_event_put(struct midi1_event_ring *ring, const struct midi1_event *ev)
+{
+	uint32_t head = (uint32_t)atomic_get(&ring->head);
+	uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+
+	if (head - tail > ring->mask) {
+		atomic_inc(&ring->dropped);
+		return false;
+	}
+
+	ring->buf[head & ring->mask] = *ev;
+	/* atomic_set() is a full barrier, the record is visible before head */
+	atomic_set(&ring->head, (atomic_val_t)(head + 1U));
+	return true;
+}
+
+bool midi1_event_get(struct midi1_event_ring *ring, struct midi1_event *ev)
+{
+	uint32_t tail = (uint32_t)atomic_get(&ring->tail);
+	uint32_t head = (uint32_t)atomic_get(&ring->head);
+
+	if (head == tail) {
+		return false;
+	}
+
+	*ev = ring->buf[tail & ring->mask];
+	atomic_set(&ring->tail, (atomic_val_t)(tail + 1U));
+	return true;
+}
+
+uint32_t midi1_event_count(struct midi1_event_ring *ring)
+{
+	return (uint32_t)atomic_get(&ring->head) - (uint32_t)atomic_get(&ring->tail);
+}
+
+uint32_t midi1_event_dropped(struct midi1_event_ring *ring)
+{
+	return (uint32_t)atomic_get(&ring->dropped);
+}
+
+/*
+ * It's channel + 1 because 0 = CH1 in MIDI.
+ */
+int midi1_event_to_str(const struct midi1_event *ev, char *buf, size_t len)
+{
+	switch (ev->status) {
+	case MIDI1_EVENT_NOTE_ON:
+		return snprintf(buf, len, "CH: %d -> Note   on: %s %03d %03d", ev->channel + 1,
+				noteToTextWithOctave(ev->data1, false), ev->data1, ev->data2);
+	case MIDI1_EVENT_NOTE_OFF:
+		return snprintf(buf, len, "CH: %d -> Note  off: %s %03d %03d", ev->channel + 1,
+				noteToTextWithOctave(ev->data1, false), ev->data1, ev->data2);
+	case MIDI1_EVENT_CONTROL_CHANGE:
+		return snprintf(buf, len, "CH: %d -> CC: %d value: %d", ev->channel + 1, ev->data1,
+				ev->data2);
+	case MIDI1_EVENT_PITCHWHEEL: {
+		/* 14 bit value for the pitch wheel, data1 = lsb, data2 = msb */
+		int16_t pwheel = (int16_t)((ev->data2 << 7) | ev->data1) - PITCHWHEEL_CENTER;
+		return snprintf(buf, len, "CH: %d -> Pitchwheel: %d", ev->channel + 1, pwheel);
+	}
+	default:
+		return snprintf(buf, len, "CH: %d -> 0x%02x %d %d", ev->channel + 1, ev->status,
+				ev->data1, ev->data2);
+	}
+}
+
+/* EOF */
@@ -0,0 +1,96 @@
+/**
+ * @file midi1_event.h
+ * @brief Compact binary MIDI event records and a lock-free SPSC ring.
+ *
+ * The parser thread records what it received as 8 byte events, the
+ * consumer (the LVGL thread) only formats the events it really shows.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260214
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_EVENT_H
+#define MIDI1_EVENT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+/* MIDI1.0 channel voice status (upper nibble of the status byte) */
+#define MIDI1_EVENT_NOTE_OFF       0x80
+#define MIDI1_EVENT_NOTE_ON        0x90
+#define MIDI1_EVENT_CONTROL_CHANGE 0xB0
+#define MIDI1_EVENT_PITCHWHEEL     0xE0
+
+/*
+ * One received MIDI message, channel is 0 --> 15
+ * timestamp is in k_cycle_get_32() cycles.
+ */
+struct midi1_event {
+	uint32_t timestamp;
+	uint8_t status;
+	uint8_t channel;
+	uint8_t data1;
+	uint8_t data2;
+};
+
+/*
+ * Single producer / single consumer ring.  head is only written by the
+ * producer, tail only by the consumer.  Both are free running counters.
+ */
+struct midi1_event_ring {
+	struct midi1_event *buf;
+	uint32_t mask;
+	atomic_t head;
+	atomic_t tail;
+	atomic_t dropped;
+};
+
+/**
+ * @brief Define a ring, size must be a power of two.
+ */
+#define MIDI1_EVENT_RING_DEFINE(_name, _size)                                                      \
+	BUILD_ASSERT(((_size) & ((_size) - 1)) == 0, "ring size must be a power of two");         \
+	static struct midi1_event _name##_buf[_size];                                              \
+	struct midi1_event_ring _name = {                                                          \
+		.buf = _name##_buf,                                                                \
+		.mask = (_size) - 1,                                                               \
+		.head = ATOMIC_INIT(0),                                                            \
+		.tail = ATOMIC_INIT(0),                                                            \
+		.dropped = ATOMIC_INIT(0),                                                         \
+	}
+
+/**
+ * @brief Producer side, never blocks.
+ *
+ * @return true when stored, false when the ring was full (counted as drop)
+ */
+bool midi1_event_put(struct midi1_event_ring *ring, const struct midi1_event *ev);
+
+/**
+ * @brief Consumer side, never blocks.
+ *
+ * @return true when an event was copied into ev
+ */
+bool midi1_event_get(struct midi1_event_ring *ring, struct midi1_event *ev);
+
+/**
+ * @brief Number of events waiting for the consumer.
+ */
+uint32_t midi1_event_count(struct midi1_event_ring *ring);
+
+/**
+ * @brief Total number of events dropped because the ring was full.
+ */
+uint32_t midi1_event_dropped(struct midi1_event_ring *ring);
+
+/**
+ * @brief Format an event as text for the MIDI log e.g.
+ * "CH: 16 -> Note   on: C 3 060 100"
+ *
+ * @return number of characters written (as snprintf)
+ */
+int midi1_event_to_str(const struct midi1_event *ev, char *buf, size_t len);
+
+#endif /* MIDI1_EVENT_H */
@@ -83,3 +83,154 @@ uint32_t midi1_pll_get_interval_us(struct midi1_pll_data *data)
 	uint64_t us = ((uint64_t)data->nominal_interval_ticks * 1000000ULL) / data->clock_freq;
 	return (uint32_t)us;
 }
+
+/* ------------------------- Phase locking (PI) mode ------------------------ */
+
+/* Tempo range the PI loop is allowed to follow, scaled BPM */
+#define MIDI1_PLL_PI_MIN_SBPM 2000
+#define MIDI1_PLL_PI_MAX_SBPM 30000
+
+/* Phase error below 1/32 of a period counts as "in phase" */
+#define MIDI1_PLL_PI_LOCK_SHIFT 5
+
+/*
+ * Divide by 2^shift rounding to nearest, symmetric around zero so the
+ * loop has no bias in either direction.
+ */
+static int64_t pi_round_shift(int64_t x, uint8_t shift)
+{
+	if (shift == 0) {
+		return x;
+	}
+
+	int64_t half = (int64_t)1 << (shift - 1);
+
+	return (x >= 0) ? ((x + half) >> shift) : -((-x + half) >> shift);
+}
+
+void midi1_pll_pi_init(struct midi1_pll_pi_data *data, uint16_t sbpm, uint32_t clock_freq)
+{
+	/* If the user has not provided settings take the defaults */
+	if (!data->kp_shift) {
+		data->kp_shift = MIDI1_PLL_PI_KP_SHIFT;
+	}
+	if (!data->ki_shift) {
+		data->ki_shift = MIDI1_PLL_PI_KI_SHIFT;
+	}
+	data->clock_freq = clock_freq;
+
+	data->period_q16 = (uint64_t)sbpm_to_ticks(sbpm, clock_freq) << 16;
+	data->min_period_q16 = (uint64_t)sbpm_to_ticks(MIDI1_PLL_PI_MAX_SBPM, clock_freq) << 16;
+	data->max_period_q16 = (uint64_t)sbpm_to_ticks(MIDI1_PLL_PI_MIN_SBPM, clock_freq) << 16;
+	data->next_q16 = 0;
+	data->phase_error_q16 = 0;
+	data->last_timestamp = 0;
+	data->lock_count = 0;
+	data->slips = 0;
+	data->slipped = false;
+	data->running = false;
+	return;
+}
+
+/*
+ * timestamp_ticks is in hardware clock ticks of course
+ */
+void midi1_pll_pi_process_timestamp(struct midi1_pll_pi_data *data, uint32_t timestamp_ticks)
+{
+	if (!data->running) {
+		/* First pulse only sets the phase */
+		data->next_q16 = ((uint64_t)timestamp_ticks << 16) + data->period_q16;
+		data->last_timestamp = timestamp_ticks;
+		data->running = true;
+		return;
+	}
+
+	/* 1. Phase error: incoming - predicted, the integer part may wrap */
+	int32_t diff = (int32_t)(timestamp_ticks - (uint32_t)(data->next_q16 >> 16));
+	int64_t error = ((int64_t)diff << 16) - (int64_t)(data->next_q16 & 0xFFFFU);
+	int64_t half_period = (int64_t)(data->period_q16 >> 1);
+
+	if (error > half_period || error < -half_period) {
+		/*
+		 * 2a. Cycle slip, either pulses got lost or the tempo jumped.
+		 * Re-anchor on this pulse.  Only take the measured interval
+		 * when it is not a multiple of the current period, or when
+		 * the previous pulse slipped as well: a lost pulse is a one
+		 * off, a tempo of about half the old one slips every pulse.
+		 */
+		uint64_t interval_q16 = (uint64_t)(timestamp_ticks - data->last_timestamp) << 16;
+		uint64_t n = (interval_q16 + (data->period_q16 >> 1)) / data->period_q16;
+		int64_t rest = (int64_t)interval_q16 - (int64_t)(n * data->period_q16);
+
+		if (n < 2 || rest > (half_period >> 1) || rest < -(half_period >> 1) ||
+		    data->slipped) {
+			data->period_q16 = interval_q16;
+		}
+		data->next_q16 = ((uint64_t)timestamp_ticks << 16) + data->period_q16;
+		data->phase_error_q16 = 0;
+		data->lock_count = 0;
+		data->slips++;
+		data->slipped = true;
+	} else {
+		data->slipped = false;
+		/* 2b. Integral path corrects the period (frequency) */
+		data->period_q16 += pi_round_shift(error, data->ki_shift);
+
+		/* 3. Proportional path pulls the phase of the next pulse */
+		data->next_q16 += data->period_q16 + pi_round_shift(error, data->kp_shift);
+		data->phase_error_q16 = error;
+
+		if ((error < 0 ? -error : error) < (int64_t)(data->period_q16 >> MIDI1_PLL_PI_LOCK_SHIFT)) {
+			if (data->lock_count < UINT16_MAX) {
+				data->lock_count++;
+			}
+		} else {
+			data->lock_count = 0;
+		}
+	}
+
+	/* Keep the loop inside a sane tempo range */
+	if (data->period_q16 < data->min_period_q16) {
+		data->period_q16 = data->min_period_q16;
+	} else if (data->period_q16 > data->max_period_q16) {
+		data->period_q16 = data->max_period_q16;
+	}
+
+	data->last_timestamp = timestamp_ticks;
+	return;
+}
+
+uint64_t midi1_pll_pi_get_interval_q16(struct midi1_pll_pi_data *data)
+{
+	return data->period_q16;
+}
+
+uint32_t midi1_pll_pi_get_interval_ticks(struct midi1_pll_pi_data *data)
+{
+	return (uint32_t)((data->period_q16 + 0x8000U) >> 16);
+}
+
+uint32_t midi1_pll_pi_get_interval_us(struct midi1_pll_pi_data *data)
+{
+	if (data->clock_freq == 0) {
+		return 0;
+	}
+
+	uint64_t us = ((data->period_q16 >> 8) * 1000000ULL) / data->clock_freq;
+	return (uint32_t)(us >> 8);
+}
+
+uint32_t midi1_pll_pi_get_next_pulse(struct midi1_pll_pi_data *data)
+{
+	return (uint32_t)((data->next_q16 + 0x8000U) >> 16);
+}
+
+int32_t midi1_pll_pi_get_phase_error_ticks(struct midi1_pll_pi_data *data)
+{
+	return (int32_t)pi_round_shift(data->phase_error_q16, 16);
+}
+
+bool midi1_pll_pi_is_locked(struct midi1_pll_pi_data *data)
+{
+	return data->lock_count >= MIDI1_PLL_PI_LOCK_COUNT;
+}
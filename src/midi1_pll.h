@@ -8,6 +8,7 @@
 #ifndef MIDI1_PLL_H
 #define MIDI1_PLL_H
 #include <stdint.h>
+#include <stdbool.h>
 
 /* Loop filter constants */
 /*
@@ -46,6 +47,56 @@ struct midi1_pll_data {
 	uint32_t clock_freq;
 };
 
+/*
+ * Phase locking (PI) mode gains as right shifts, 2 = 1/4, 5 = 1/32
+ */
+#define MIDI1_PLL_PI_KP_SHIFT CONFIG_PLL_PI_KP_SHIFT
+#define MIDI1_PLL_PI_KI_SHIFT CONFIG_PLL_PI_KI_SHIFT
+
+/* Consecutive in-window pulses before the PI loop reports lock */
+#define MIDI1_PLL_PI_LOCK_COUNT 24
+
+/*
+ * Second order phase locking mode.  Instead of intervals it takes the
+ * absolute timestamp of each incoming pulse.  The period and the predicted
+ * next pulse are kept in Q16 ticks so rounding never accumulates.
+ * The timestamps may wrap at 32 bits.
+ *
+ * The PI loop only captures phase errors up to half a period, at 120 BPM
+ * a step of about 10 BPM.  Anything further out, a large tempo jump or a
+ * lost pulse, is not tracked but taken as a cycle slip: the loop
+ * re-anchors on the pulse, restarts the lock count and counts it in
+ * slips.  The measured interval becomes the new period unless it is a
+ * whole multiple of the old one, which is what lost pulses look like;
+ * a second slip in a row always takes it.
+ */
+struct midi1_pll_pi_data {
+	/*
+	 * Configuration of the loop:
+	 */
+	uint8_t kp_shift;
+	uint8_t ki_shift;
+
+	/*
+	 * Loop state:
+	 */
+	/* period of the generated clock in Q16 ticks */
+	uint64_t period_q16;
+	/* predicted timestamp of the next pulse in Q16 ticks */
+	uint64_t next_q16;
+	/* last phase error, incoming - predicted, Q16 ticks */
+	int64_t phase_error_q16;
+	uint64_t min_period_q16;
+	uint64_t max_period_q16;
+	uint32_t last_timestamp;
+	uint32_t clock_freq;
+	uint16_t lock_count;
+	uint16_t slips;
+	/* The previous pulse was a slip too */
+	bool slipped;
+	bool running;
+};
+
 /**
  * @brief Initialize the MIDI1 PLL with a nominal BPM.
  *
@@ -74,4 +125,49 @@ uint32_t midi1_pll_get_interval_us(struct midi1_pll_data *data);
  */
 int32_t midi1_pll_get_interval_ticks(struct midi1_pll_data *data);
 
+/**
+ * @brief Initialize the phase locking PLL with a nominal BPM.
+ *
+ * @param sbpm Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @param clock_freq frequency of the timestamp counter
+ */
+void midi1_pll_pi_init(struct midi1_pll_pi_data *data, uint16_t sbpm, uint32_t clock_freq);
+
+/**
+ * @brief Process the timestamp of an incoming MIDI clock pulse.
+ *
+ * @param timestamp_ticks counter value at the pulse.
+ */
+void midi1_pll_pi_process_timestamp(struct midi1_pll_pi_data *data, uint32_t timestamp_ticks);
+
+/**
+ * @brief Get the 24pqn period in Q16 ticks.
+ */
+uint64_t midi1_pll_pi_get_interval_q16(struct midi1_pll_pi_data *data);
+
+/**
+ * @brief Get the 24pqn period rounded to ticks.
+ */
+uint32_t midi1_pll_pi_get_interval_ticks(struct midi1_pll_pi_data *data);
+
+/**
+ * @brief Get the 24pqn period in microseconds.
+ */
+uint32_t midi1_pll_pi_get_interval_us(struct midi1_pll_pi_data *data);
+
+/**
+ * @brief Get the predicted timestamp of the next incoming pulse.
+ */
+uint32_t midi1_pll_pi_get_next_pulse(struct midi1_pll_pi_data *data);
+
+/**
+ * @brief Get the last phase error (incoming - predicted) in ticks.
+ */
+int32_t midi1_pll_pi_get_phase_error_ticks(struct midi1_pll_pi_data *data);
+
+/**
+ * @brief true once MIDI1_PLL_PI_LOCK_COUNT pulses in a row were in phase.
+ */
+bool midi1_pll_pi_is_locked(struct midi1_pll_pi_data *data);
+
 #endif /* MIDI1_PLL_H */
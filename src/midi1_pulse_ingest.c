@@ -0,0 +1,81 @@
+/**
+ * @file midi1_pulse_ingest.c
+ * @brief Timestamp MIDI real-time bytes when the parser dispatches them.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260218
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/counter.h>
+#include <zephyr/shell/shell.h>
+
+#include "midi1_pulse_ingest.h"
+
+/* The same counter as the one 'midi1_clock_meas_cntr' measures with */
+static const struct device *const ingest_counter =
+	DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi1_clock_meas_cntr), counter));
+
+static uint32_t counter_top = UINT32_MAX;
+/* Parser thread only */
+static uint32_t stat_stamped;
+
+int midi1_pulse_ingest_init(void)
+{
+	if (!device_is_ready(ingest_counter)) {
+		return -ENODEV;
+	}
+	counter_top = counter_get_top_value(ingest_counter);
+	return 0;
+}
+
+uint32_t midi1_pulse_ingest_now(void)
+{
+	uint32_t now = 0;
+
+	(void)counter_get_value(ingest_counter, &now);
+	stat_stamped++;
+	return now;
+}
+
+uint32_t midi1_pulse_ingest_interval(uint32_t from, uint32_t to)
+{
+	if (to >= from || counter_top == UINT32_MAX) {
+		return to - from;
+	}
+	return to + (counter_top - from) + 1U;
+}
+
+uint32_t midi1_pulse_ingest_count(void)
+{
+	return stat_stamped;
+}
+
+void midi1_pulse_ingest_reset_stats(void)
+{
+	stat_stamped = 0;
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_ingest(const struct shell *sh, size_t argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		midi1_pulse_ingest_reset_stats();
+		shell_print(sh, "ingest stats reset");
+		return 0;
+	}
+
+	shell_print(sh, "Real-time timestamps: %u, taken when the parser thread dispatches",
+		    midi1_pulse_ingest_count());
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), ingest, NULL, "Real-time byte timestamping [reset]", cmd_midi_ingest, 1,
+		 1);
+#endif
+
+/* EOF */
@@ -0,0 +1,48 @@
+/**
+ * @file midi1_pulse_ingest.h
+ * @brief Timestamp MIDI real-time bytes when the parser dispatches them.
+ *
+ * Real-time bytes get a timestamp from the counter used by
+ * midi1_clock_meas_cntr the moment the parser thread dispatches them to
+ * realtime_handler().  The UART interrupt belongs to the midi1_serial
+ * driver of the zephyr-midi1 module, which has no per byte RX hook, so
+ * the timestamp is not taken in the ISR: the time the byte waited in
+ * the driver buffer and the scheduling latency of the parser thread
+ * are part of the measured intervals.  The receive thread runs at a
+ * high priority to keep that small, the PLLs filter what is left.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260218
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_PULSE_INGEST_H
+#define MIDI1_PULSE_INGEST_H
+#include <stdint.h>
+
+/**
+ * @brief Prepare the timestamp counter, call before the first pulse.
+ *
+ * @return 0 or -ENODEV when the counter is not ready
+ */
+int midi1_pulse_ingest_init(void);
+
+/**
+ * @brief Timestamp of the real-time byte being dispatched right now.
+ *
+ * @return counter value, in ticks of the midi1_clock_meas_cntr counter
+ */
+uint32_t midi1_pulse_ingest_now(void);
+
+/**
+ * @brief Interval in counter ticks between two timestamps, handles the
+ * counter wrapping at its top value.
+ */
+uint32_t midi1_pulse_ingest_interval(uint32_t from, uint32_t to);
+
+/**
+ * @brief Real-time bytes timestamped so far.
+ */
+uint32_t midi1_pulse_ingest_count(void);
+void midi1_pulse_ingest_reset_stats(void);
+
+#endif /* MIDI1_PULSE_INGEST_H */
@@ -25,14 +25,43 @@ LOG_MODULE_REGISTER(midi1_receive_thread, CONFIG_LOG_DEFAULT_LEVEL);
 #include <zephyr/drivers/midi/midi1_clock_meas_cntr.h>
 
 /* Some helpers for MIDI  */
+#include "clock_jitter.h"
+#include "clock_source.h"
+#include "midi1_event.h"
 #include "midi1_pll.h"
-#include "note.h"
+#include "midi1_pulse_ingest.h"
+#include "clock_phase.h"
+#include "midi1_sysex.h"
+#include "midi_probe.h"
+#include "midi_router.h"
+#include "usb_midi_tx.h"
 
 /* Common stuff in the MIDI monitor application */
 #include "common.h"
 #include "model.h"
 
-K_MSGQ_DEFINE(midi_msgq, MIDI_LINE_MAX, MIDI_MSGQ_MAX, 4);
+/* Received MIDI events towards the LVGL thread, see 'midi1_event.h' */
+MIDI1_EVENT_RING_DEFINE(midi_event_ring, MIDI_EVENT_RING_SIZE);
+K_MSGQ_DEFINE(midi_sysex_q, sizeof(struct midi1_sysex *), MIDI_SYSEX_QUEUE_SIZE, 4);
+
+/*
+ * Record the message in binary form only, formatting to text is done by
+ * the LVGL thread for the lines it actually shows.
+ */
+static void midi_event_record(uint8_t status, uint8_t channel, uint8_t data1, uint8_t data2)
+{
+	struct midi1_event ev = {
+		.timestamp = k_cycle_get_32(),
+		.status = status,
+		.channel = channel,
+		.data1 = data1,
+		.data2 = data2,
+	};
+
+	midi1_event_put(&midi_event_ring, &ev);
+	/* The GUI now sleeps until something changed */
+	model_notify();
+}
 
 /**
  * @brief Callbacks/delegates for 'midi1_serial.c' after parsing MIDI1.0
@@ -42,90 +71,115 @@ K_MSGQ_DEFINE(midi_msgq, MIDI_LINE_MAX, MIDI_MSGQ_MAX, 4);
  * parser this one is blocked untill the delegate is finished.
  * It's better if you have something running for a longer time
  * to fire off a workqueue.
- *
- * It's channel + 1 because 0 = CH1 in MIDI.
  */
 void note_on_handler(uint8_t channel, uint8_t note, uint8_t velocity)
 {
-	char line[MIDI_LINE_MAX];
-	snprintf(line, sizeof(line), "CH: %d -> Note   on: %s %03d %03d", channel + 1,
-		 noteToTextWithOctave(note, false), note, velocity);
-	LOG_DBG("%s", line);
-	k_msgq_put(&midi_msgq, line, K_NO_WAIT);
+	/* Pass-through first, the display can wait */
+	midi_router_din(MIDI1_EVENT_NOTE_ON, channel, note, velocity);
+	midi_event_record(MIDI1_EVENT_NOTE_ON, channel, note, velocity);
 	return;
 }
 
 void note_off_handler(uint8_t channel, uint8_t note, uint8_t velocity)
 {
-	char line[MIDI_LINE_MAX];
-	snprintf(line, sizeof(line), "CH: %d -> Note  off: %s %03d %03d", channel + 1,
-		 noteToTextWithOctave(note, false), note, velocity);
-	LOG_DBG("%s", line);
-	k_msgq_put(&midi_msgq, line, K_NO_WAIT);
+	midi_router_din(MIDI1_EVENT_NOTE_OFF, channel, note, velocity);
+	midi_event_record(MIDI1_EVENT_NOTE_OFF, channel, note, velocity);
 	return;
 }
 
 void pitchwheel_handler(uint8_t channel, uint8_t lsb, uint8_t msb)
 {
-	/* 14 bit value for the pitch wheel  */
-	int16_t pwheel = (int16_t)((msb << 7) | lsb) - PITCHWHEEL_CENTER;
-	char line[MIDI_LINE_MAX];
-	snprintf(line, sizeof(line), "CH: %d -> Pitchwheel: %d", channel + 1, pwheel);
-	LOG_DBG("%s", line);
-	k_msgq_put(&midi_msgq, line, K_NO_WAIT);
+	midi_router_din(MIDI1_EVENT_PITCHWHEEL, channel, lsb, msb);
+	midi_event_record(MIDI1_EVENT_PITCHWHEEL, channel, lsb, msb);
 	return;
 }
 
 void control_change_handler(uint8_t channel, uint8_t controller, uint8_t value)
 {
-	char line[MIDI_LINE_MAX];
-	snprintf(line, sizeof(line), "CH: %d -> CC: %d value: %d", channel + 1, controller, value);
-	LOG_DBG("%s", line);
-	k_msgq_put(&midi_msgq, line, K_NO_WAIT);
+	midi_router_din(MIDI1_EVENT_CONTROL_CHANGE, channel, controller, value);
+	midi_event_record(MIDI1_EVENT_CONTROL_CHANGE, channel, controller, value);
 	return;
 }
 
+/* Set once by the receive thread before the callbacks are registered */
+static const struct device *const meas = DEVICE_DT_GET(DT_NODELABEL(midi1_clock_meas_cntr));
+static const struct midi1_clock_meas_cntr_api *mid_meas;
+
 /* This feeds the clock measurement driver 'midi_clock_meas_cntr' */
 void realtime_handler(uint8_t msg)
 {
+	uint32_t timestamp;
+
+	MIDI_PROBE_BEGIN(REALTIME);
+
 	/*
-	 * Here we use the MIDI clock measurement driver
-	 * to count the received BPM.
+	 * Timestamp taken now, as the parser dispatches the byte, so before
+	 * anything else looks at the message.
 	 */
-	if (msg == RT_TIMING_CLOCK) {
+	timestamp = midi1_pulse_ingest_now();
 
-		const struct device *meas = DEVICE_DT_GET(DT_NODELABEL(midi1_clock_meas_cntr));
-		if (!device_is_ready(meas)) {
-			LOG_INF("MIDI1 clock measurement device not ready");
-			return;
-		}
-		const struct midi1_clock_meas_cntr_api *mid_meas = meas->api;
+	if (msg == RT_TIMING_CLOCK) {
+		/*
+		 * The measurement driver still counts the received BPM
+		 * for the display.
+		 */
 		mid_meas->pulse(meas);
+
 		/*
-		 * Feed the PLL with this measurement we just did
-		 * 'g_pll' is defined in 'common.c'
+		 * Feed the PLLs with the dispatch timestamps, the latency of
+		 * this thread is in the intervals and filtered by the PLLs.
+		 * 'g_pll_pi' is defined in 'common.c'
 		 */
-		midi1_pll_process_interval(&g_pll, mid_meas->interval_ticks(meas));
+		clock_source_pulse(CLOCK_SOURCE_SERIAL, timestamp);
+		midi1_pll_pi_process_timestamp(&g_pll_pi, timestamp);
+		/* For the generator to follow in phase, see 'clock_phase.h' */
+		clock_phase_rx(&g_pll_pi);
+		clock_jitter_rx_error(midi1_pll_pi_get_phase_error_ticks(&g_pll_pi));
 	}
 	/* We ignore other RT messages for now */
+	MIDI_PROBE_END(REALTIME);
 	return;
 }
 
+/*
+ * A completed SysEx goes by reference to the GUI and to USB, each gets
+ * its own reference.  The parser's reference becomes the GUI one.
+ */
+static void sysex_hand_off(struct midi1_sysex *msg)
+{
+	if (!msg) {
+		return;
+	}
+	midi1_sysex_ref(msg, 1);
+	if (k_msgq_put(&midi_sysex_q, &msg, K_NO_WAIT)) {
+		midi1_sysex_release(msg);
+	} else {
+		model_notify();
+	}
+	if (usb_midi_tx_sysex(msg)) {
+		midi1_sysex_release(msg);
+	}
+}
+
+/*
+ * The bytes go straight into a pool buffer, logging every byte made a
+ * patch dump stall this thread and lose clock pulses.
+ */
 void sysex_start_handler(void)
 {
-	LOG_INF("sysex_start_handler()");
+	sysex_hand_off(midi1_sysex_start());
 	return;
 }
 
 void sysex_data_handler(uint8_t data)
 {
-	LOG_INF("%x ", data);
+	midi1_sysex_data(data);
 	return;
 }
 
 void sysex_stop_handler(void)
 {
-	LOG_INF("sysex_stop_handler()");
+	sysex_hand_off(midi1_sysex_stop());
 	return;
 }
 
@@ -146,16 +200,24 @@ void midi1_serial_receive_thread(void)
 	const struct midi1_serial_api *mid = midi->api;
 
 	/* We need to find the clock frequency used by the counter. */
-	const struct device *meas = DEVICE_DT_GET(DT_NODELABEL(midi1_clock_meas_cntr));
 	if (!device_is_ready(meas)) {
 		LOG_INF("MIDI1 clock measurement device not ready");
 		return;
 	}
-	const struct midi1_clock_meas_cntr_api *mid_meas = meas->api;
+	mid_meas = meas->api;
 
-	/* Lets init the PLL but adjust the tracking gain from the default */
-	// g_pll.tracking_g = 27;
-	midi1_pll_init(&g_pll, 12000, mid_meas->clock_freq(meas));
+	if (midi1_pulse_ingest_init()) {
+		LOG_ERR("MIDI1 pulse timestamp counter not ready");
+		return;
+	}
+
+	/* One PLL per clock input, the serial one is fed from here */
+	if (clock_source_init(mid_meas->clock_freq(meas))) {
+		LOG_ERR("Clock source timestamp counter not ready");
+		return;
+	}
+	midi1_pll_pi_init(&g_pll_pi, 12000, mid_meas->clock_freq(meas));
+	clock_phase_init(mid_meas->clock_freq(meas));
 
 	/*
 	 * Set the callbacks in the driver to our own callbacks.  Pointers
@@ -176,10 +238,15 @@ void midi1_serial_receive_thread(void)
 	while (1) {
 		/* As this call is blocking no need to sleep in between */
 		mid->receiveparser(midi);
+		MIDI_PROBE_BEGIN(RX_LOOP);
 		uint16_t cntr_sbpm = mid_meas->get_sbpm(meas);
-		uint16_t pll_sbpm = pqn24_to_sbpm(midi1_pll_get_interval_us(&g_pll));
+		uint16_t pll_sbpm = clock_source_get_sbpm(CLOCK_SOURCE_SERIAL);
 		LOG_DBG("--> measured:[ %d ] pll: [ %d ] <-- ", cntr_sbpm, pll_sbpm);
-		model_set(true, 0, cntr_sbpm, pll_sbpm, 0);
+		LOG_DBG("--> pll_pi: [ %d ] phase error: [ %d ] locked: [ %d ] <-- ",
+			pqn24_to_sbpm(midi1_pll_pi_get_interval_us(&g_pll_pi)),
+			midi1_pll_pi_get_phase_error_ticks(&g_pll_pi), midi1_pll_pi_is_locked(&g_pll_pi));
+		model_set_clock(cntr_sbpm, pll_sbpm);
+		MIDI_PROBE_END(RX_LOOP);
 	}
 	return;
 }
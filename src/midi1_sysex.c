@@ -0,0 +1,191 @@
+/**
+ * @file midi1_sysex.c
+ * @brief SysEx reassembly in a pool of preallocated message buffers.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260324
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdio.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/shell/shell.h>
+
+#include "midi1_sysex.h"
+
+static struct midi1_sysex pool[MIDI1_SYSEX_BUFFERS];
+
+/* Only the parser (one thread) fills a buffer, the stats are under the lock */
+static struct midi1_sysex *open_msg;
+static bool open_no_buffer;
+static struct k_spinlock stats_lock;
+static struct midi1_sysex_stats stats;
+
+static uint32_t pool_in_use(void)
+{
+	uint32_t n = 0;
+
+	for (int i = 0; i < MIDI1_SYSEX_BUFFERS; i++) {
+		n += atomic_get(&pool[i].refs) ? 1U : 0U;
+	}
+	return n;
+}
+
+static struct midi1_sysex *pool_alloc(void)
+{
+	for (int i = 0; i < MIDI1_SYSEX_BUFFERS; i++) {
+		if (atomic_cas(&pool[i].refs, 0, 1)) {
+			return &pool[i];
+		}
+	}
+	return NULL;
+}
+
+/* The open message is done, count it */
+static struct midi1_sysex *finish(uint8_t flags)
+{
+	struct midi1_sysex *msg = open_msg;
+	k_spinlock_key_t key;
+
+	open_msg = NULL;
+	open_no_buffer = false;
+	if (!msg) {
+		return NULL;
+	}
+	msg->flags |= flags;
+
+	key = k_spin_lock(&stats_lock);
+	stats.completed++;
+	stats.bytes += msg->len;
+	stats.max_len = MAX(stats.max_len, msg->len);
+	if (msg->flags & MIDI1_SYSEX_TRUNCATED) {
+		stats.truncated++;
+	}
+	if (msg->flags & MIDI1_SYSEX_UNTERMINATED) {
+		stats.unterminated++;
+	}
+	k_spin_unlock(&stats_lock, key);
+	return msg;
+}
+
+struct midi1_sysex *midi1_sysex_start(void)
+{
+	struct midi1_sysex *prev = finish(MIDI1_SYSEX_UNTERMINATED);
+	k_spinlock_key_t key;
+
+	open_msg = pool_alloc();
+
+	key = k_spin_lock(&stats_lock);
+	stats.started++;
+	if (open_msg) {
+		open_msg->timestamp = k_cycle_get_32();
+		open_msg->len = 0;
+		open_msg->flags = 0;
+		stats.max_in_use = MAX(stats.max_in_use, pool_in_use());
+	} else {
+		/* The data bytes of this one are counted as lost */
+		open_no_buffer = true;
+		stats.no_buffer++;
+	}
+	k_spin_unlock(&stats_lock, key);
+	return prev;
+}
+
+void midi1_sysex_data(uint8_t data)
+{
+	struct midi1_sysex *msg = open_msg;
+
+	if (msg && msg->len < MIDI1_SYSEX_SIZE) {
+		msg->data[msg->len++] = data;
+		return;
+	}
+	if (msg) {
+		msg->flags |= MIDI1_SYSEX_TRUNCATED;
+	} else if (!open_no_buffer) {
+		/* Data outside of a message, the parser should not do that */
+		return;
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	stats.lost_bytes++;
+	k_spin_unlock(&stats_lock, key);
+}
+
+struct midi1_sysex *midi1_sysex_stop(void)
+{
+	return finish(0);
+}
+
+void midi1_sysex_ref(struct midi1_sysex *msg, int count)
+{
+	atomic_add(&msg->refs, count);
+}
+
+void midi1_sysex_release(struct midi1_sysex *msg)
+{
+	/* The last atomic_dec() leaves refs at 0, the buffer is free again */
+	(void)atomic_dec(&msg->refs);
+}
+
+/* Enough to see the manufacturer and the command */
+#define SYSEX_SUMMARY_BYTES 6
+
+int midi1_sysex_to_str(const struct midi1_sysex *msg, char *buf, size_t len)
+{
+	int n = snprintf(buf, len, "SysEx F0");
+
+	for (int i = 0; i < MIN(msg->len, SYSEX_SUMMARY_BYTES) && n < (int)len; i++) {
+		n += snprintf(buf + n, len - n, " %02X", msg->data[i]);
+	}
+	if (n < (int)len) {
+		n += snprintf(buf + n, len - n, "%s (%u bytes%s%s)",
+			      msg->len > SYSEX_SUMMARY_BYTES ? " .." : "", msg->len,
+			      (msg->flags & MIDI1_SYSEX_TRUNCATED) ? ", truncated" : "",
+			      (msg->flags & MIDI1_SYSEX_UNTERMINATED) ? ", no F7" : "");
+	}
+	return n;
+}
+
+void midi1_sysex_get_stats(struct midi1_sysex_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+	k_spin_unlock(&stats_lock, key);
+}
+
+void midi1_sysex_reset_stats(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	(void)memset(&stats, 0, sizeof(stats));
+	k_spin_unlock(&stats_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_sysex(const struct shell *sh, size_t argc, char **argv)
+{
+	struct midi1_sysex_stats s;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		midi1_sysex_reset_stats();
+		shell_print(sh, "sysex stats reset");
+		return 0;
+	}
+
+	midi1_sysex_get_stats(&s);
+	shell_print(sh, "started %u, completed %u, bytes %u, longest %u/%d", s.started,
+		    s.completed, s.bytes, s.max_len, MIDI1_SYSEX_SIZE);
+	shell_print(sh, "truncated %u, unterminated %u, no buffer %u, lost bytes %u",
+		    s.truncated, s.unterminated, s.no_buffer, s.lost_bytes);
+	shell_print(sh, "buffers in use %u, max %u/%d", pool_in_use(), s.max_in_use,
+		    MIDI1_SYSEX_BUFFERS);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), sysex, NULL, "SysEx reassembly [reset]", cmd_midi_sysex, 1, 1);
+#endif
+
+/* EOF */
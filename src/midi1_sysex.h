@@ -0,0 +1,103 @@
+/**
+ * @file midi1_sysex.h
+ * @brief SysEx reassembly in a pool of preallocated message buffers.
+ *
+ * The parser callbacks write a System Exclusive message straight into a
+ * free buffer of the pool, nothing is copied or logged per byte.  A
+ * completed message is handed to its consumers by reference, every
+ * consumer releases it when done and the last one returns the buffer.
+ *
+ * A message longer than a buffer is truncated (the rest is counted and
+ * thrown away), a message that starts while every buffer is still in
+ * use is dropped as a whole.  Both are flagged or counted so it is
+ * always visible what was lost.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260324
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_SYSEX_H
+#define MIDI1_SYSEX_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#define MIDI1_SYSEX_BUFFERS CONFIG_MIDI1_SYSEX_BUFFERS
+/* Data bytes between F0 and F7, those two are not stored */
+#define MIDI1_SYSEX_SIZE    CONFIG_MIDI1_SYSEX_SIZE
+
+/* Longer than MIDI1_SYSEX_SIZE, only the start is in data */
+#define MIDI1_SYSEX_TRUNCATED    BIT(0)
+/* Ended by another start instead of F7 */
+#define MIDI1_SYSEX_UNTERMINATED BIT(1)
+
+struct midi1_sysex {
+	/* k_cycle_get_32() of the start */
+	uint32_t timestamp;
+	/* Bytes in data */
+	uint16_t len;
+	uint8_t flags;
+	/* Holders of this buffer, 0 is free */
+	atomic_t refs;
+	uint8_t data[MIDI1_SYSEX_SIZE];
+};
+
+struct midi1_sysex_stats {
+	uint32_t started;
+	uint32_t completed;
+	uint32_t truncated;
+	uint32_t unterminated;
+	/* Started while every buffer was in use */
+	uint32_t no_buffer;
+	uint32_t bytes;
+	/* Data bytes thrown away, truncated or without a buffer */
+	uint32_t lost_bytes;
+	uint32_t max_len;
+	uint32_t max_in_use;
+};
+
+/**
+ * @brief Parser side: F0 received, take a free buffer.
+ *
+ * A message still open is finished as unterminated and returned.
+ *
+ * @return the unterminated message or NULL
+ */
+struct midi1_sysex *midi1_sysex_start(void);
+
+/**
+ * @brief Parser side: one data byte, stored in place.
+ */
+void midi1_sysex_data(uint8_t data);
+
+/**
+ * @brief Parser side: F7 received.
+ *
+ * @return the completed message with one reference held by the caller,
+ *         or NULL when there was no buffer for it
+ */
+struct midi1_sysex *midi1_sysex_stop(void);
+
+/**
+ * @brief Add references for more consumers before handing it off.
+ */
+void midi1_sysex_ref(struct midi1_sysex *msg, int count);
+
+/**
+ * @brief A consumer is done, the last one frees the buffer.
+ */
+void midi1_sysex_release(struct midi1_sysex *msg);
+
+/**
+ * @brief One line summary, the first bytes in hex and the length.
+ *
+ * @return like snprintf()
+ */
+int midi1_sysex_to_str(const struct midi1_sysex *msg, char *buf, size_t len);
+
+void midi1_sysex_get_stats(struct midi1_sysex_stats *stats);
+void midi1_sysex_reset_stats(void);
+
+#endif /* MIDI1_SYSEX_H */
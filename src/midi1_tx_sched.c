@@ -0,0 +1,425 @@
+/**
+ * @file midi1_tx_sched.c
+ * @brief Clock quantised serial MIDI output with running status.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260322
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/shell/shell.h>
+
+/* RT_TIMING_CLOCK and friends */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "midi1_tx_sched.h"
+#include "pulse_out.h"
+
+LOG_MODULE_REGISTER(midi1_tx_sched, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* The UART behind the serial MIDI driver, real-time bytes interleave safely */
+static const struct device *const tx_uart = DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi0), uart));
+
+/* The status byte is repeated at least this often (one beat) */
+#define MIDI1_TX_SCHED_REFRESH_TICKS 24
+
+/* Start, 8 data and a stop bit at 31250 baud */
+#define MIDI1_BYTE_US 320
+
+struct tx_msg {
+	uint32_t tick;
+	/* Keeps the queue order of messages due on the same tick */
+	uint32_t seq;
+	uint8_t bytes[3];
+	uint8_t len;
+};
+
+/* Binary min-heap on (tick, seq), under sched_lock */
+static struct k_spinlock sched_lock;
+static struct tx_msg heap[MIDI1_TX_SCHED_DEPTH];
+static uint32_t heap_len;
+static uint32_t put_seq;
+static struct midi1_tx_sched_stats stats;
+
+static atomic_t now_tick;
+
+/*
+ * Cycle counter of the moment the UART has sent everything handed to
+ * it, and of the next expected clock pulse.
+ */
+static atomic_t busy_until_cyc;
+static atomic_t next_pulse_cyc;
+static uint32_t byte_cyc;
+static K_SEM_DEFINE(pulse_sem, 0, 1);
+
+/* Released by the clock callback, written out by the TX thread */
+K_MSGQ_DEFINE(midi1_tx_due_q, sizeof(struct tx_msg), MIDI1_TX_SCHED_DEPTH, 4);
+
+static bool msg_before(const struct tx_msg *a, const struct tx_msg *b)
+{
+	int32_t d = (int32_t)(a->tick - b->tick);
+
+	return d < 0 || (d == 0 && (int32_t)(a->seq - b->seq) < 0);
+}
+
+static void heap_push(const struct tx_msg *msg)
+{
+	uint32_t i = heap_len++;
+
+	while (i > 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (!msg_before(msg, &heap[parent])) {
+			break;
+		}
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = *msg;
+}
+
+static void heap_pop(struct tx_msg *out)
+{
+	struct tx_msg last = heap[--heap_len];
+	uint32_t i = 0;
+
+	*out = heap[0];
+	while (true) {
+		uint32_t child = 2 * i + 1;
+
+		if (child >= heap_len) {
+			break;
+		}
+		if (child + 1 < heap_len && msg_before(&heap[child + 1], &heap[child])) {
+			child++;
+		}
+		if (!msg_before(&heap[child], &last)) {
+			break;
+		}
+		heap[i] = heap[child];
+		i = child;
+	}
+	heap[i] = last;
+}
+
+uint32_t midi1_tx_sched_now(void)
+{
+	return (uint32_t)atomic_get(&now_tick);
+}
+
+/* Channel voice messages only, running status does not apply to the rest */
+static bool msg_valid(uint8_t status, uint8_t len)
+{
+	return status >= 0x80 && status < 0xF0 && len >= 2 && len <= 3;
+}
+
+int midi1_tx_sched_put(uint32_t tick, uint8_t status, uint8_t data1, uint8_t data2, uint8_t len)
+{
+	struct tx_msg msg = {
+		.tick = tick,
+		.bytes = {status, data1 & 0x7F, data2 & 0x7F},
+		.len = len,
+	};
+	k_spinlock_key_t key;
+
+	if (!msg_valid(status, len)) {
+		return -EINVAL;
+	}
+
+	key = k_spin_lock(&sched_lock);
+	if (heap_len == MIDI1_TX_SCHED_DEPTH) {
+		stats.dropped++;
+		k_spin_unlock(&sched_lock, key);
+		return -ENOSPC;
+	}
+	if ((int32_t)(tick - midi1_tx_sched_now()) <= 0) {
+		stats.late++;
+	}
+	msg.seq = put_seq++;
+	heap_push(&msg);
+	stats.queued++;
+	stats.max_depth = MAX(stats.max_depth, heap_len);
+	k_spin_unlock(&sched_lock, key);
+	return 0;
+}
+
+int midi1_tx_sched_send(uint8_t status, uint8_t data1, uint8_t data2, uint8_t len)
+{
+	struct tx_msg msg = {
+		.tick = midi1_tx_sched_now(),
+		.bytes = {status, data1 & 0x7F, data2 & 0x7F},
+		.len = len,
+	};
+	k_spinlock_key_t key;
+	int ret;
+
+	if (!msg_valid(status, len)) {
+		return -EINVAL;
+	}
+
+	/* Straight to the TX thread, behind what was released on this tick */
+	ret = k_msgq_put(&midi1_tx_due_q, &msg, K_NO_WAIT);
+	key = k_spin_lock(&sched_lock);
+	if (ret) {
+		stats.dropped++;
+	} else {
+		stats.queued++;
+	}
+	k_spin_unlock(&sched_lock, key);
+	return ret ? -ENOSPC : 0;
+}
+
+/* Estimated time the UART is still busy at cyc, call with sched_lock held */
+static void clock_overlap_add(uint32_t cyc)
+{
+	int32_t behind = (int32_t)((uint32_t)atomic_get(&busy_until_cyc) - cyc);
+	uint32_t us = behind > 0 ? k_cyc_to_us_floor32((uint32_t)behind) : 0U;
+
+	if (us) {
+		stats.clock_overlapped++;
+	}
+	stats.clock_overlap_last_us = us;
+	stats.clock_overlap_max_us = MAX(stats.clock_overlap_max_us, us);
+}
+
+int midi1_tx_sched_realtime(uint8_t rt)
+{
+	k_spinlock_key_t key;
+
+	if (rt < RT_TIMING_CLOCK) {
+		return -EINVAL;
+	}
+	/* A single byte may go in between the bytes of any other message */
+	uart_poll_out(tx_uart, rt);
+	/* The clock pulse outputs follow the transport */
+	pulse_out_transport(rt);
+
+	key = k_spin_lock(&sched_lock);
+	stats.realtime++;
+	clock_overlap_add(k_cycle_get_32());
+	k_spin_unlock(&sched_lock, key);
+	return 0;
+}
+
+void midi1_tx_sched_tick(void)
+{
+	static uint32_t last_cyc;
+	uint32_t cyc = k_cycle_get_32();
+	uint32_t now = (uint32_t)atomic_inc(&now_tick) + 1U;
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+	struct tx_msg msg;
+
+	/* The tempo ramps slowly, the previous interval predicts the next pulse */
+	if (last_cyc) {
+		atomic_set(&next_pulse_cyc, (atomic_val_t)(cyc + (cyc - last_cyc)));
+	}
+	last_cyc = cyc;
+	clock_overlap_add(cyc);
+
+	while (heap_len > 0 && (int32_t)(heap[0].tick - now) <= 0) {
+		heap_pop(&msg);
+		if (k_msgq_put(&midi1_tx_due_q, &msg, K_NO_WAIT)) {
+			stats.dropped++;
+		}
+	}
+	k_spin_unlock(&sched_lock, key);
+	k_sem_give(&pulse_sem);
+}
+
+void midi1_tx_sched_get_stats(struct midi1_tx_sched_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+	*out = stats;
+	k_spin_unlock(&sched_lock, key);
+}
+
+void midi1_tx_sched_reset_stats(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+	(void)memset(&stats, 0, sizeof(stats));
+	k_spin_unlock(&sched_lock, key);
+}
+
+/* ---------------------------- THREADS ------------------------------------ */
+
+#ifdef CONFIG_MIDI1_TX_SCHED_ASYNC
+static K_SEM_DEFINE(tx_done_sem, 0, 1);
+
+/*
+ * The end of a transfer is known here, it replaces the estimate of
+ * busy_until_cyc.
+ */
+static void tx_uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+	if (evt->type == UART_TX_DONE || evt->type == UART_TX_ABORTED) {
+		atomic_set(&busy_until_cyc, (atomic_val_t)k_cycle_get_32());
+		k_sem_give(&tx_done_sem);
+	}
+}
+
+static int tx_init(void)
+{
+	return uart_callback_set(tx_uart, tx_uart_cb, NULL);
+}
+
+/* The thread blocks until the UART interrupt says the bytes are out */
+static void tx_write(const uint8_t *buf, uint8_t len, uint32_t start)
+{
+	k_sem_reset(&tx_done_sem);
+	if (uart_tx(tx_uart, buf, len, SYS_FOREVER_US) == 0) {
+		(void)k_sem_take(&tx_done_sem, K_USEC(2U * len * MIDI1_BYTE_US + MIDI1_BYTE_US));
+		return;
+	}
+	for (uint8_t i = 0; i < len; i++) {
+		uart_poll_out(tx_uart, buf[i]);
+	}
+}
+#else
+static int tx_init(void)
+{
+	return 0;
+}
+
+/*
+ * The interrupt of the UART belongs to the midi1_serial driver for RX,
+ * so this writes with uart_poll_out().  The thread sleeps until the
+ * byte before is in the shift register, uart_poll_out() then finds the
+ * holding register free and returns at once instead of spinning for a
+ * byte time.
+ */
+static void tx_write(const uint8_t *buf, uint8_t len, uint32_t start)
+{
+	for (uint8_t i = 0; i < len; i++) {
+		int32_t wait = (int32_t)(start + i * byte_cyc - byte_cyc - k_cycle_get_32());
+
+		if (wait > 0) {
+			k_sleep(K_CYC(wait));
+		}
+		uart_poll_out(tx_uart, buf[i]);
+	}
+}
+#endif /* CONFIG_MIDI1_TX_SCHED_ASYNC */
+
+/*
+ * Wait until the message fits in before the next clock pulse, one byte
+ * time of margin.  A pulse that is due already (clock stopped or the
+ * first pulse) does not hold anything back.
+ */
+static uint32_t wait_for_gap(uint8_t nbytes)
+{
+	while (1) {
+		uint32_t now = k_cycle_get_32();
+		uint32_t busy = (uint32_t)atomic_get(&busy_until_cyc);
+		uint32_t start = (int32_t)(busy - now) > 0 ? busy : now;
+		uint32_t end = start + nbytes * byte_cyc;
+		uint32_t next = (uint32_t)atomic_get(&next_pulse_cyc);
+
+		if ((int32_t)(next - now) <= 0 || (int32_t)(next - byte_cyc - end) >= 0) {
+			return end;
+		}
+
+		k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+		stats.deferred++;
+		k_spin_unlock(&sched_lock, key);
+		k_sem_reset(&pulse_sem);
+		(void)k_sem_take(&pulse_sem, K_USEC(k_cyc_to_us_floor32(next - now) + MIDI1_BYTE_US));
+	}
+}
+
+static void midi1_tx_sched_thread(void)
+{
+	uint8_t running = 0;
+	uint32_t running_tick = 0;
+	struct tx_msg msg;
+
+	if (!device_is_ready(tx_uart) || tx_init()) {
+		LOG_ERR("Serial MIDI1 UART not ready");
+		return;
+	}
+	byte_cyc = k_us_to_cyc_ceil32(MIDI1_BYTE_US);
+
+	while (1) {
+		k_msgq_get(&midi1_tx_due_q, &msg, K_FOREVER);
+
+		bool skip = msg.bytes[0] == running &&
+			    (msg.tick - running_tick) < MIDI1_TX_SCHED_REFRESH_TICKS;
+		uint8_t nbytes = msg.len - (skip ? 1U : 0U);
+		uint32_t end = wait_for_gap(nbytes);
+
+		/* Before writing, the clock callback may look at it meanwhile */
+		atomic_set(&busy_until_cyc, (atomic_val_t)end);
+		tx_write(&msg.bytes[skip ? 1 : 0], nbytes, end - nbytes * byte_cyc);
+		if (!skip) {
+			running = msg.bytes[0];
+			running_tick = msg.tick;
+		}
+
+		k_spinlock_key_t key = k_spin_lock(&sched_lock);
+
+		stats.sent++;
+		stats.bytes += msg.len - (skip ? 1U : 0U);
+		stats.saved += skip ? 1U : 0U;
+		k_spin_unlock(&sched_lock, key);
+	}
+}
+
+/* Right behind the clock callback, it sleeps while the UART sends */
+K_THREAD_DEFINE(midi1_tx_sched_tid, 1024, midi1_tx_sched_thread, NULL, NULL, NULL, 1, 0, 0);
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_tx(const struct shell *sh, size_t argc, char **argv)
+{
+	struct midi1_tx_sched_stats s;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		midi1_tx_sched_reset_stats();
+		shell_print(sh, "tx stats reset");
+		return 0;
+	}
+
+	midi1_tx_sched_get_stats(&s);
+	shell_print(sh, "tick %u, queued %u, sent %u, late %u, dropped %u, max depth %u/%d",
+		    midi1_tx_sched_now(), s.queued, s.sent, s.late, s.dropped, s.max_depth,
+		    MIDI1_TX_SCHED_DEPTH);
+	shell_print(sh, "bytes %u, running status saved %u (%u%%)", s.bytes, s.saved,
+		    (s.bytes + s.saved) ? (s.saved * 100U) / (s.bytes + s.saved) : 0U);
+	shell_print(sh, "held for a pulse %u, real-time %u", s.deferred, s.realtime);
+	shell_print(sh, "clock overlap (estimated) %u, last %u us, max %u us", s.clock_overlapped,
+		    s.clock_overlap_last_us, s.clock_overlap_max_us);
+	return 0;
+}
+
+static int cmd_midi_rt(const struct shell *sh, size_t argc, char **argv)
+{
+	static const struct {
+		const char *name;
+		uint8_t rt;
+	} cmds[] = {{"start", RT_START}, {"continue", RT_CONTINUE}, {"stop", RT_STOP}};
+
+	for (size_t i = 0; i < ARRAY_SIZE(cmds); i++) {
+		if (strcmp(argv[1], cmds[i].name) == 0) {
+			return midi1_tx_sched_realtime(cmds[i].rt);
+		}
+	}
+	shell_error(sh, "use start, continue or stop");
+	return -EINVAL;
+}
+
+SHELL_SUBCMD_ADD((midi), tx, NULL, "Serial MIDI TX scheduler [reset]", cmd_midi_tx, 1, 1);
+SHELL_SUBCMD_ADD((midi), rt, NULL, "Send a real-time message <start|continue|stop>", cmd_midi_rt,
+		 2, 0);
+#endif
+
+/* EOF */
@@ -0,0 +1,128 @@
+/**
+ * @file midi1_tx_sched.h
+ * @brief Clock quantised serial MIDI output with running status.
+ *
+ * Messages are queued with the 24pqn tick of the generated clock they
+ * are due on.  The clock callback releases the due messages on every
+ * pulse and a TX thread writes them to the UART of midi0, leaving out
+ * the status byte when it repeats (running status).  The caller never
+ * waits for the 31250 baud UART.
+ *
+ * The status is sent again at least once per beat so a receiver that
+ * is plugged in halfway picks up the stream.  Real-time bytes of the
+ * clock driver may arrive in between, they do not cancel running status.
+ *
+ * Real-time bytes never wait behind a channel message: the TX thread
+ * keeps track of when the UART finishes what it was given and holds a
+ * message back when it would still be sending at the next clock pulse.
+ * midi1_tx_sched_realtime() writes straight to the UART.
+ *
+ * The UART is shared with the clock driver, which writes its 0xF8 with
+ * uart_poll_out() from the counter ISR.  Because no message is started
+ * that would run into the next pulse, the UART is idle then and the
+ * 0xF8 goes out at once.  A pulse that comes earlier than predicted
+ * waits for at most the byte in the shift register.
+ *
+ * The TX thread does not spin on the UART: it sleeps between bytes, or
+ * with CONFIG_MIDI1_TX_SCHED_ASYNC until uart_tx() reports the message
+ * sent.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260322
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_TX_SCHED_H
+#define MIDI1_TX_SCHED_H
+#include <stdint.h>
+
+#include "midi1_event.h"
+
+/* Messages waiting for their tick */
+#define MIDI1_TX_SCHED_DEPTH CONFIG_MIDI1_TX_SCHED_DEPTH
+
+struct midi1_tx_sched_stats {
+	uint32_t queued;
+	uint32_t sent;
+	uint32_t bytes;
+	/* Status bytes left out by running status */
+	uint32_t saved;
+	/* Due on a tick that had already passed, sent on the next one */
+	uint32_t late;
+	/* Queue full */
+	uint32_t dropped;
+	uint32_t max_depth;
+	/* Held back until after a clock pulse */
+	uint32_t deferred;
+	uint32_t realtime;
+	/*
+	 * Pulses that fell while the UART was still sending channel bytes,
+	 * and for how long.  Estimated from the byte times of what the TX
+	 * thread wrote, with CONFIG_MIDI1_TX_SCHED_ASYNC from the end of the
+	 * last transfer, not a measured send time of the 0xF8.
+	 */
+	uint32_t clock_overlapped;
+	uint32_t clock_overlap_last_us;
+	uint32_t clock_overlap_max_us;
+};
+
+/**
+ * @brief Current 24pqn tick of the generated clock, free running.
+ */
+uint32_t midi1_tx_sched_now(void);
+
+/**
+ * @brief Queue a channel voice message, thread or ISR.
+ *
+ * @param tick midi1_tx_sched_now() based tick it is due on
+ * @param status status byte including the channel
+ * @param len 2 or 3 bytes including the status
+ * @return 0, -ENOSPC when the queue is full or -EINVAL
+ */
+int midi1_tx_sched_put(uint32_t tick, uint8_t status, uint8_t data1, uint8_t data2, uint8_t len);
+
+/**
+ * @brief Send a channel voice message as soon as possible, thread or ISR.
+ *
+ * It skips the tick queue but still uses running status and keeps out of
+ * the way of the clock, for passing through live input.
+ *
+ * @return 0, -ENOSPC when the TX thread is that far behind or -EINVAL
+ */
+int midi1_tx_sched_send(uint8_t status, uint8_t data1, uint8_t data2, uint8_t len);
+
+static inline int midi1_tx_note_on(uint32_t tick, uint8_t channel, uint8_t note, uint8_t velocity)
+{
+	return midi1_tx_sched_put(tick, MIDI1_EVENT_NOTE_ON | channel, note, velocity, 3);
+}
+
+static inline int midi1_tx_note_off(uint32_t tick, uint8_t channel, uint8_t note,
+				    uint8_t velocity)
+{
+	return midi1_tx_sched_put(tick, MIDI1_EVENT_NOTE_OFF | channel, note, velocity, 3);
+}
+
+static inline int midi1_tx_control_change(uint32_t tick, uint8_t channel, uint8_t controller,
+					  uint8_t value)
+{
+	return midi1_tx_sched_put(tick, MIDI1_EVENT_CONTROL_CHANGE | channel, controller, value, 3);
+}
+
+/**
+ * @brief Send a real-time byte (0xF8 --> 0xFF) now, thread or ISR.
+ *
+ * @return 0 or -EINVAL for a byte that is not real-time
+ */
+int midi1_tx_sched_realtime(uint8_t rt);
+
+/**
+ * @brief One 24pqn pulse, call from the clock callback (ISR).
+ *
+ * The clock driver sends its timing clock at the same moment, this is
+ * where the overlap with our channel bytes is estimated.
+ */
+void midi1_tx_sched_tick(void);
+
+void midi1_tx_sched_get_stats(struct midi1_tx_sched_stats *stats);
+void midi1_tx_sched_reset_stats(void);
+
+#endif /* MIDI1_TX_SCHED_H */
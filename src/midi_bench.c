@@ -0,0 +1,162 @@
+/**
+ * @file midi_bench.c
+ * @brief Whole pipeline benchmark report.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260401
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/shell/shell.h>
+
+#include "clock_jitter.h"
+#include "hr_latency.h"
+#include "midi_bench.h"
+#include "model.h"
+
+/* Execution cycles of every thread at the previous report */
+struct bench_thread {
+	k_tid_t tid;
+	uint64_t cycles;
+	uint64_t delta;
+	size_t stack_size;
+	size_t stack_used;
+};
+
+/* The bench thread and the shell both report, one at a time */
+K_MUTEX_DEFINE(bench_lock);
+static struct bench_thread threads[MIDI_BENCH_MAX_THREADS];
+static int num_threads;
+static uint64_t total_cycles;
+
+static struct bench_thread *thread_slot(k_tid_t tid)
+{
+	for (int i = 0; i < num_threads; i++) {
+		if (threads[i].tid == tid) {
+			return &threads[i];
+		}
+	}
+	if (num_threads == MIDI_BENCH_MAX_THREADS) {
+		return NULL;
+	}
+	threads[num_threads] = (struct bench_thread){.tid = tid};
+	return &threads[num_threads++];
+}
+
+/* Only collects, the printing is done after the walk */
+static void thread_sample(const struct k_thread *thread, void *user_data)
+{
+	struct bench_thread *t = thread_slot((k_tid_t)thread);
+	k_thread_runtime_stats_t rt;
+	size_t unused = 0;
+
+	if (!t) {
+		return;
+	}
+	if (k_thread_runtime_stats_get((k_tid_t)thread, &rt) == 0) {
+		t->delta = rt.execution_cycles - t->cycles;
+		t->cycles = rt.execution_cycles;
+	}
+	t->stack_size = thread->stack_info.size;
+	if (k_thread_stack_space_get(thread, &unused) == 0) {
+		t->stack_used = t->stack_size - unused;
+	}
+}
+
+/* Cycles of all threads since the previous sample, the lock has to be held */
+static uint64_t bench_sample(void)
+{
+	k_thread_runtime_stats_t all;
+	uint64_t total_delta = 0;
+
+	if (k_thread_runtime_stats_all_get(&all) == 0) {
+		total_delta = all.execution_cycles - total_cycles;
+		total_cycles = all.execution_cycles;
+	}
+	k_thread_foreach_unlocked(thread_sample, NULL);
+	return total_delta;
+}
+
+static uint32_t ticks_to_us(uint32_t ticks, uint32_t freq)
+{
+	return freq ? (uint32_t)(((uint64_t)ticks * 1000000U) / freq) : 0U;
+}
+
+void midi_bench_report(uint32_t seq)
+{
+	struct hr_latency_report lat;
+	struct clock_jitter_report jit;
+	human_bpm_model_t mod;
+	uint64_t total_delta;
+
+	k_mutex_lock(&bench_lock, K_FOREVER);
+	model_get(&mod);
+	printk("BENCH seq=%u t_ms=%u hr_sbpm=%u target_sbpm=%u gen_sbpm=%u pll_sbpm=%u\n", seq,
+	       k_uptime_get_32(), mod.hr_sbpm, mod.target_sbpm, mod.gen_sbpm, mod.pll_sbpm);
+
+	hr_latency_get(HR_LATENCY_TARGET, &lat);
+	printk("BENCH seq=%u latency=target count=%u mean_us=%u min_us=%u max_us=%u\n", seq,
+	       lat.count, lat.mean_us, lat.min_us, lat.max_us);
+	hr_latency_get(HR_LATENCY_TOTAL, &lat);
+	printk("BENCH seq=%u latency=total count=%u mean_us=%u min_us=%u max_us=%u\n", seq,
+	       lat.count, lat.mean_us, lat.min_us, lat.max_us);
+
+	clock_jitter_get(CLOCK_JITTER_GEN, &jit);
+	printk("BENCH seq=%u jitter=gen count=%u rms_us=%u p2p_us=%u drift_ppm=%d\n", seq,
+	       jit.count, ticks_to_us(jit.rms, jit.clock_freq), ticks_to_us(jit.p2p, jit.clock_freq),
+	       jit.drift_ppm);
+	clock_jitter_get(CLOCK_JITTER_RX, &jit);
+	printk("BENCH seq=%u jitter=rx count=%u rms_us=%u p2p_us=%u\n", seq, jit.count,
+	       ticks_to_us(jit.rms, jit.clock_freq), ticks_to_us(jit.p2p, jit.clock_freq));
+
+	total_delta = bench_sample();
+	for (int i = 0; i < num_threads; i++) {
+		struct bench_thread *t = &threads[i];
+		const char *name = k_thread_name_get(t->tid);
+		/* Per mille of the cycles all threads used in this interval */
+		uint32_t cpu = total_delta ? (uint32_t)((t->delta * 1000U) / total_delta) : 0U;
+
+		printk("BENCH seq=%u thread=%s cpu_pm=%u stack_used=%u stack_size=%u\n", seq,
+		       name ? name : "?", cpu, (uint32_t)t->stack_used, (uint32_t)t->stack_size);
+	}
+
+	hr_latency_reset();
+	clock_jitter_reset();
+	k_mutex_unlock(&bench_lock);
+}
+
+/* ---------------------------- THREADS ------------------------------------ */
+
+static void midi_bench_thread(void)
+{
+	uint32_t seq = 0;
+
+	/* The first report covers one period, not the CPU time since boot */
+	k_mutex_lock(&bench_lock, K_FOREVER);
+	(void)bench_sample();
+	k_mutex_unlock(&bench_lock);
+
+	while (1) {
+		k_sleep(K_SECONDS(MIDI_BENCH_PERIOD_S));
+		midi_bench_report(seq++);
+	}
+}
+
+/* Below everything it measures */
+K_THREAD_DEFINE(midi_bench_tid, 1024, midi_bench_thread, NULL, NULL, NULL, 12, 0, 0);
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_bench(const struct shell *sh, size_t argc, char **argv)
+{
+	/* Starts a new interval, the periodic report counts from here */
+	midi_bench_report(UINT32_MAX);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), bench, NULL, "Pipeline benchmark report now", cmd_midi_bench, 1, 0);
+#endif
+
+/* EOF */
@@ -0,0 +1,30 @@
+/**
+ * @file midi_bench.h
+ * @brief Whole pipeline benchmark report.
+ *
+ * Every MIDI_BENCH_PERIOD_S the heart rate notification to tempo
+ * latency, the jitter of the generated clock and per thread CPU share
+ * and stack high-water mark are printed as "BENCH" lines, then the
+ * latency and jitter statistics start over.  The lines are meant for a
+ * script, one key=value set per line, see tests/bsim/pipeline.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260401
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI_BENCH_H
+#define MIDI_BENCH_H
+#include <stdint.h>
+
+#define MIDI_BENCH_PERIOD_S CONFIG_MIDI_BENCH_PERIOD_S
+/* Threads followed for the CPU share */
+#define MIDI_BENCH_MAX_THREADS 24
+
+/**
+ * @brief Print a report now and start a new interval.
+ *
+ * @param seq interval number printed with every line
+ */
+void midi_bench_report(uint32_t seq);
+
+#endif /* MIDI_BENCH_H */
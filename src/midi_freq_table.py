@@ -9,12 +9,15 @@
 Generate a C array of precomputed frequencies for MIDI notes 0..127 (C-1 .. G9).
 Usage:
     python3 gen_midi_table.py --a4 440.0 > midi_freq_table.c
+    python3 gen_midi_table.py --names sharp --out midi_note_names_sharp.inc
 Options:
     --a4 FLOAT    Set concert pitch A4 in Hz (default 440.0)
+    --names KIND  Generate the note names with octave instead, "sharp" or "flat"
+    --log2        Generate the Q24 log2(1 + i/256) table used by freqToNoteCents()
     --out FILE    Write output to FILE instead of stdout
 """
 import argparse
-from math import pow
+from math import pow, log2
 
 NOTE_NAMES = ["C", "C#", "D", "D#", "E", "F", "F#", "G", "G#", "A", "A#", "B"]
 FLAT_EQUIV = {"C#": "Db", "D#": "Eb", "F#": "Gb", "G#": "Ab", "A#": "Bb"}
@@ -27,6 +30,17 @@ def midi_note_name(n):
         return f"{name}{octave}/{FLAT_EQUIV[name]}{octave}"
     return f"{name}{octave}"
 
+# As noteToText() + noteToOct() in note.c: two characters then the octave,
+# note 60 is "C 3"
+DISPLAY_SHARPS = ["C ", "C#", "D ", "D#", "E ", "F ", "F#", "G ", "G#", "A ", "A#", "B "]
+DISPLAY_FLATS = ["C ", "Db", "D ", "Eb", "E ", "F ", "Gb", "G ", "Ab", "A ", "Bb", "B "]
+DISPLAY_OCTAVE_OFFSET = -2
+NAME_LEN = 5
+
+def display_note_name(n, flats):
+    names = DISPLAY_FLATS if flats else DISPLAY_SHARPS
+    return f"{names[n % 12]}{(n // 12) + DISPLAY_OCTAVE_OFFSET}"
+
 def midi_freq(n, a4_freq):
     # f = A4 * 2^((n - 69) / 12)
     return a4_freq * pow(2.0, (n - A4_MIDI) / 12.0)
@@ -43,15 +57,47 @@ def generate_c_table(a4_freq):
     #lines.append("};")
     return "\n".join(lines)
 
+def generate_c_names(flats):
+    kind = "flat" if flats else "sharp"
+    lines = []
+    lines.append(f"/* Generated by midi_freq_table.py, {kind} note names for MIDI notes 0–127 */")
+    for i in range(128):
+        name = display_note_name(i, flats)
+        # Room for the terminating null in char [NAME_LEN]
+        assert len(name) < NAME_LEN
+        lines.append(f"    \"{name}\",   /* {i}: {midi_note_name(i)} */")
+    return "\n".join(lines)
+
+LOG2_TABLE_BITS = 8
+LOG2_Q = 24
+
+def generate_c_log2():
+    size = 1 << LOG2_TABLE_BITS
+    lines = []
+    lines.append(f"/* Generated by midi_freq_table.py, Q{LOG2_Q} log2(1 + i/{size}) for i = 0..{size} */")
+    for i in range(size + 1):
+        v = round(log2(1.0 + i / size) * (1 << LOG2_Q))
+        lines.append(f"    {v}U,   /* {i} */")
+    return "\n".join(lines)
+
 def main():
     p = argparse.ArgumentParser(description="Generate C table of MIDI frequencies")
     p.add_argument("--a4", type=float, default=440.0,
                    help="Concert pitch frequency for A4 in Hz (default 440.0)")
+    p.add_argument("--names", choices=["sharp", "flat"], default=None,
+                   help="Generate note names with octave instead of frequencies")
+    p.add_argument("--log2", action="store_true",
+                   help="Generate the fixed point log2 table instead of frequencies")
     p.add_argument("--out", type=str, default=None,
                    help="Write output to file instead of stdout")
     args = p.parse_args()
 
-    c_text = generate_c_table(args.a4)
+    if args.log2:
+        c_text = generate_c_log2()
+    elif args.names:
+        c_text = generate_c_names(args.names == "flat")
+    else:
+        c_text = generate_c_table(args.a4)
     if args.out:
         with open(args.out, "w", encoding="utf-8") as f:
             f.write(c_text + "\n")
@@ -0,0 +1,39 @@
+/**
+ * @file midi_note_names.h
+ * Note names with octave for MIDI notes 0–127 as shown in the MIDI log
+ * e.g. "C 3" for note 60, and a log2 table for the fixed point pitch
+ * conversion.  The tables are generated at build time by
+ * midi_freq_table.py (see CMakeLists.txt) and live in flash.
+ * used by "note.h  / note.c" for the noteToTextWithOctave() function
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI_NOTE_NAMES_H
+#define MIDI_NOTE_NAMES_H
+
+#include <stdint.h>
+
+/* Longest name is "C#-2" plus the terminating null */
+#define MIDI_NOTE_NAME_LEN 5
+
+static const char midi_note_names_sharp[128][MIDI_NOTE_NAME_LEN] = {
+#include "midi_note_names_sharp.inc"
+};
+
+static const char midi_note_names_flat[128][MIDI_NOTE_NAME_LEN] = {
+#include "midi_note_names_flat.inc"
+};
+
+/*
+ * Q24 log2(1 + i / 256) for i = 0 --> 256, used by the fixed point
+ * freqToNoteCents() and freqToPitch725()
+ */
+#define MIDI_LOG2_TABLE_BITS 8
+#define MIDI_LOG2_Q          24
+
+static const uint32_t midi_log2_table[(1 << MIDI_LOG2_TABLE_BITS) + 1] = {
+#include "midi_log2_table.inc"
+};
+
+#endif /* MIDI_NOTE_NAMES_H */
@@ -0,0 +1,112 @@
+/**
+ * @file midi_probe.c
+ * @brief Hot path latency probes, cycle counter based.
+ *
+ * Only built with CONFIG_MIDI_PROBE, see CMakeLists.txt.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260314
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/timing/timing.h>
+
+#include "midi_probe.h"
+
+static struct midi_probe_stats probes[MIDI_PROBE_COUNT];
+
+static const char *const probe_names[MIDI_PROBE_COUNT] = {
+	[MIDI_PROBE_CLOCK_CB] = "clock_cb",
+	[MIDI_PROBE_REALTIME] = "realtime",
+	[MIDI_PROBE_PLL_SERIAL] = "pll_serial",
+	[MIDI_PROBE_PLL_USB] = "pll_usb",
+	[MIDI_PROBE_PLL_HR] = "pll_hr",
+	[MIDI_PROBE_RX_LOOP] = "rx_loop",
+	[MIDI_PROBE_LVGL_FRAME] = "lvgl_frame",
+};
+
+void midi_probe_record(enum midi_probe_id id, timing_t start, timing_t end)
+{
+	struct midi_probe_stats *p = &probes[id];
+	uint32_t cycles = (uint32_t)MIN(timing_cycles_get(&start, &end), UINT32_MAX);
+
+	if (p->count == 0 || cycles < p->min) {
+		p->min = cycles;
+	}
+	if (cycles > p->max) {
+		p->max = cycles;
+	}
+	p->sum += cycles;
+	p->count++;
+	/* Bucket n holds 2^n --> 2^(n+1) - 1 cycles */
+	p->hist[31 - __builtin_clz(cycles | 1U)]++;
+}
+
+void midi_probe_get(enum midi_probe_id id, struct midi_probe_stats *out)
+{
+	*out = probes[id];
+}
+
+void midi_probe_reset(void)
+{
+	/* The writers may record while this runs, it is diagnostics only */
+	memset(probes, 0, sizeof(probes));
+}
+
+const char *midi_probe_name(enum midi_probe_id id)
+{
+	return id < MIDI_PROBE_COUNT ? probe_names[id] : "?";
+}
+
+/* Before the application threads start */
+static int midi_probe_init(void)
+{
+	timing_init();
+	timing_start();
+	return 0;
+}
+
+SYS_INIT(midi_probe_init, APPLICATION, 0);
+
+/* ---------------------------- SHELL -------------------------------------- */
+
+static uint32_t cycles_to_ns(uint64_t cycles)
+{
+	return (uint32_t)MIN(timing_cycles_to_ns(cycles), UINT32_MAX);
+}
+
+static int cmd_midi_stats(const struct shell *sh, size_t argc, char **argv)
+{
+	struct midi_probe_stats p;
+
+	if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+		midi_probe_reset();
+		shell_print(sh, "probes reset");
+		return 0;
+	}
+
+	shell_print(sh, "%-10s %8s %9s %9s %9s  (ns)", "probe", "count", "min", "mean", "max");
+	for (int i = 0; i < MIDI_PROBE_COUNT; i++) {
+		midi_probe_get(i, &p);
+		if (p.count == 0) {
+			shell_print(sh, "%-10s %8u", midi_probe_name(i), 0);
+			continue;
+		}
+		shell_print(sh, "%-10s %8u %9u %9u %9u", midi_probe_name(i), p.count,
+			    cycles_to_ns(p.min), cycles_to_ns(p.sum / p.count), cycles_to_ns(p.max));
+		for (int b = 0; b < MIDI_PROBE_HIST_BUCKETS; b++) {
+			if (p.hist[b]) {
+				shell_print(sh, "    >= %9u ns: %u", cycles_to_ns(1ULL << b),
+					    p.hist[b]);
+			}
+		}
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), stats, NULL, "Hot path latency probes [reset]", cmd_midi_stats, 1, 1);
+
+/* EOF */
@@ -0,0 +1,76 @@
+/**
+ * @file midi_probe.h
+ * @brief Hot path latency probes, cycle counter based.
+ *
+ * MIDI_PROBE_BEGIN()/MIDI_PROBE_END() around a piece of code record its
+ * duration in cycles of the timing API (the DWT cycle counter on the
+ * Cortex-M targets) with min/max/mean and a log2 histogram per probe.
+ * The results are shown and reset with the 'midi stats' shell command.
+ * Without CONFIG_MIDI_PROBE the macros compile away completely.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260314
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI_PROBE_H
+#define MIDI_PROBE_H
+#include <stdint.h>
+
+enum midi_probe_id {
+	/* midi1_clock_cntr_callback() */
+	MIDI_PROBE_CLOCK_CB = 0,
+	/* realtime_handler() */
+	MIDI_PROBE_REALTIME,
+	/*
+	 * midi1_pll_process_interval(), one per clock source in the order
+	 * of enum clock_source_id as each runs under its own lock
+	 */
+	MIDI_PROBE_PLL_SERIAL,
+	MIDI_PROBE_PLL_USB,
+	MIDI_PROBE_PLL_HR,
+	/* Receive thread loop, after receiveparser() returned */
+	MIDI_PROBE_RX_LOOP,
+	/* lv_timer_handler(), the LVGL frame */
+	MIDI_PROBE_LVGL_FRAME,
+	MIDI_PROBE_COUNT
+};
+
+/* One bucket per power of two cycles */
+#define MIDI_PROBE_HIST_BUCKETS 32
+
+#ifdef CONFIG_MIDI_PROBE
+#include <zephyr/timing/timing.h>
+
+/*
+ * A probe has one writer (the thread or ISR the code runs in), the shell
+ * only reads and resets, a torn read there is acceptable.
+ */
+struct midi_probe_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[MIDI_PROBE_HIST_BUCKETS];
+};
+
+#define MIDI_PROBE_BEGIN(_id) timing_t _midi_probe_##_id = timing_counter_get()
+#define MIDI_PROBE_END(_id)                                                                         \
+	midi_probe_record(MIDI_PROBE_##_id, _midi_probe_##_id, timing_counter_get())
+/* End of MIDI_PROBE_BEGIN(_id) recorded into a probe picked at run time */
+#define MIDI_PROBE_END_TO(_id, _probe)                                                              \
+	midi_probe_record(_probe, _midi_probe_##_id, timing_counter_get())
+
+void midi_probe_record(enum midi_probe_id id, timing_t start, timing_t end);
+void midi_probe_get(enum midi_probe_id id, struct midi_probe_stats *out);
+void midi_probe_reset(void);
+const char *midi_probe_name(enum midi_probe_id id);
+
+#else
+
+#define MIDI_PROBE_BEGIN(_id) do { } while (0)
+#define MIDI_PROBE_END(_id)   do { } while (0)
+#define MIDI_PROBE_END_TO(_id, _probe) do { } while (0)
+
+#endif /* CONFIG_MIDI_PROBE */
+
+#endif /* MIDI_PROBE_H */
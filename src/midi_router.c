@@ -0,0 +1,325 @@
+/**
+ * @file midi_router.c
+ * @brief Pass-through between the DIN (serial MIDI 1.0) port and USB.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260326
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+
+#include "midi1_tx_sched.h"
+#include "midi_router.h"
+#include "usb_midi_tx.h"
+
+struct route {
+	/* Read in the callbacks without a lock */
+	atomic_t enabled;
+	atomic_t channels;
+	atomic_t types;
+	struct midi_route_stats stats;
+};
+
+static struct k_spinlock route_lock;
+static struct route routes[MIDI_ROUTE_COUNT] = {
+	[MIDI_ROUTE_DIN_TO_USB] = {
+		.enabled = ATOMIC_INIT(IS_ENABLED(CONFIG_MIDI_ROUTER_DIN_TO_USB)),
+		.channels = ATOMIC_INIT(MIDI_ROUTE_CHANNELS_ALL),
+		.types = ATOMIC_INIT(MIDI_ROUTE_TYPES_ALL),
+	},
+	[MIDI_ROUTE_USB_TO_DIN] = {
+		.enabled = ATOMIC_INIT(IS_ENABLED(CONFIG_MIDI_ROUTER_USB_TO_DIN)),
+		.channels = ATOMIC_INIT(MIDI_ROUTE_CHANNELS_ALL),
+		.types = ATOMIC_INIT(MIDI_ROUTE_TYPES_ALL),
+	},
+};
+
+/* Program change and channel pressure have one data byte */
+static uint8_t msg_len(uint8_t status)
+{
+	return (status & 0xF0) == 0xC0 || (status & 0xF0) == 0xD0 ? 2 : 3;
+}
+
+static bool route_passes(struct route *r, uint8_t status, uint8_t channel)
+{
+	return atomic_get(&r->enabled) && (atomic_get(&r->channels) & BIT(channel)) &&
+	       (atomic_get(&r->types) & MIDI_ROUTE_TYPE(status));
+}
+
+static void route_filtered(struct route *r)
+{
+	k_spinlock_key_t key = k_spin_lock(&route_lock);
+
+	r->stats.filtered++;
+	k_spin_unlock(&route_lock, key);
+}
+
+/* The message was handed to the TX path (or not) 'start' cycles ago */
+static void route_done(struct route *r, uint32_t start, uint8_t len, int err)
+{
+	uint32_t us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+	k_spinlock_key_t key = k_spin_lock(&route_lock);
+
+	if (err) {
+		r->stats.dropped++;
+	} else {
+		r->stats.passed++;
+		r->stats.bytes += len;
+	}
+	r->stats.last_us = us;
+	r->stats.max_us = MAX(r->stats.max_us, us);
+	r->stats.total_us += us;
+	k_spin_unlock(&route_lock, key);
+}
+
+void midi_router_din(uint8_t status, uint8_t channel, uint8_t data1, uint8_t data2)
+{
+	struct route *r = &routes[MIDI_ROUTE_DIN_TO_USB];
+	uint32_t start = k_cycle_get_32();
+	int err;
+
+	channel &= 0x0F;
+	if (!route_passes(r, status, channel)) {
+		route_filtered(r);
+		return;
+	}
+
+	err = usb_midi_tx_send(UMP_MIDI1_CHANNEL_VOICE(usb_midi_tx_get_group(0), status >> 4,
+						       channel, data1, data2));
+	route_done(r, start, msg_len(status), err);
+}
+
+bool midi_router_usb(const struct midi_ump ump)
+{
+	struct route *r = &routes[MIDI_ROUTE_USB_TO_DIN];
+	uint32_t start = k_cycle_get_32();
+	uint8_t status;
+	uint8_t len;
+	int err;
+
+	if (UMP_MT(ump) != UMP_MT_MIDI1_CHANNEL_VOICE ||
+	    UMP_GROUP(ump) != usb_midi_tx_get_group(0)) {
+		k_spinlock_key_t key = k_spin_lock(&route_lock);
+
+		r->stats.unsupported++;
+		k_spin_unlock(&route_lock, key);
+		return false;
+	}
+
+	status = (UMP_MIDI_COMMAND(ump) << 4) | UMP_MIDI_CHANNEL(ump);
+	if (!route_passes(r, status, UMP_MIDI_CHANNEL(ump))) {
+		route_filtered(r);
+		return true;
+	}
+
+	len = msg_len(status);
+	err = midi1_tx_sched_send(status, UMP_MIDI1_P1(ump), UMP_MIDI1_P2(ump), len);
+	route_done(r, start, len, err);
+	return true;
+}
+
+void midi_router_set_enabled(enum midi_route route, bool enabled)
+{
+	if (route < MIDI_ROUTE_COUNT) {
+		atomic_set(&routes[route].enabled, enabled ? 1 : 0);
+	}
+}
+
+bool midi_router_get_enabled(enum midi_route route)
+{
+	return route < MIDI_ROUTE_COUNT && atomic_get(&routes[route].enabled);
+}
+
+void midi_router_set_channels(enum midi_route route, uint16_t channels)
+{
+	if (route < MIDI_ROUTE_COUNT) {
+		atomic_set(&routes[route].channels, channels);
+	}
+}
+
+uint16_t midi_router_get_channels(enum midi_route route)
+{
+	return route < MIDI_ROUTE_COUNT ? (uint16_t)atomic_get(&routes[route].channels) : 0;
+}
+
+void midi_router_set_types(enum midi_route route, uint8_t types)
+{
+	if (route < MIDI_ROUTE_COUNT) {
+		atomic_set(&routes[route].types, types & MIDI_ROUTE_TYPES_ALL);
+	}
+}
+
+uint8_t midi_router_get_types(enum midi_route route)
+{
+	return route < MIDI_ROUTE_COUNT ? (uint8_t)atomic_get(&routes[route].types) : 0;
+}
+
+void midi_router_get_stats(enum midi_route route, struct midi_route_stats *stats)
+{
+	k_spinlock_key_t key;
+
+	if (route >= MIDI_ROUTE_COUNT) {
+		return;
+	}
+	key = k_spin_lock(&route_lock);
+	*stats = routes[route].stats;
+	k_spin_unlock(&route_lock, key);
+}
+
+void midi_router_reset_stats(void)
+{
+	int64_t now = k_uptime_get();
+	k_spinlock_key_t key = k_spin_lock(&route_lock);
+
+	for (int i = 0; i < MIDI_ROUTE_COUNT; i++) {
+		(void)memset(&routes[i].stats, 0, sizeof(routes[i].stats));
+		routes[i].stats.since_ms = now;
+	}
+	k_spin_unlock(&route_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static const char *const route_names[MIDI_ROUTE_COUNT] = {"din", "usb"};
+
+static const struct {
+	const char *name;
+	uint8_t types;
+} type_names[] = {
+	{"note", MIDI_ROUTE_TYPE(0x80) | MIDI_ROUTE_TYPE(0x90)},
+	{"poly", MIDI_ROUTE_TYPE(0xA0)},
+	{"cc", MIDI_ROUTE_TYPE(0xB0)},
+	{"program", MIDI_ROUTE_TYPE(0xC0)},
+	{"pressure", MIDI_ROUTE_TYPE(0xD0)},
+	{"pitch", MIDI_ROUTE_TYPE(0xE0)},
+};
+
+static void route_print(const struct shell *sh, enum midi_route route)
+{
+	struct midi_route_stats s;
+	int64_t ms;
+
+	midi_router_get_stats(route, &s);
+	ms = k_uptime_get() - s.since_ms;
+	shell_print(sh, "%s: %s, channels 0x%04x, types 0x%02x",
+		    route == MIDI_ROUTE_DIN_TO_USB ? "DIN -> USB" : "USB -> DIN",
+		    midi_router_get_enabled(route) ? "on" : "off", midi_router_get_channels(route),
+		    midi_router_get_types(route));
+	shell_print(sh, "  passed %u (%u bytes, %u/s), filtered %u, unsupported %u, dropped %u",
+		    s.passed, s.bytes, ms > 0 ? (uint32_t)((s.passed * 1000LL) / ms) : 0U,
+		    s.filtered, s.unsupported, s.dropped);
+	shell_print(sh, "  latency last %u us, mean %u us, max %u us", s.last_us,
+		    (s.passed + s.dropped) ? (uint32_t)(s.total_us / (s.passed + s.dropped)) : 0U,
+		    s.max_us);
+}
+
+/* "1,2,10" or "all" */
+static int parse_channels(const char *arg, uint16_t *channels)
+{
+	char *end;
+
+	if (strcmp(arg, "all") == 0) {
+		*channels = MIDI_ROUTE_CHANNELS_ALL;
+		return 0;
+	}
+	*channels = 0;
+	do {
+		long ch = strtol(arg, &end, 10);
+
+		if (end == arg || ch < 1 || ch > 16 || (*end != ',' && *end != '\0')) {
+			return -EINVAL;
+		}
+		*channels |= BIT(ch - 1);
+		arg = end + 1;
+	} while (*end == ',');
+	return 0;
+}
+
+/* "note,cc" or "all" */
+static int parse_types(const char *arg, uint8_t *types)
+{
+	if (strcmp(arg, "all") == 0) {
+		*types = MIDI_ROUTE_TYPES_ALL;
+		return 0;
+	}
+	*types = 0;
+	while (*arg) {
+		size_t n = strcspn(arg, ",");
+		size_t i;
+
+		for (i = 0; i < ARRAY_SIZE(type_names); i++) {
+			if (strlen(type_names[i].name) == n &&
+			    strncmp(arg, type_names[i].name, n) == 0) {
+				*types |= type_names[i].types;
+				break;
+			}
+		}
+		if (i == ARRAY_SIZE(type_names)) {
+			return -EINVAL;
+		}
+		arg += n;
+		arg += *arg == ',' ? 1 : 0;
+	}
+	return *types ? 0 : -EINVAL;
+}
+
+static int cmd_midi_route(const struct shell *sh, size_t argc, char **argv)
+{
+	enum midi_route route = MIDI_ROUTE_COUNT;
+	uint16_t channels;
+	uint8_t types;
+
+	if (argc == 1) {
+		for (int i = 0; i < MIDI_ROUTE_COUNT; i++) {
+			route_print(sh, i);
+		}
+		return 0;
+	}
+	if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+		midi_router_reset_stats();
+		shell_print(sh, "route stats reset");
+		return 0;
+	}
+	for (int i = 0; i < MIDI_ROUTE_COUNT; i++) {
+		if (strcmp(argv[1], route_names[i]) == 0) {
+			route = i;
+		}
+	}
+	if (route == MIDI_ROUTE_COUNT || argc < 3) {
+		shell_error(sh, "use [reset] or <din|usb> <on|off|ch <list|all>|type <list|all>>");
+		return -EINVAL;
+	}
+
+	if (strcmp(argv[2], "on") == 0 || strcmp(argv[2], "off") == 0) {
+		midi_router_set_enabled(route, strcmp(argv[2], "on") == 0);
+	} else if (strcmp(argv[2], "ch") == 0 && argc == 4) {
+		if (parse_channels(argv[3], &channels)) {
+			shell_error(sh, "channels are 1 --> 16, e.g. 1,2,10");
+			return -EINVAL;
+		}
+		midi_router_set_channels(route, channels);
+	} else if (strcmp(argv[2], "type") == 0 && argc == 4) {
+		if (parse_types(argv[3], &types)) {
+			shell_error(sh, "types are note, poly, cc, program, pressure and pitch");
+			return -EINVAL;
+		}
+		midi_router_set_types(route, types);
+	} else {
+		shell_error(sh, "use on, off, ch <list|all> or type <list|all>");
+		return -EINVAL;
+	}
+	route_print(sh, route);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), route, NULL,
+		 "DIN <-> USB routing [reset | <din|usb> <on|off|ch <list>|type <list>>]",
+		 cmd_midi_route, 1, 3);
+#endif
+
+/* EOF */
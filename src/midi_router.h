@@ -0,0 +1,86 @@
+/**
+ * @file midi_router.h
+ * @brief Pass-through between the DIN (serial MIDI 1.0) port and USB.
+ *
+ * A parsed DIN message becomes a UMP MIDI 1.0 Channel Voice packet on
+ * the first function block, a MIDI 1.0 Channel Voice packet from the
+ * host becomes serial MIDI.  The conversion is done in the callback
+ * that received the message, bit shuffling only, no formatting, and
+ * the result goes straight to the TX path of the other side.
+ *
+ * Every route has a channel and a message type filter and counts what
+ * it passed and how long the conversion took.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260326
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI_ROUTER_H
+#define MIDI_ROUTER_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/audio/midi.h>
+#include <zephyr/sys/util.h>
+
+enum midi_route {
+	MIDI_ROUTE_DIN_TO_USB = 0,
+	MIDI_ROUTE_USB_TO_DIN,
+	MIDI_ROUTE_COUNT
+};
+
+/* Message type filter, one bit per channel voice status 0x8n --> 0xEn */
+#define MIDI_ROUTE_TYPE(status) BIT((((status) >> 4) & 0x07))
+#define MIDI_ROUTE_TYPES_ALL    0x7FU
+#define MIDI_ROUTE_CHANNELS_ALL 0xFFFFU
+
+struct midi_route_stats {
+	uint32_t passed;
+	uint32_t bytes;
+	/* Left out by the channel or type filter, or the route is off */
+	uint32_t filtered;
+	/* Not a MIDI 1.0 channel voice message */
+	uint32_t unsupported;
+	/* The TX path of the other side was full */
+	uint32_t dropped;
+	/* From the callback to the TX path of the other side */
+	uint32_t last_us;
+	uint32_t max_us;
+	uint64_t total_us;
+	/* k_uptime_get() of the last reset */
+	int64_t since_ms;
+};
+
+/**
+ * @brief A parsed DIN message, call from the serial parser callbacks.
+ *
+ * @param status channel voice status without the channel
+ * @param channel 0 --> 15
+ */
+void midi_router_din(uint8_t status, uint8_t channel, uint8_t data1, uint8_t data2);
+
+/**
+ * @brief A packet from the USB host, call from the usbd_midi rx callback.
+ *
+ * @return true when it was a channel voice message for the router
+ */
+bool midi_router_usb(const struct midi_ump ump);
+
+void midi_router_set_enabled(enum midi_route route, bool enabled);
+bool midi_router_get_enabled(enum midi_route route);
+
+/**
+ * @brief Channels that pass, bit 0 is channel 1.
+ */
+void midi_router_set_channels(enum midi_route route, uint16_t channels);
+uint16_t midi_router_get_channels(enum midi_route route);
+
+/**
+ * @brief Message types that pass, see MIDI_ROUTE_TYPE().
+ */
+void midi_router_set_types(enum midi_route route, uint8_t types);
+uint8_t midi_router_get_types(enum midi_route route);
+
+void midi_router_get_stats(enum midi_route route, struct midi_route_stats *stats);
+void midi_router_reset_stats(void);
+
+#endif /* MIDI_ROUTER_H */
@@ -0,0 +1,15 @@
+/**
+ * @file midi_shell.c
+ * @brief The 'midi' shell command, the modules add their subcommands to
+ * it with SHELL_SUBCMD_ADD((midi), ...).
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260314
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/shell/shell.h>
+
+SHELL_SUBCMD_SET_CREATE(midi_cmds, (midi));
+SHELL_CMD_REGISTER(midi, &midi_cmds, "MIDI human clock commands", NULL);
+
+/* EOF */
@@ -1,6 +1,12 @@
 /**
  * @brief MIDI 1.0 application "MODEL"
  *
+ * The model is split in slots, one per writer.  Each slot is published
+ * with a sequence counter and two copies (a "latch"): the writer updates
+ * the copy that readers are not using, so the writer is wait-free and a
+ * reader only has to retry when a write happened during its copy.  A
+ * reader that preempts a writer half way still finds a complete copy.
+ *
  * @author Jan-Willem Smaal <usenet@gispen.org>
  * @date 20260107
  *
@@ -8,70 +14,218 @@
  */
 #include <zephyr/types.h>
 #include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
 #include "model.h"
 
-// static struct human_bpm_model g_model;
-static human_bpm_model_t g_model;
-static struct k_mutex g_model_lock;
+enum model_owner {
+	MODEL_OWNER_MAIN = 0,
+	MODEL_OWNER_RX,
+	MODEL_OWNER_CLOCK,
+	MODEL_OWNER_COUNT
+};
+
+struct model_snapshot {
+	human_bpm_model_t data;
+	uint16_t version[MODEL_FIELD_COUNT];
+};
+
+struct model_slot {
+	atomic_t seq;
+	/* A field changed since the previous publish, owner only */
+	bool dirty;
+	/* Only touched by the owner of the slot */
+	struct model_snapshot shadow;
+	/* Readers use copy[seq & 1] */
+	struct model_snapshot copy[2];
+};
+
+static struct model_slot g_slot[MODEL_OWNER_COUNT];
+
+/* Given on every published change, the GUI blocks on it */
+K_SEM_DEFINE(model_changed_sem, 0, 1);
+
+/* Update a field in the shadow copy and bump its version on a change */
+#define MODEL_UPDATE(_slot, _member, _field, _val)                                                 \
+	do {                                                                                       \
+		if ((_slot)->shadow.data._member != (_val)) {                                      \
+			(_slot)->shadow.data._member = (_val);                                     \
+			(_slot)->shadow.version[_field]++;                                         \
+			(_slot)->dirty = true;                                                     \
+		}                                                                                  \
+	} while (0)
+
+static void slot_publish(struct model_slot *slot)
+{
+	slot->shadow.data.last_update_ms = k_uptime_get_32();
+
+	/* odd: readers move to copy[1] while copy[0] is written */
+	atomic_inc(&slot->seq);
+	slot->copy[0] = slot->shadow;
+	/* even: readers move back to copy[0] while copy[1] is written */
+	atomic_inc(&slot->seq);
+	slot->copy[1] = slot->shadow;
+
+	if (slot->dirty) {
+		slot->dirty = false;
+		model_notify();
+	}
+}
+
+static void slot_read(struct model_slot *slot, struct model_snapshot *out)
+{
+	atomic_val_t seq;
+
+	do {
+		seq = atomic_get(&slot->seq);
+		*out = slot->copy[seq & 1];
+	} while (atomic_get(&slot->seq) != seq);
+}
 
 void model_init(void)
 {
-	k_mutex_init(&g_model_lock);
+	/* Nothing to do, the slots are fine zero initialised */
 }
 
-void model_set(bool hr_connected, uint16_t hr_bpm, uint16_t meas_sbpm, uint16_t pll_sbpm,
-	       uint32_t bpm_led_interval)
+void model_notify(void)
 {
-	k_mutex_lock(&g_model_lock, K_FOREVER);
-	g_model.hr_connected = hr_connected;
+	k_sem_give(&model_changed_sem);
+}
+
+int model_wait(k_timeout_t timeout)
+{
+	return k_sem_take(&model_changed_sem, timeout);
+}
+
+void model_set_hr(bool hr_connected, uint16_t hr_bpm, uint16_t hr_sbpm)
+{
+	struct model_slot *slot = &g_slot[MODEL_OWNER_MAIN];
+
+	MODEL_UPDATE(slot, hr_connected, MODEL_HR_CONNECTED, hr_connected);
 	/* Only change things in the model when they have a value */
 	if (hr_bpm) {
-		g_model.hr_bpm = hr_bpm;
+		MODEL_UPDATE(slot, hr_bpm, MODEL_HR_BPM, hr_bpm);
+	}
+	if (hr_sbpm) {
+		MODEL_UPDATE(slot, hr_sbpm, MODEL_HR_SBPM, hr_sbpm);
 	}
+	slot_publish(slot);
+}
+
+void model_set_clock(uint16_t meas_sbpm, uint16_t pll_sbpm)
+{
+	struct model_slot *slot = &g_slot[MODEL_OWNER_RX];
+
 	if (meas_sbpm) {
-		g_model.meas_sbpm = meas_sbpm;
+		MODEL_UPDATE(slot, meas_sbpm, MODEL_MEAS_SBPM, meas_sbpm);
 	}
 	if (pll_sbpm) {
-		g_model.pll_sbpm = pll_sbpm;
+		MODEL_UPDATE(slot, pll_sbpm, MODEL_PLL_SBPM, pll_sbpm);
 	}
-	if (bpm_led_interval) {
-		g_model.bpm_led_interval = bpm_led_interval;
-	}
-	g_model.last_update_ms = k_uptime_get_32();
-	k_mutex_unlock(&g_model_lock);
+	slot_publish(slot);
 }
 
-void model_get(human_bpm_model_t *out)
+void model_set_target(uint16_t target_sbpm)
 {
-	k_mutex_lock(&g_model_lock, K_FOREVER);
-	*out = g_model;
-	k_mutex_unlock(&g_model_lock);
+	struct model_slot *slot = &g_slot[MODEL_OWNER_MAIN];
+
+	MODEL_UPDATE(slot, target_sbpm, MODEL_TARGET_SBPM, target_sbpm);
+	slot_publish(slot);
 }
 
-human_bpm_model_t model_get2(void)
+void model_set_gen(uint16_t gen_sbpm)
 {
-	struct human_bpm_model ret;
-	k_mutex_lock(&g_model_lock, K_FOREVER);
-	ret = g_model;
-	k_mutex_unlock(&g_model_lock);
-	return ret;
+	struct model_slot *slot = &g_slot[MODEL_OWNER_CLOCK];
+
+	MODEL_UPDATE(slot, gen_sbpm, MODEL_GEN_SBPM, gen_sbpm);
+	slot_publish(slot);
 }
 
-bpm_led_status_t model_get_led_status(void)
+void model_set_hr_latency(uint32_t hr_latency_us)
 {
-	bpm_led_status_t ret = LED_UNDEF;
-	k_mutex_lock(&g_model_lock, K_FOREVER);
-	ret = g_model.bpm_led_status;
-	k_mutex_unlock(&g_model_lock);
-	return ret;
+	struct model_slot *slot = &g_slot[MODEL_OWNER_CLOCK];
+
+	if (hr_latency_us) {
+		MODEL_UPDATE(slot, hr_latency_us, MODEL_HR_LATENCY, hr_latency_us);
+	}
+	slot_publish(slot);
 }
 
 void model_set_led_status(bpm_led_status_t led_stat)
 {
-	k_mutex_lock(&g_model_lock, K_FOREVER);
-	g_model.bpm_led_status = led_stat;
-	k_mutex_unlock(&g_model_lock);
-	return;
+	struct model_slot *slot = &g_slot[MODEL_OWNER_MAIN];
+
+	MODEL_UPDATE(slot, bpm_led_status, MODEL_LED_STATUS, led_stat);
+	slot_publish(slot);
+}
+
+void model_set_led_interval(uint32_t bpm_led_interval)
+{
+	struct model_slot *slot = &g_slot[MODEL_OWNER_MAIN];
+
+	if (bpm_led_interval) {
+		MODEL_UPDATE(slot, bpm_led_interval, MODEL_LED_INTERVAL,
+			     bpm_led_interval);
+	}
+	slot_publish(slot);
+}
+
+uint32_t model_read(human_bpm_model_t *out, struct model_reader *reader)
+{
+	struct model_snapshot main_part;
+	struct model_snapshot rx_part;
+	struct model_snapshot clock_part;
+	uint16_t version[MODEL_FIELD_COUNT];
+	uint32_t changed = 0;
+
+	slot_read(&g_slot[MODEL_OWNER_MAIN], &main_part);
+	slot_read(&g_slot[MODEL_OWNER_RX], &rx_part);
+	slot_read(&g_slot[MODEL_OWNER_CLOCK], &clock_part);
+
+	/* Take every field from the slot of its owner */
+	*out = main_part.data;
+	out->meas_sbpm = rx_part.data.meas_sbpm;
+	out->pll_sbpm = rx_part.data.pll_sbpm;
+	out->gen_sbpm = clock_part.data.gen_sbpm;
+	out->hr_latency_us = clock_part.data.hr_latency_us;
+	out->last_update_ms = MAX(main_part.data.last_update_ms, rx_part.data.last_update_ms);
+	out->last_update_ms = MAX(out->last_update_ms, clock_part.data.last_update_ms);
+
+	version[MODEL_HR_CONNECTED] = main_part.version[MODEL_HR_CONNECTED];
+	version[MODEL_HR_BPM] = main_part.version[MODEL_HR_BPM];
+	version[MODEL_MEAS_SBPM] = rx_part.version[MODEL_MEAS_SBPM];
+	version[MODEL_PLL_SBPM] = rx_part.version[MODEL_PLL_SBPM];
+	version[MODEL_LED_STATUS] = main_part.version[MODEL_LED_STATUS];
+	version[MODEL_LED_INTERVAL] = main_part.version[MODEL_LED_INTERVAL];
+	version[MODEL_TARGET_SBPM] = main_part.version[MODEL_TARGET_SBPM];
+	version[MODEL_GEN_SBPM] = clock_part.version[MODEL_GEN_SBPM];
+	version[MODEL_HR_SBPM] = main_part.version[MODEL_HR_SBPM];
+	version[MODEL_HR_LATENCY] = clock_part.version[MODEL_HR_LATENCY];
+
+	if (reader == NULL) {
+		return MODEL_CHANGED_ALL;
+	}
+
+	for (int i = 0; i < MODEL_FIELD_COUNT; i++) {
+		if (!reader->valid || reader->version[i] != version[i]) {
+			changed |= MODEL_CHANGED(i);
+		}
+		reader->version[i] = version[i];
+	}
+	reader->valid = true;
+	return changed;
+}
+
+void model_get(human_bpm_model_t *out)
+{
+	model_read(out, NULL);
+}
+
+bpm_led_status_t model_get_led_status(void)
+{
+	struct model_snapshot main_part;
+
+	slot_read(&g_slot[MODEL_OWNER_MAIN], &main_part);
+	return main_part.data.bpm_led_status;
 }
 
 /* EOF */
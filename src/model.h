@@ -11,6 +11,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <zephyr/kernel.h>
 
 /*
  * state --> Waiting for BLE HR service, Connected,
@@ -26,19 +27,128 @@ typedef enum bpm_led_status {
 typedef struct human_bpm_model {
 	bool hr_connected;
 	uint16_t hr_bpm;
+	/* Tempo of the heart rate, RR interval based when the sensor sends them */
+	uint16_t hr_sbpm;
 	uint16_t meas_sbpm;
 	uint16_t pll_sbpm;
+	/* Generated clock: where it is heading and where it is now */
+	uint16_t target_sbpm;
+	uint16_t gen_sbpm;
+	/* Heart rate notification to gen_sbpm() of the latest tempo change */
+	uint32_t hr_latency_us;
 	uint32_t last_update_ms;
 	/* 1 = on, 0 = undefined, 2 = off*/
 	bpm_led_status_t bpm_led_status;
 	uint32_t bpm_led_interval;
 } human_bpm_model_t;
 
+/*
+ * Every field has a version number, a reader can find out what changed
+ * since its previous read using the mask returned by model_read().
+ */
+enum model_field {
+	MODEL_HR_CONNECTED = 0,
+	MODEL_HR_BPM,
+	MODEL_MEAS_SBPM,
+	MODEL_PLL_SBPM,
+	MODEL_LED_STATUS,
+	MODEL_LED_INTERVAL,
+	MODEL_TARGET_SBPM,
+	MODEL_GEN_SBPM,
+	MODEL_HR_SBPM,
+	MODEL_HR_LATENCY,
+	MODEL_FIELD_COUNT
+};
+
+#define MODEL_CHANGED(field) (1U << (field))
+#define MODEL_CHANGED_ALL    ((1U << MODEL_FIELD_COUNT) - 1U)
+
+/*
+ * Reader side state, zero initialise it so the first read reports
+ * everything as changed.
+ */
+struct model_reader {
+	uint16_t version[MODEL_FIELD_COUNT];
+	bool valid;
+};
+
+/*
+ * Writer ownership, every field has exactly one writer:
+ *
+ *   main thread (BLE HR)    hr_connected, hr_bpm, hr_sbpm, bpm_led_status,
+ *                           bpm_led_interval, target_sbpm
+ *   MIDI1 receive thread    meas_sbpm, pll_sbpm
+ *   MIDI1 clock callback    gen_sbpm, hr_latency_us
+ *
+ * Each writer publishes into its own double buffered slot so writers never
+ * wait for each other or for a reader, and readers never take a lock.
+ */
 void model_init(void);
-void model_set(bool hr_connected, uint16_t hr_bpm, uint16_t meas_sbpm, uint16_t pll_sbpm,
-	       uint32_t bpm_led_interval);
+
+/**
+ * @brief Update the BLE heart rate part, main thread only.
+ *
+ * @param hr_bpm 0 leaves the previous value in place.
+ * @param hr_sbpm 0 leaves the previous value in place.
+ */
+void model_set_hr(bool hr_connected, uint16_t hr_bpm, uint16_t hr_sbpm);
+
+/**
+ * @brief Update the measured/PLL part, MIDI1 receive thread only.
+ *
+ * @param meas_sbpm 0 leaves the previous value in place.
+ * @param pll_sbpm 0 leaves the previous value in place.
+ */
+void model_set_clock(uint16_t meas_sbpm, uint16_t pll_sbpm);
+
+/**
+ * @brief Target tempo of the generated clock, main thread only.
+ */
+void model_set_target(uint16_t target_sbpm);
+
+/**
+ * @brief Tempo the generated clock runs at, clock callback only (ISR safe).
+ */
+void model_set_gen(uint16_t gen_sbpm);
+
+/**
+ * @brief Measured heart rate to clock latency, clock callback only (ISR safe).
+ *
+ * @param hr_latency_us 0 leaves the previous value in place.
+ */
+void model_set_hr_latency(uint32_t hr_latency_us);
+
+/**
+ * @brief Take a consistent snapshot of the model.
+ *
+ * @param reader per reader state or NULL
+ * @return MODEL_CHANGED() mask of the fields changed since the previous
+ *         read with the same reader.
+ */
+uint32_t model_read(human_bpm_model_t *out, struct model_reader *reader);
+
 void model_get(human_bpm_model_t *out);
+
+/**
+ * @brief Wake up a reader blocked in model_wait(), ISR safe.
+ *
+ * Publishing a changed field does this already, producers of data
+ * outside the model (the MIDI event ring) call it themselves.
+ */
+void model_notify(void);
+
+/**
+ * @brief Block until the model changed or model_notify() was called.
+ *
+ * Meant for a single reader (the GUI), wake ups are not counted.
+ *
+ * @return 0 or -EAGAIN on timeout
+ */
+int model_wait(k_timeout_t timeout);
 bpm_led_status_t model_get_led_status(void);
+
+/* main thread only */
 void model_set_led_status(bpm_led_status_t led_stat);
+void model_set_led_interval(uint32_t bpm_led_interval);
 
 #endif
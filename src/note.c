@@ -10,24 +10,26 @@
  * @license SPDX-License-Identifier: Apache-2.0
  */
 #include "note.h"
+#include "midi_note_names.h"
 
 /*
  * Return the note with the octave included.
- * not thread safe.
+ * The names are generated at build time, this is a single read from
+ * flash and thread safe.
  */
 const char *noteToTextWithOctave(uint8_t midinote, bool flats)
 {
-	static char notestring[5];
-	snprintf(notestring, sizeof(notestring), "%s%d", noteToText(midinote, flats),
-		 noteToOct(midinote));
-	return &notestring[0];
+	midinote &= 0x7f;
+	if (flats) {
+		return midi_note_names_flat[midinote];
+	}
+	return midi_note_names_sharp[midinote];
 }
 
 /* This function converts a MIDI note using a lookup table to a string */
 const char *noteToText(uint8_t midinote, bool flats)
 {
-	int octave = noteToOct(midinote);
-	uint8_t note = midinote - ((octave + 2) * 12);
+	uint8_t note = midinote % 12;
 	static const char *flatNotes[] = {"C ", "Db", "D ", "Eb", "E ", "F ",
 					  "Gb", "G ", "Ab", "A ", "Bb", "B "};
 	static const char *sharpNotes[] = {"C ", "C#", "D ", "D#", "E ", "F ",
@@ -135,4 +137,100 @@ uint8_t freqToMidiNote(float freq)
 	return (freq - low < high - freq) ? (min - 1) : min;
 }
 
+/*
+ * Fixed point conversions.
+ * log2 in Q24 from the position of the leading one and a 256 entry table
+ * of the mantissa with linear interpolation, the error is well below
+ * 0.01 cent.
+ */
+#define NOTE_A440_Q16    NOTE_FREQ_Q16(440)
+#define NOTE_RATIO_SHIFT 30
+
+/* 440 / A4 in Q30, 1.0 for A = 440 Hz */
+static uint32_t a4_ratio_q30 = 1UL << NOTE_RATIO_SHIFT;
+
+void noteSetA4(uint32_t a4_q16)
+{
+	if (a4_q16 < NOTE_A4_MIN_Q16) {
+		a4_q16 = NOTE_A4_MIN_Q16;
+	}
+	if (a4_q16 > NOTE_A4_MAX_Q16) {
+		a4_q16 = NOTE_A4_MAX_Q16;
+	}
+	a4_ratio_q30 = (uint32_t)(((uint64_t)NOTE_A440_Q16 << NOTE_RATIO_SHIFT) / a4_q16);
+}
+
+/* log2(x) in Q24, x > 0 */
+static int32_t log2Q24(uint32_t x)
+{
+	int32_t e = 31 - __builtin_clz(x);
+	/* Leading one in bit 31, the mantissa follows */
+	uint32_t m = x << (31 - e);
+	uint32_t idx = (m >> (31 - MIDI_LOG2_TABLE_BITS)) & ((1U << MIDI_LOG2_TABLE_BITS) - 1U);
+	uint32_t frac = (m >> (31 - MIDI_LOG2_TABLE_BITS - 16)) & 0xffffU;
+	uint32_t t0 = midi_log2_table[idx];
+	uint32_t t1 = midi_log2_table[idx + 1];
+	uint32_t interp = (uint32_t)(((uint64_t)(t1 - t0) * frac) >> 16);
+
+	return (e << MIDI_LOG2_Q) + (int32_t)(t0 + interp);
+}
+
+/* MIDI note number in Q24, 69 << 24 for A4 */
+static int64_t freqToNoteQ24(uint32_t freq_q16)
+{
+	uint64_t f = ((uint64_t)freq_q16 * a4_ratio_q30) >> NOTE_RATIO_SHIFT;
+
+	if (f == 0) {
+		f = 1;
+	}
+	if (f > UINT32_MAX) {
+		f = UINT32_MAX;
+	}
+
+	/* 12 semitones per octave above or below A440 */
+	int32_t octaves_q24 = log2Q24((uint32_t)f) - log2Q24(NOTE_A440_Q16);
+
+	return ((int64_t)69 << MIDI_LOG2_Q) + (int64_t)octaves_q24 * 12;
+}
+
+uint8_t freqToNoteCents(uint32_t freq_q16, int16_t *cents_q8)
+{
+	int64_t note_q24 = freqToNoteQ24(freq_q16);
+	int64_t note = (note_q24 + (1 << (MIDI_LOG2_Q - 1))) >> MIDI_LOG2_Q;
+
+	if (note < 0) {
+		note = 0;
+	}
+	if (note > 127) {
+		note = 127;
+	}
+
+	if (cents_q8) {
+		/* 100 cents per semitone, Q24 --> Q8 */
+		int64_t cents = ((note_q24 - (note << MIDI_LOG2_Q)) * 100) >> (MIDI_LOG2_Q - 8);
+
+		if (cents > INT16_MAX) {
+			cents = INT16_MAX;
+		}
+		if (cents < INT16_MIN) {
+			cents = INT16_MIN;
+		}
+		*cents_q8 = (int16_t)cents;
+	}
+	return (uint8_t)note;
+}
+
+uint32_t freqToPitch725(uint32_t freq_q16)
+{
+	int64_t note_q25 = freqToNoteQ24(freq_q16) << 1;
+
+	if (note_q25 < 0) {
+		return 0;
+	}
+	if (note_q25 > (int64_t)UINT32_MAX) {
+		return UINT32_MAX;
+	}
+	return (uint32_t)note_q25;
+}
+
 /* EOF */
@@ -67,5 +67,43 @@ float noteToFreq(uint8_t midinote);
  */
 uint8_t freqToMidiNote(float freq);
 
+/*
+ * Fixed point pitch, no FPU needed.  Frequencies are in Q16 Hz
+ * e.g. 440 Hz is (440 << 16).
+ */
+#define NOTE_FREQ_Q16(hz) ((uint32_t)(hz) << 16)
+
+/* Allowed range of the A4 reference */
+#define NOTE_A4_MIN_Q16 NOTE_FREQ_Q16(300)
+#define NOTE_A4_MAX_Q16 NOTE_FREQ_Q16(500)
+
+/**
+ * @brief Set the A4 reference used by the fixed point conversions.
+ *
+ * The conversions scale the input by 440 / A4, so any tuning costs one
+ * multiply instead of a table per tuning.
+ *
+ * @param a4_q16 A4 frequency in Q16 Hz, clamped to 300 --> 500 Hz
+ */
+void noteSetA4(uint32_t a4_q16);
+
+/**
+ * @brief Nearest MIDI note and the offset from it, constant time.
+ *
+ * @param freq_q16 frequency in Q16 Hz
+ * @param cents_q8 offset from the returned note in cents Q8 (256 = 1
+ *        cent), +/- 50 cents unless the note was clamped.  May be NULL.
+ * @return midinote in MIDI format (limited to 0 -> 127)
+ */
+uint8_t freqToNoteCents(uint32_t freq_q16, int16_t *cents_q8);
+
+/**
+ * @brief Frequency to MIDI 2.0 pitch 7.25 (per note pitch), constant time.
+ *
+ * @param freq_q16 frequency in Q16 Hz
+ * @return 7 bits note number, 25 bits fraction of a semitone
+ */
+uint32_t freqToPitch725(uint32_t freq_q16);
+
 #endif /* NOTE_H */
 /* EOF */
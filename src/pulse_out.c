@@ -0,0 +1,289 @@
+/**
+ * @file pulse_out.c
+ * @brief DIN sync and analog clock pulse outputs on PWM channels.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260402
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/pwm.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "pulse_out.h"
+
+LOG_MODULE_REGISTER(pulse_out, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define PULSE_OUT_NODE DT_NODELABEL(midi1_pulse_out)
+
+/* sbpm is BPM * 100, a beat at 1 sbpm takes 6000 s */
+#define PULSE_OUT_SBPM_S 6000ULL
+
+struct pulse_out_cfg {
+	struct pwm_dt_spec pwm;
+	const char *name;
+	uint8_t ppqn;
+	uint32_t width_us;
+};
+
+struct pulse_out_data {
+	/* cycles per second * 6000 / ppqn, the period is this / sbpm */
+	uint64_t period_k;
+	/* Remainder of period_k / sbpm carried from beat to beat, in 1/sbpm cycles */
+	uint32_t rem_acc;
+	uint32_t pulse_cycles;
+	/* As programmed, the width is 0 while stopped */
+	uint32_t period_cycles;
+	uint32_t pulse_set;
+	uint32_t updates;
+	uint32_t errors;
+};
+
+#define PULSE_OUT_CFG(node)                                                                        \
+	{                                                                                          \
+		.pwm = PWM_DT_SPEC_GET(node),                                                      \
+		.name = DT_NODE_FULL_NAME(node),                                                   \
+		.ppqn = DT_PROP(node, ppqn),                                                       \
+		.width_us = DT_PROP(node, pulse_width_us),                                         \
+	},
+
+static const struct pulse_out_cfg cfg[] = {
+	DT_FOREACH_CHILD_STATUS_OKAY(PULSE_OUT_NODE, PULSE_OUT_CFG)};
+
+static const struct gpio_dt_spec run_gpio = GPIO_DT_SPEC_GET_OR(PULSE_OUT_NODE, run_gpios, {0});
+static const struct gpio_dt_spec reset_gpio =
+	GPIO_DT_SPEC_GET_OR(PULSE_OUT_NODE, reset_gpios, {0});
+#define PULSE_OUT_RESET_US DT_PROP(PULSE_OUT_NODE, reset_width_us)
+
+static struct pulse_out_data data[ARRAY_SIZE(cfg)];
+static struct k_spinlock pulse_lock;
+static bool ready;
+/* What the outputs were programmed with, only the beat changes these */
+static bool running;
+static uint16_t running_sbpm;
+static uint32_t beats;
+static uint32_t resets;
+/* Requested by pulse_out_run() and pulse_out_transport(), stopped until a Start */
+static atomic_t run_req = ATOMIC_INIT(IS_ENABLED(CONFIG_PULSE_OUT_FREE_RUN));
+static atomic_t reset_req;
+
+static void reset_end(struct k_timer *timer)
+{
+	(void)gpio_pin_set_dt(&reset_gpio, 0);
+}
+
+K_TIMER_DEFINE(reset_timer, reset_end, NULL);
+
+int pulse_out_init(void)
+{
+	uint64_t cps;
+
+	for (size_t i = 0; i < ARRAY_SIZE(cfg); i++) {
+		if (!pwm_is_ready_dt(&cfg[i].pwm)) {
+			LOG_ERR("Pulse output %s PWM not ready", cfg[i].name);
+			return -ENODEV;
+		}
+		if (pwm_get_cycles_per_sec(cfg[i].pwm.dev, cfg[i].pwm.channel, &cps)) {
+			LOG_ERR("Pulse output %s no PWM clock", cfg[i].name);
+			return -ENODEV;
+		}
+		data[i].period_k = (cps * PULSE_OUT_SBPM_S) / cfg[i].ppqn;
+		data[i].pulse_cycles = (uint32_t)((cps * cfg[i].width_us) / USEC_PER_SEC);
+		(void)pwm_set_pulse_dt(&cfg[i].pwm, 0);
+	}
+	if (run_gpio.port) {
+		if (!gpio_is_ready_dt(&run_gpio) ||
+		    gpio_pin_configure_dt(&run_gpio, GPIO_OUTPUT_INACTIVE)) {
+			LOG_ERR("Pulse output run line not ready");
+			return -ENODEV;
+		}
+	}
+	if (reset_gpio.port) {
+		if (!gpio_is_ready_dt(&reset_gpio) ||
+		    gpio_pin_configure_dt(&reset_gpio, GPIO_OUTPUT_INACTIVE)) {
+			LOG_ERR("Pulse output reset line not ready");
+			return -ENODEV;
+		}
+	}
+	ready = true;
+	LOG_INF("%d clock pulse outputs", (int)ARRAY_SIZE(cfg));
+	return 0;
+}
+
+/*
+ * Both the period and the pulse go to the driver in a single call, so
+ * the width never exceeds the new period.  At most half the period
+ * keeps the pulses apart at the highest tempo.
+ *
+ * The period of a beat is N or N + 1 PWM cycles: the remainder of the
+ * division is carried to the next beat, so the mean period is exact
+ * and the phase to the MIDI clock stays within one cycle per pulse of
+ * a beat instead of drifting.  A new tempo starts the remainder at
+ * half, the same as rounding to the nearest cycle.  The driver is only
+ * called when the period or the pulse changes.
+ */
+static void output_set(size_t i, uint16_t sbpm, bool run, bool retempo)
+{
+	struct pulse_out_data *d = &data[i];
+	uint32_t period = (uint32_t)(d->period_k / sbpm);
+	uint32_t pulse;
+
+	if (retempo) {
+		d->rem_acc = sbpm / 2U;
+	}
+	d->rem_acc += (uint32_t)(d->period_k % sbpm);
+	if (d->rem_acc >= sbpm) {
+		d->rem_acc -= sbpm;
+		period++;
+	}
+	pulse = run ? MIN(d->pulse_cycles, period / 2U) : 0U;
+	if (period == d->period_cycles && pulse == d->pulse_set) {
+		return;
+	}
+
+	if (pwm_set_cycles(cfg[i].pwm.dev, cfg[i].pwm.channel, period, pulse, cfg[i].pwm.flags)) {
+		d->errors++;
+		return;
+	}
+	d->period_cycles = period;
+	d->pulse_set = pulse;
+	d->updates++;
+}
+
+void pulse_out_beat(uint16_t sbpm)
+{
+	bool run = atomic_get(&run_req) != 0;
+	bool reset = run && atomic_cas(&reset_req, 1, 0);
+	bool retempo;
+	k_spinlock_key_t key;
+
+	if (!ready || !sbpm) {
+		return;
+	}
+
+	key = k_spin_lock(&pulse_lock);
+	retempo = sbpm != running_sbpm;
+	/* Reset ahead of the first clock pulse of the song */
+	if (reset && reset_gpio.port) {
+		(void)gpio_pin_set_dt(&reset_gpio, 1);
+		k_timer_start(&reset_timer, K_USEC(PULSE_OUT_RESET_US), K_NO_WAIT);
+		resets++;
+	}
+	/* All outputs close together on this beat pulse, nothing else */
+	for (size_t i = 0; i < ARRAY_SIZE(cfg); i++) {
+		output_set(i, sbpm, run, retempo);
+	}
+	if (run != running && run_gpio.port) {
+		(void)gpio_pin_set_dt(&run_gpio, run);
+	}
+	running = run;
+	running_sbpm = sbpm;
+	beats++;
+	k_spin_unlock(&pulse_lock, key);
+}
+
+void pulse_out_run(bool run)
+{
+	atomic_set(&run_req, run);
+}
+
+void pulse_out_transport(uint8_t rt)
+{
+	switch (rt) {
+	case RT_START:
+		atomic_set(&reset_req, 1);
+		atomic_set(&run_req, 1);
+		break;
+	case RT_CONTINUE:
+		atomic_set(&run_req, 1);
+		break;
+	case RT_STOP:
+		atomic_set(&run_req, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+int pulse_out_get_info(int index, struct pulse_out_info *info)
+{
+	k_spinlock_key_t key;
+
+	if (index < 0 || index >= (int)ARRAY_SIZE(cfg)) {
+		return -EINVAL;
+	}
+	key = k_spin_lock(&pulse_lock);
+	*info = (struct pulse_out_info){
+		.name = cfg[index].name,
+		.ppqn = cfg[index].ppqn,
+		.width_us = cfg[index].width_us,
+		.period_cycles = data[index].period_cycles,
+		.pulse_cycles = data[index].pulse_set,
+		.updates = data[index].updates,
+		.errors = data[index].errors,
+	};
+	k_spin_unlock(&pulse_lock, key);
+	return 0;
+}
+
+void pulse_out_get_stats(struct pulse_out_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&pulse_lock);
+
+	*stats = (struct pulse_out_stats){
+		.outputs = (int)ARRAY_SIZE(cfg),
+		.running = running,
+		.sbpm = running_sbpm,
+		.beats = beats,
+		.resets = resets,
+	};
+	k_spin_unlock(&pulse_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_pulse(const struct shell *sh, size_t argc, char **argv)
+{
+	struct pulse_out_stats stats;
+	struct pulse_out_info info;
+
+	if (argc > 1) {
+		if (strcmp(argv[1], "on") == 0) {
+			pulse_out_run(true);
+		} else if (strcmp(argv[1], "off") == 0) {
+			pulse_out_run(false);
+		} else {
+			shell_error(sh, "usage: midi pulse [on|off]");
+			return -EINVAL;
+		}
+		shell_print(sh, "Taken over on the next beat");
+		return 0;
+	}
+
+	pulse_out_get_stats(&stats);
+	shell_print(sh, "%d outputs %s at %u.%02u BPM, %u beats, %u resets",
+		    stats.outputs, stats.running ? "running" : "stopped", stats.sbpm / 100U,
+		    stats.sbpm % 100U, stats.beats, stats.resets);
+	for (int i = 0; i < stats.outputs; i++) {
+		if (pulse_out_get_info(i, &info)) {
+			break;
+		}
+		shell_print(sh, "  %-16s %2u ppqn %5u us period %u pulse %u cycles, %u updates %u errors",
+			    info.name, info.ppqn, info.width_us, info.period_cycles, info.pulse_cycles,
+			    info.updates, info.errors);
+	}
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), pulse, NULL, "Clock pulse outputs [on|off]", cmd_midi_pulse, 1, 1);
+#endif
+
+/* EOF */
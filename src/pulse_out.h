@@ -0,0 +1,120 @@
+/**
+ * @file pulse_out.h
+ * @brief DIN sync and analog clock pulse outputs on PWM channels.
+ *
+ * Every child of the midi1_pulse_out node is one output with its own
+ * ppqn (1, 4, 24 or 48) and pulse width.  The pulses are made by the
+ * PWM hardware from the period of the tempo, so the CPU does no work
+ * per pulse and the outputs do not pick up the jitter of the clock
+ * callback.
+ *
+ * The period is recomputed by pulse_out_beat() on the first pulse of
+ * every beat of the generated MIDI clock: the outputs start in phase
+ * with it and a tempo change is taken over on the next beat.
+ *
+ * They follow the transport of the generated clock: stopped at boot
+ * unless CONFIG_PULSE_OUT_FREE_RUN, running after a Start or Continue
+ * and stopped again by a Stop, see pulse_out_transport().  A Start also pulses the reset line, on the
+ * beat the outputs start on.
+ *
+ * The PWM runs free, Zephyr has no way to restart the counter of a
+ * running channel.  The period is a whole number of PWM cycles, so the
+ * beats alternate between N and N + 1 cycles with the remainder carried
+ * over, the mean period is exact and the rounding does not add up to a
+ * drift.  A PWM that is not clocked from the same source as
+ * midi1_clock_cntr still drifts by the difference of the two
+ * oscillators, e.g. 50 ppm or 0.5 ms per 10 s between two crystals.
+ *
+ * The new period is written while the counter runs.  Both boards latch
+ * it from a shadow register at the end of the running period: the TPM
+ * of the MCXW71 buffers MOD and CnV until the counter wraps, the
+ * SCTimer of the RW612 reloads its match registers from MATCHREL at
+ * the limit.  The pulse running at the beat ends with the old period,
+ * the next one starts with the new period, so a change lands one pulse
+ * late: a constant offset that does not accumulate.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260402
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef PULSE_OUT_H
+#define PULSE_OUT_H
+#include <stdbool.h>
+#include <stdint.h>
+
+struct pulse_out_info {
+	const char *name;
+	uint8_t ppqn;
+	uint32_t width_us;
+	/* PWM cycles as programmed, 0 before the first beat */
+	uint32_t period_cycles;
+	uint32_t pulse_cycles;
+	uint32_t updates;
+	/* Rejected by the PWM driver, e.g. a period out of its range */
+	uint32_t errors;
+};
+
+struct pulse_out_stats {
+	int outputs;
+	bool running;
+	/* Tempo the outputs run at */
+	uint16_t sbpm;
+	/* Beats the outputs were recomputed on */
+	uint32_t beats;
+	/* Reset pulses, one per Start */
+	uint32_t resets;
+};
+
+#ifdef CONFIG_PULSE_OUT
+/**
+ * @brief Check the PWM channels and the run line, the outputs stay low.
+ *
+ * @return 0 or -ENODEV
+ */
+int pulse_out_init(void);
+
+/**
+ * @brief First pulse of a beat of the generated clock (ISR).
+ *
+ * Recomputes the period for the beat, the PWM driver is only called
+ * when the period, the tempo or the run state changed.
+ *
+ * @param sbpm tempo the MIDI clock runs at from this pulse
+ */
+void pulse_out_beat(uint16_t sbpm);
+
+/**
+ * @brief Run or stop the outputs, thread or ISR.
+ *
+ * Taken over on the next beat, stopped outputs stay low.
+ */
+void pulse_out_run(bool run);
+
+/**
+ * @brief Follow a real-time message sent with the generated clock.
+ *
+ * Start runs the outputs with a reset pulse, Continue runs them without
+ * and Stop stops them, on the next beat.  Other bytes are ignored.
+ *
+ * @param rt real-time status byte, e.g. RT_START
+ */
+void pulse_out_transport(uint8_t rt);
+
+int pulse_out_get_info(int index, struct pulse_out_info *info);
+void pulse_out_get_stats(struct pulse_out_stats *stats);
+#else
+static inline int pulse_out_init(void)
+{
+	return 0;
+}
+
+static inline void pulse_out_beat(uint16_t sbpm)
+{
+}
+
+static inline void pulse_out_transport(uint8_t rt)
+{
+}
+#endif /* CONFIG_PULSE_OUT */
+
+#endif /* PULSE_OUT_H */
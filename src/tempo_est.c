@@ -0,0 +1,143 @@
+/**
+ * @file tempo_est.c
+ * @brief Predicting tempo estimator between the heart rate and the clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260328
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/shell/shell.h>
+
+#include "tempo_est.h"
+
+/* Limits of the tempo handed to the clock, scaled BPM */
+#define TEMPO_EST_MIN_SBPM 2000
+#define TEMPO_EST_MAX_SBPM 30000
+
+/* Benedict-Bordner: beta = alpha^2 / (2 - alpha), both per mille */
+#define TEMPO_EST_BETA ((TEMPO_EST_ALPHA * TEMPO_EST_ALPHA) / (2000 - TEMPO_EST_ALPHA))
+
+static struct k_spinlock est_lock;
+/* Tempo in Q16 scaled BPM and trend in Q16 scaled BPM per second */
+static int64_t tempo_q16;
+static int64_t trend_q16;
+static uint32_t last_ms;
+static uint8_t reject_run;
+static struct tempo_est_stats stats;
+
+/* Call with est_lock held */
+static void restart_locked(uint16_t sbpm, uint32_t now_ms)
+{
+	tempo_q16 = (int64_t)sbpm << 16;
+	trend_q16 = 0;
+	last_ms = now_ms;
+	reject_run = 0;
+	stats.valid = true;
+	stats.restarts++;
+}
+
+void tempo_est_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&est_lock);
+
+	stats.valid = false;
+	k_spin_unlock(&est_lock, key);
+}
+
+/* Call with est_lock held, dt in ms */
+static int64_t predict_locked(uint32_t dt)
+{
+	return tempo_q16 + (trend_q16 * dt) / 1000;
+}
+
+uint16_t tempo_est_update(uint16_t sbpm, uint32_t now_ms)
+{
+	k_spinlock_key_t key = k_spin_lock(&est_lock);
+	uint32_t dt = now_ms - last_ms;
+	int64_t predicted;
+	int64_t residual;
+
+	stats.samples++;
+	if (!stats.valid || dt > TEMPO_EST_MAX_GAP_MS) {
+		restart_locked(sbpm, now_ms);
+		goto out;
+	}
+	if (dt < TEMPO_EST_MIN_DT_MS) {
+		/*
+		 * Another sensor a few ms after the previous one, the trend
+		 * gain is per interval and would blow up.
+		 */
+		stats.held++;
+		goto out;
+	}
+
+	predicted = predict_locked(dt);
+	residual = ((int64_t)sbpm << 16) - predicted;
+
+	if (llabs(residual) > ((int64_t)TEMPO_EST_GATE_SBPM << 16)) {
+		stats.rejected++;
+		if (++reject_run >= TEMPO_EST_REJECT_LIMIT) {
+			/* Not a spike, the tempo really moved (or another sensor took over) */
+			restart_locked(sbpm, now_ms);
+		}
+		goto out;
+	}
+	reject_run = 0;
+
+	/* Correct the prediction, then the trend per second */
+	tempo_q16 = predicted + (residual * TEMPO_EST_ALPHA) / 1000;
+	trend_q16 += (residual * TEMPO_EST_BETA) / dt;
+	trend_q16 = CLAMP(trend_q16, -((int64_t)TEMPO_EST_MAX_TREND << 16),
+			  (int64_t)TEMPO_EST_MAX_TREND << 16);
+	last_ms = now_ms;
+	stats.max_residual_sbpm = MAX(stats.max_residual_sbpm, (uint16_t)(llabs(residual) >> 16));
+
+out:
+	/* Ahead of the last sample, not of now: a rejected sample adds no time */
+	predicted = predict_locked((now_ms - last_ms) + TEMPO_EST_HORIZON_MS) >> 16;
+	stats.sbpm = (uint16_t)(tempo_q16 >> 16);
+	stats.trend_sbpm_per_s = (int16_t)(trend_q16 >> 16);
+	stats.predicted_sbpm = (uint16_t)CLAMP(predicted, TEMPO_EST_MIN_SBPM, TEMPO_EST_MAX_SBPM);
+	sbpm = stats.predicted_sbpm;
+	k_spin_unlock(&est_lock, key);
+	return sbpm;
+}
+
+void tempo_est_get_stats(struct tempo_est_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&est_lock);
+
+	*out = stats;
+	k_spin_unlock(&est_lock, key);
+}
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_est(const struct shell *sh, size_t argc, char **argv)
+{
+	struct tempo_est_stats s;
+
+	tempo_est_get_stats(&s);
+	shell_print(sh, "alpha %d/1000, beta %d/1000, horizon %d ms, gate %d sbpm, min dt %d ms",
+		    TEMPO_EST_ALPHA, TEMPO_EST_BETA, TEMPO_EST_HORIZON_MS, TEMPO_EST_GATE_SBPM,
+		    TEMPO_EST_MIN_DT_MS);
+	if (!s.valid) {
+		shell_print(sh, "no heart rate tempo yet");
+	} else {
+		shell_print(sh, "tempo %u sbpm, trend %d sbpm/s, predicted %u sbpm", s.sbpm,
+			    s.trend_sbpm_per_s, s.predicted_sbpm);
+	}
+	shell_print(sh, "samples %u, held %u, rejected %u, restarts %u, max residual %u sbpm",
+		    s.samples, s.held, s.rejected, s.restarts, s.max_residual_sbpm);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), est, NULL, "Heart rate tempo estimator", cmd_midi_est, 1, 0);
+#endif
+
+/* EOF */
@@ -0,0 +1,79 @@
+/**
+ * @file tempo_est.h
+ * @brief Predicting tempo estimator between the heart rate and the clock.
+ *
+ * An alpha-beta filter on the aggregated heart rate tempo: it tracks the
+ * tempo and its trend (scaled BPM per second) and hands the clock the
+ * tempo predicted TEMPO_EST_HORIZON_MS ahead, so the generated clock
+ * moves with the trend instead of a step behind it.
+ *
+ * TEMPO_EST_ALPHA is the one knob between smoothing (low) and latency
+ * (high), beta follows from it as in the Benedict-Bordner filter,
+ * beta = alpha^2 / (2 - alpha).  A sample too far from the prediction
+ * is taken as a motion artefact and left out; TEMPO_EST_REJECT_LIMIT
+ * of them in a row is a real change and restarts the filter at the
+ * new tempo.
+ *
+ * With several sensors the aggregate changes on every notification,
+ * a few ms apart.  Only samples at least TEMPO_EST_MIN_DT_MS after the
+ * previous one update the filter, the ones in between are held back;
+ * the next sample after the interval has their sensors in it already.
+ *
+ * Integer maths only, it runs the same without an FPU.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260328
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef TEMPO_EST_H
+#define TEMPO_EST_H
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Per mille, 1000 is no smoothing at all */
+#define TEMPO_EST_ALPHA        CONFIG_TEMPO_EST_ALPHA
+#define TEMPO_EST_HORIZON_MS   CONFIG_TEMPO_EST_HORIZON_MS
+/* Residual gate in scaled BPM */
+#define TEMPO_EST_GATE_SBPM    CONFIG_TEMPO_EST_GATE_SBPM
+#define TEMPO_EST_REJECT_LIMIT 3
+#define TEMPO_EST_MIN_DT_MS    CONFIG_TEMPO_EST_MIN_DT_MS
+
+/* Trend limit, scaled BPM per second, keeps the prediction sane */
+#define TEMPO_EST_MAX_TREND 500
+/* No sample for this long starts over */
+#define TEMPO_EST_MAX_GAP_MS 5000
+
+struct tempo_est_stats {
+	bool valid;
+	/* Filtered tempo and trend at the last sample */
+	uint16_t sbpm;
+	int16_t trend_sbpm_per_s;
+	/* Tempo handed to the clock */
+	uint16_t predicted_sbpm;
+	uint32_t samples;
+	/* Within TEMPO_EST_MIN_DT_MS of the previous sample, held back */
+	uint32_t held;
+	uint32_t rejected;
+	/* Restarted after a gap or a run of rejected samples */
+	uint32_t restarts;
+	/* Largest accepted residual */
+	uint16_t max_residual_sbpm;
+};
+
+/**
+ * @brief Forget the state, the next sample starts over.
+ */
+void tempo_est_reset(void);
+
+/**
+ * @brief A new aggregated tempo, thread context.
+ *
+ * @param sbpm Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @param now_ms k_uptime_get_32() of the sample
+ * @return the predicted tempo for the clock
+ */
+uint16_t tempo_est_update(uint16_t sbpm, uint32_t now_ms);
+
+void tempo_est_get_stats(struct tempo_est_stats *stats);
+
+#endif /* TEMPO_EST_H */
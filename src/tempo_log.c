@@ -0,0 +1,543 @@
+/**
+ * @file tempo_log.c
+ * @brief Tempo history recorder in a flash circular log.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260330
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/fs/fcb.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/spinlock.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/shell/shell.h>
+
+#include "clock_source.h"
+#include "common.h"
+#include "model.h"
+#include "tempo_log.h"
+#include "usb_midi_tx.h"
+
+LOG_MODULE_REGISTER(tempo_log, CONFIG_LOG_DEFAULT_LEVEL);
+
+#define TEMPO_LOG_PARTITION_ID FIXED_PARTITION_ID(tempo_log_partition)
+#define TEMPO_LOG_FCB_MAGIC    0x544c4f47
+#define TEMPO_LOG_MAX_SECTORS  32
+/* Room for padding up to the flash write block */
+#define TEMPO_LOG_ALIGN_MAX    32
+/* Head byte and three 3 byte varints */
+#define TEMPO_LOG_RECORD_MAX   10
+
+BUILD_ASSERT(TEMPO_LOG_BLOCK_SIZE > sizeof(struct tempo_log_header) + TEMPO_LOG_RECORD_MAX,
+	     "staging block too small for a record");
+
+/* Requests towards the log thread */
+#define REQ_FLUSH  BIT(0)
+#define REQ_EXPORT BIT(1)
+#define REQ_ERASE  BIT(2)
+
+struct stage {
+	uint8_t buf[TEMPO_LOG_BLOCK_SIZE + TEMPO_LOG_ALIGN_MAX];
+	uint16_t prev[3];
+	/* Handed to the log thread, sampling uses the other one */
+	bool busy;
+};
+
+static struct fcb fcb;
+static struct flash_sector sectors[TEMPO_LOG_MAX_SECTORS];
+static uint8_t write_align = 1;
+
+/* Staging blocks, the timer fills stage[fill] */
+static struct k_spinlock log_lock;
+static struct stage stage[2];
+static int fill;
+static struct tempo_log_stats stats;
+
+static atomic_t requests;
+static K_SEM_DEFINE(log_sem, 0, 1);
+
+static struct tempo_log_header *stage_header(struct stage *s)
+{
+	return (struct tempo_log_header *)s->buf;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = (uint8_t)v;
+	return p;
+}
+
+/* Hand the filled block to the thread, call with log_lock held */
+static bool handoff_locked(void)
+{
+	struct stage *s = &stage[fill];
+
+	if (stage_header(s)->len == 0) {
+		return true;
+	}
+	if (stage[fill ^ 1].busy) {
+		return false;
+	}
+	s->busy = true;
+	fill ^= 1;
+	stage_header(&stage[fill])->len = 0;
+	stats.staged = 0;
+	k_sem_give(&log_sem);
+	return true;
+}
+
+/* Call with log_lock held */
+static void encode_locked(const uint16_t value[3], uint8_t flags, uint32_t now)
+{
+	struct stage *s = &stage[fill];
+	struct tempo_log_header *h = stage_header(s);
+
+	if (h->len == 0) {
+		*h = (struct tempo_log_header){
+			.version = TEMPO_LOG_VERSION,
+			.flags = flags,
+			.boot = stats.boot,
+			.t0_ms = now,
+			.period_ms = TEMPO_LOG_PERIOD_MS,
+			.samples = 1,
+			.len = sizeof(*h),
+			.hr_sbpm = value[0],
+			.meas_sbpm = value[1],
+			.pll_sbpm = value[2],
+		};
+	} else {
+		uint8_t *head = &s->buf[h->len];
+		uint8_t *p = head + 1;
+
+		*head = flags;
+		for (int i = 0; i < 3; i++) {
+			int32_t d = (int32_t)value[i] - s->prev[i];
+
+			if (d) {
+				*head |= BIT(i);
+				/* Zigzag, small changes either way are one byte */
+				p = put_varint(p, ((uint32_t)d << 1) ^ (uint32_t)(d >> 31));
+			}
+		}
+		h->len = (uint16_t)(p - s->buf);
+		h->samples++;
+	}
+	memcpy(s->prev, value, sizeof(s->prev));
+	stats.staged = h->len;
+}
+
+static void log_sample(struct k_timer *timer)
+{
+	human_bpm_model_t mod;
+	uint16_t value[3];
+	uint8_t flags = 0;
+	uint32_t now = k_uptime_get_32();
+
+	/* Lock free, like the chart history */
+	model_get(&mod);
+	value[0] = mod.hr_sbpm ? mod.hr_sbpm : mod.hr_bpm * 100U;
+	value[1] = mod.meas_sbpm;
+	value[2] = mod.pll_sbpm;
+	flags |= mod.hr_connected ? TEMPO_LOG_HR_CONNECTED : 0;
+	/* The same (frequency) PLL as pll_sbpm */
+	flags |= clock_source_get_quality(CLOCK_SOURCE_SERIAL) >= CLOCK_SOURCE_LOCK_QUALITY
+			 ? TEMPO_LOG_PLL_LOCKED
+			 : 0;
+
+	k_spinlock_key_t key = k_spin_lock(&log_lock);
+	struct tempo_log_header *h = stage_header(&stage[fill]);
+
+	if (h->len + TEMPO_LOG_RECORD_MAX > TEMPO_LOG_BLOCK_SIZE && !handoff_locked()) {
+		/* The thread is still writing the other block */
+		stats.overruns++;
+		k_spin_unlock(&log_lock, key);
+		return;
+	}
+	encode_locked(value, flags, now);
+	stats.samples++;
+
+	h = stage_header(&stage[fill]);
+	if (now - h->t0_ms >= TEMPO_LOG_FLUSH_S * 1000U) {
+		/* Bounds what a power cut loses, on an overrun it is retried */
+		(void)handoff_locked();
+	}
+	k_spin_unlock(&log_lock, key);
+}
+
+K_TIMER_DEFINE(log_timer, log_sample, NULL);
+
+/* ---------------------------- FLASH -------------------------------------- */
+
+static int log_append(const uint8_t *buf, uint16_t len)
+{
+	struct fcb_entry loc;
+	int err;
+
+	err = fcb_append(&fcb, len, &loc);
+	if (err == -ENOSPC) {
+		/* Circular, the oldest sector goes */
+		err = fcb_rotate(&fcb);
+		if (err == 0) {
+			stats.rotations++;
+			err = fcb_append(&fcb, len, &loc);
+		}
+	}
+	if (err) {
+		return err;
+	}
+	err = flash_area_write(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), buf, len);
+	if (err) {
+		return err;
+	}
+	return fcb_append_finish(&fcb, &loc);
+}
+
+/* Write the blocks handed off by the timer, log thread only */
+static void write_pending(void)
+{
+	for (int i = 0; i < 2; i++) {
+		struct stage *s = &stage[i];
+		uint32_t start;
+		uint16_t len;
+		int err;
+
+		if (!s->busy) {
+			continue;
+		}
+		/* Padded to the write block, the header has the real length */
+		len = stage_header(s)->len;
+		memset(&s->buf[len], 0, ROUND_UP(len, write_align) - len);
+		len = ROUND_UP(len, write_align);
+
+		start = k_cycle_get_32();
+		err = log_append(s->buf, len);
+		uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+
+		k_spinlock_key_t key = k_spin_lock(&log_lock);
+
+		if (err) {
+			stats.errors++;
+		} else {
+			stats.flushes++;
+			stats.entries++;
+			stats.bytes += len;
+		}
+		stats.last_write_us = us;
+		stats.max_write_us = MAX(stats.max_write_us, us);
+		s->busy = false;
+		stage_header(s)->len = 0;
+		k_spin_unlock(&log_lock, key);
+		if (err) {
+			LOG_ERR("Tempo log write failed (err %d)", err);
+		}
+	}
+}
+
+/* Hand off what is staged now and write it */
+static void flush_now(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&log_lock);
+
+	(void)handoff_locked();
+	k_spin_unlock(&log_lock, key);
+	write_pending();
+}
+
+static int log_init(void)
+{
+	const struct flash_area *fa;
+	struct fcb_entry loc = {0};
+	uint32_t cnt = TEMPO_LOG_MAX_SECTORS;
+	struct tempo_log_header h;
+	uint16_t boot = 0;
+	int err;
+
+	err = flash_area_get_sectors(TEMPO_LOG_PARTITION_ID, &cnt, sectors);
+	if (err) {
+		return err;
+	}
+	fcb.f_magic = TEMPO_LOG_FCB_MAGIC;
+	fcb.f_version = TEMPO_LOG_VERSION;
+	fcb.f_sector_cnt = (uint8_t)cnt;
+	fcb.f_sectors = sectors;
+	err = fcb_init(TEMPO_LOG_PARTITION_ID, &fcb);
+	if (err) {
+		return err;
+	}
+	if (flash_area_open(TEMPO_LOG_PARTITION_ID, &fa) == 0) {
+		write_align = (uint8_t)MIN(flash_area_align(fa), TEMPO_LOG_ALIGN_MAX);
+	}
+
+	/* Count what is there and continue after the last boot */
+	while (fcb_getnext(&fcb, &loc) == 0) {
+		if (flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(loc), &h, sizeof(h)) == 0 &&
+		    h.version == TEMPO_LOG_VERSION) {
+			boot = MAX(boot, h.boot + 1U);
+		}
+		stats.entries++;
+		stats.bytes += loc.fe_data_len;
+	}
+	stats.boot = boot;
+	stats.ready = true;
+	LOG_INF("Tempo log: %u entries, %u bytes, boot %u", stats.entries, stats.bytes, boot);
+	return 0;
+}
+
+/* ---------------------------- EXPORT ------------------------------------- */
+
+/* SysEx7 in UMP Data 64 packets, 6 bytes at a time */
+struct sysex_out {
+	uint8_t b[UMP_DATA64_BYTES];
+	uint8_t n;
+	bool started;
+	int err;
+};
+
+static void sysex_packet(struct sysex_out *sx, bool last)
+{
+	uint8_t status = sx->started ? (last ? UMP_DATA64_END : UMP_DATA64_CONTINUE)
+				     : (last ? UMP_DATA64_COMPLETE : UMP_DATA64_START);
+	uint8_t *b = sx->b;
+	struct midi_ump ump = {
+		.data = {(UMP_MT_DATA_64 << 28) | ((usb_midi_tx_get_group(0) & 0x0f) << 24) |
+				 (status << 20) | (sx->n << 16) | (b[0] << 8) | b[1],
+			 ((uint32_t)b[2] << 24) | (b[3] << 16) | (b[4] << 8) | b[5]},
+	};
+
+	if (sx->err) {
+		return;
+	}
+	/* Keep half the queue for the clock, the export only adds latency to itself */
+	while (usb_midi_tx_free() < USB_MIDI_TX_QUEUE_SIZE / 2) {
+		if (!usb_midi_tx_is_ready()) {
+			sx->err = -ENODEV;
+			return;
+		}
+		k_msleep(1);
+	}
+	sx->err = usb_midi_tx_send(ump);
+	sx->started = true;
+	memset(sx->b, 0, sizeof(sx->b));
+	sx->n = 0;
+}
+
+static void sysex_byte(struct sysex_out *sx, uint8_t byte)
+{
+	if (sx->n == UMP_DATA64_BYTES) {
+		sysex_packet(sx, false);
+	}
+	sx->b[sx->n++] = byte & 0x7F;
+}
+
+static int sysex_end(struct sysex_out *sx)
+{
+	sysex_packet(sx, true);
+	return sx->err;
+}
+
+/* 7 in 8: a byte with the top bits of the next 7, then their low 7 bits */
+static void sysex_packed(struct sysex_out *sx, const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i += 7) {
+		size_t n = MIN(len - i, 7);
+		uint8_t msbs = 0;
+
+		for (size_t j = 0; j < n; j++) {
+			msbs |= (data[i + j] >> 7) << j;
+		}
+		sysex_byte(sx, msbs);
+		for (size_t j = 0; j < n; j++) {
+			sysex_byte(sx, data[i + j]);
+		}
+	}
+}
+
+static int export_entry(struct fcb_entry *loc)
+{
+	struct sysex_out sx = {0};
+	uint8_t chunk[7 * 8];
+	uint16_t off = 0;
+
+	sysex_byte(&sx, TEMPO_LOG_SYSEX_ID);
+	sysex_byte(&sx, TEMPO_LOG_SYSEX_ENTRY);
+	while (off < loc->fe_data_len && sx.err == 0) {
+		uint16_t n = MIN(loc->fe_data_len - off, (int)sizeof(chunk));
+		int err = flash_area_read(fcb.fap, FCB_ENTRY_FA_DATA_OFF(*loc) + off, chunk, n);
+
+		if (err) {
+			return err;
+		}
+		sysex_packed(&sx, chunk, n);
+		off += n;
+	}
+	return sysex_end(&sx);
+}
+
+static void export_all(void)
+{
+	struct fcb_entry loc = {0};
+	struct sysex_out sx = {0};
+	uint32_t count = 0;
+	int hold = usb_midi_tx_sysex_hold();
+	int err = hold;
+
+	flush_now();
+	/* No forwarded SysEx or jitter record between the packets of an entry */
+	while (err == 0 && fcb_getnext(&fcb, &loc) == 0) {
+		err = export_entry(&loc);
+		count++;
+	}
+	if (err == 0) {
+		sysex_byte(&sx, TEMPO_LOG_SYSEX_ID);
+		sysex_byte(&sx, TEMPO_LOG_SYSEX_END);
+		sysex_byte(&sx, (count >> 7) & 0x7F);
+		sysex_byte(&sx, count & 0x7F);
+		err = sysex_end(&sx);
+	}
+	if (hold == 0) {
+		usb_midi_tx_sysex_unhold();
+	}
+
+	k_spinlock_key_t key = k_spin_lock(&log_lock);
+
+	stats.exported = count;
+	k_spin_unlock(&log_lock, key);
+	if (err) {
+		LOG_WRN("Tempo log export stopped after %u entries (err %d)", count, err);
+	} else {
+		LOG_INF("Tempo log exported, %u entries", count);
+	}
+}
+
+/* ---------------------------- API ---------------------------------------- */
+
+static void request(uint32_t req)
+{
+	atomic_or(&requests, req);
+	k_sem_give(&log_sem);
+}
+
+void tempo_log_flush(void)
+{
+	request(REQ_FLUSH);
+}
+
+int tempo_log_export(void)
+{
+	if (!usb_midi_tx_is_ready()) {
+		return -ENODEV;
+	}
+	if (atomic_get(&requests) & REQ_EXPORT) {
+		return -EBUSY;
+	}
+	request(REQ_EXPORT);
+	return 0;
+}
+
+int tempo_log_erase(void)
+{
+	request(REQ_ERASE);
+	return 0;
+}
+
+void tempo_log_get_stats(struct tempo_log_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&log_lock);
+
+	*out = stats;
+	k_spin_unlock(&log_lock, key);
+}
+
+/* ---------------------------- THREADS ------------------------------------ */
+
+static void tempo_log_thread(void)
+{
+	int err = log_init();
+
+	if (err) {
+		LOG_ERR("Tempo log not available (err %d)", err);
+		return;
+	}
+	k_timer_start(&log_timer, K_MSEC(TEMPO_LOG_PERIOD_MS), K_MSEC(TEMPO_LOG_PERIOD_MS));
+
+	while (1) {
+		uint32_t req;
+
+		k_sem_take(&log_sem, K_FOREVER);
+		req = (uint32_t)atomic_get(&requests);
+
+		if (req & REQ_ERASE) {
+			flush_now();
+			err = fcb_clear(&fcb);
+
+			k_spinlock_key_t key = k_spin_lock(&log_lock);
+
+			stats.entries = 0;
+			stats.bytes = 0;
+			stats.errors += err ? 1U : 0U;
+			k_spin_unlock(&log_lock, key);
+		}
+		if (req & REQ_FLUSH) {
+			flush_now();
+		}
+		write_pending();
+		if (req & REQ_EXPORT) {
+			export_all();
+		}
+		atomic_and(&requests, ~(atomic_val_t)req);
+	}
+}
+
+/* Lowest of the application, flash writes stall nothing that is timed */
+K_THREAD_DEFINE(tempo_log_tid, 2048, tempo_log_thread, NULL, NULL, NULL, 10, 0, 1000);
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static int cmd_midi_log(const struct shell *sh, size_t argc, char **argv)
+{
+	struct tempo_log_stats s;
+
+	if (argc > 1) {
+		int err = -EINVAL;
+
+		if (strcmp(argv[1], "flush") == 0) {
+			tempo_log_flush();
+			err = 0;
+		} else if (strcmp(argv[1], "export") == 0) {
+			err = tempo_log_export();
+		} else if (strcmp(argv[1], "erase") == 0) {
+			err = tempo_log_erase();
+		}
+		if (err) {
+			shell_error(sh, "use flush, export (USB ready) or erase (err %d)", err);
+		}
+		return err;
+	}
+
+	tempo_log_get_stats(&s);
+	if (!s.ready) {
+		shell_print(sh, "tempo log not available");
+		return 0;
+	}
+	shell_print(sh, "boot %u, samples %u every %d ms, staged %u/%d bytes", s.boot, s.samples,
+		    TEMPO_LOG_PERIOD_MS, s.staged, TEMPO_LOG_BLOCK_SIZE);
+	shell_print(sh, "flash %u entries, %u bytes, flushes %u, rotations %u", s.entries,
+		    s.bytes, s.flushes, s.rotations);
+	shell_print(sh, "overruns %u, errors %u, write last %u us, max %u us, exported %u",
+		    s.overruns, s.errors, s.last_write_us, s.max_write_us, s.exported);
+	return 0;
+}
+
+SHELL_SUBCMD_ADD((midi), log, NULL, "Tempo log in flash [flush|export|erase]", cmd_midi_log, 1,
+		 1);
+#endif
+
+/* EOF */
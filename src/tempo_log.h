@@ -0,0 +1,113 @@
+/**
+ * @file tempo_log.h
+ * @brief Tempo history recorder in a flash circular log.
+ *
+ * The model is sampled every TEMPO_LOG_PERIOD_MS into a RAM staging
+ * block: one absolute sample in the block header, after that a record
+ * per sample with only the fields that changed, delta and varint
+ * encoded.  A steady tempo costs one byte per sample.
+ *
+ * A full block (or one older than TEMPO_LOG_FLUSH_S) is appended to an
+ * FCB in the tempo_log_partition as one entry by a low priority thread,
+ * while sampling goes on in the other staging block.  When the log is
+ * full the oldest sector is erased, it always holds the latest history.
+ *
+ * The log is exported over USB MIDI as SysEx, paced so the clock
+ * packets keep at least half of the USB TX queue.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260330
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef TEMPO_LOG_H
+#define TEMPO_LOG_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/toolchain.h>
+
+#define TEMPO_LOG_PERIOD_MS  CONFIG_TEMPO_LOG_PERIOD_MS
+#define TEMPO_LOG_BLOCK_SIZE CONFIG_TEMPO_LOG_BLOCK_SIZE
+#define TEMPO_LOG_FLUSH_S    CONFIG_TEMPO_LOG_FLUSH_S
+
+#define TEMPO_LOG_VERSION 1
+
+/*
+ * Record head byte, followed by a zigzag varint delta for every field
+ * bit that is set, in this order.
+ */
+#define TEMPO_LOG_HR           BIT(0)
+#define TEMPO_LOG_MEAS         BIT(1)
+#define TEMPO_LOG_PLL          BIT(2)
+#define TEMPO_LOG_FIELDS       (TEMPO_LOG_HR | TEMPO_LOG_MEAS | TEMPO_LOG_PLL)
+/* State at the sample, also in the header flags */
+#define TEMPO_LOG_HR_CONNECTED BIT(3)
+#define TEMPO_LOG_PLL_LOCKED   BIT(4)
+
+/* Start of every log entry, little endian */
+struct tempo_log_header {
+	uint8_t version;
+	uint8_t flags;
+	/* Counts boots, the timestamps are uptime */
+	uint16_t boot;
+	uint32_t t0_ms;
+	uint16_t period_ms;
+	/* Samples including the one in this header */
+	uint16_t samples;
+	/* Bytes used including this header, the entry may be padded */
+	uint16_t len;
+	/* Scaled BPM, hr is hr_sbpm or hr_bpm * 100 */
+	uint16_t hr_sbpm;
+	uint16_t meas_sbpm;
+	uint16_t pll_sbpm;
+} __packed;
+
+/* SysEx7 export: 0x7D (non commercial), type, 7 in 8 packed data */
+#define TEMPO_LOG_SYSEX_ID    0x7D
+#define TEMPO_LOG_SYSEX_ENTRY 0x10
+/* Last message of an export, the entry count as 2 x 7 bits */
+#define TEMPO_LOG_SYSEX_END   0x11
+
+struct tempo_log_stats {
+	bool ready;
+	uint16_t boot;
+	uint32_t samples;
+	/* Entries and bytes in flash */
+	uint32_t entries;
+	uint32_t bytes;
+	/* Staging block that is being filled */
+	uint32_t staged;
+	uint32_t flushes;
+	/* Oldest sector erased to make room */
+	uint32_t rotations;
+	/* Samples lost while both staging blocks were full */
+	uint32_t overruns;
+	uint32_t errors;
+	uint32_t last_write_us;
+	uint32_t max_write_us;
+	uint32_t exported;
+};
+
+/**
+ * @brief Write the staging block to flash now, thread context.
+ */
+void tempo_log_flush(void);
+
+/**
+ * @brief Stream the whole log over USB MIDI, in the background.
+ *
+ * Forwarded SysEx and the jitter stream are held off on group 0 until
+ * the export is done, see usb_midi_tx_sysex_hold().
+ *
+ * @return 0, -ENODEV when USB is not ready or -EBUSY during an export
+ */
+int tempo_log_export(void);
+
+/**
+ * @brief Erase the log.
+ */
+int tempo_log_erase(void);
+
+void tempo_log_get_stats(struct tempo_log_stats *stats);
+
+#endif /* TEMPO_LOG_H */
@@ -0,0 +1,85 @@
+/**
+ * @file tempo_slew.c
+ * @brief Glitch-free tempo ramping for the generated MIDI clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260221
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/spinlock.h>
+
+#include "tempo_slew.h"
+
+/* 24 pulses per quarter note */
+#define TEMPO_SLEW_PPQN 24
+
+static struct k_spinlock slew_lock;
+/* Tempos in Q16 scaled BPM */
+static int32_t current_q16;
+static int32_t target_q16;
+/* Signed increment per pulse, 0 when at the target */
+static int32_t step_q16;
+
+void tempo_slew_init(uint16_t sbpm)
+{
+	k_spinlock_key_t key = k_spin_lock(&slew_lock);
+
+	current_q16 = (int32_t)CLAMP(sbpm, TEMPO_SLEW_MIN_SBPM, TEMPO_SLEW_MAX_SBPM) << 16;
+	target_q16 = current_q16;
+	step_q16 = 0;
+	k_spin_unlock(&slew_lock, key);
+}
+
+void tempo_slew_set_target(uint16_t target_sbpm)
+{
+	/* The division is done here once, not in the clock callback */
+	int32_t step = ((int32_t)TEMPO_SLEW_SBPM_PER_BEAT << 16) / TEMPO_SLEW_PPQN;
+	k_spinlock_key_t key = k_spin_lock(&slew_lock);
+
+	target_q16 = (int32_t)CLAMP(target_sbpm, TEMPO_SLEW_MIN_SBPM, TEMPO_SLEW_MAX_SBPM) << 16;
+	if (target_q16 == current_q16) {
+		step_q16 = 0;
+	} else if (TEMPO_SLEW_SBPM_PER_BEAT == 0) {
+		/* Slewing disabled, the next pulse jumps */
+		step_q16 = target_q16 - current_q16;
+	} else {
+		step_q16 = (target_q16 > current_q16) ? step : -step;
+	}
+	k_spin_unlock(&slew_lock, key);
+}
+
+uint16_t tempo_slew_pulse(void)
+{
+	uint16_t ret = 0;
+	k_spinlock_key_t key = k_spin_lock(&slew_lock);
+
+	if (step_q16 != 0) {
+		int32_t before = current_q16 >> 16;
+
+		current_q16 += step_q16;
+		/* Do not run past the target */
+		if ((step_q16 > 0 && current_q16 >= target_q16) ||
+		    (step_q16 < 0 && current_q16 <= target_q16)) {
+			current_q16 = target_q16;
+			step_q16 = 0;
+		}
+		if ((current_q16 >> 16) != before) {
+			ret = (uint16_t)(current_q16 >> 16);
+		}
+	}
+	k_spin_unlock(&slew_lock, key);
+	return ret;
+}
+
+uint16_t tempo_slew_get_target(void)
+{
+	return (uint16_t)(target_q16 >> 16);
+}
+
+uint16_t tempo_slew_get_current(void)
+{
+	return (uint16_t)(current_q16 >> 16);
+}
+
+/* EOF */
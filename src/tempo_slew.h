@@ -0,0 +1,50 @@
+/**
+ * @file tempo_slew.h
+ * @brief Glitch-free tempo ramping for the generated MIDI clock.
+ *
+ * A new target tempo is not applied in one step, the clock callback moves
+ * the generated tempo towards it a little on every 24pqn pulse.  The per
+ * pulse increment is computed when the target is set so the callback
+ * only adds and compares.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260221
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef TEMPO_SLEW_H
+#define TEMPO_SLEW_H
+#include <stdint.h>
+
+/* Maximum tempo change per beat in scaled BPM (0 = jump) */
+#define TEMPO_SLEW_SBPM_PER_BEAT CONFIG_TEMPO_SLEW_SBPM_PER_BEAT
+
+/* Tempos are clamped to 20 --> 300 BPM, the range of tempo_est */
+#define TEMPO_SLEW_MIN_SBPM 2000
+#define TEMPO_SLEW_MAX_SBPM 30000
+
+/**
+ * @brief Start at a tempo without ramping.
+ *
+ * @param sbpm Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ */
+void tempo_slew_init(uint16_t sbpm);
+
+/**
+ * @brief Set a new target tempo, thread context.
+ *
+ * Clamped to TEMPO_SLEW_MIN_SBPM..TEMPO_SLEW_MAX_SBPM like the start
+ * tempo, which also keeps the Q16 value within an int32_t.
+ */
+void tempo_slew_set_target(uint16_t target_sbpm);
+
+/**
+ * @brief Advance one 24pqn pulse, call from the clock callback.
+ *
+ * @return the new tempo to program or 0 when it did not change
+ */
+uint16_t tempo_slew_pulse(void);
+
+uint16_t tempo_slew_get_target(void);
+uint16_t tempo_slew_get_current(void);
+
+#endif /* TEMPO_SLEW_H */
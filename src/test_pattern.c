@@ -0,0 +1,67 @@
+/**
+ * @brief MIDI 1.0 serial test pattern thread.
+ *
+ * Sends an initial note and then a repeating pattern of CC and notes on
+ * the serial MIDI output.  It runs in its own low priority thread so its
+ * sleeps can never delay the tempo updates in main().  The messages go
+ * through 'midi1_tx_sched.h' so they are on the beat of the generated
+ * clock.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260220
+ *
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+/* This is the MIDI module at: https://github.com/jw-smaal/zephyr-midi1  */
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "midi1_tx_sched.h"
+
+LOG_MODULE_REGISTER(midi1_test_pattern, CONFIG_LOG_DEFAULT_LEVEL);
+
+/* Ticks of the generated 24pqn clock */
+#define PQN_BEAT   24
+#define PQN_EIGHTH 12
+#define PQN_BAR    (4 * PQN_BEAT)
+
+void midi1_test_pattern_thread(void)
+{
+	/* Everything is queued on the ticks of the generated clock */
+	uint32_t t = midi1_tx_sched_now() + PQN_BEAT;
+
+	LOG_INF("MIDI1 sending initial note...");
+	midi1_tx_note_on(t, CH16, 1, 60);
+	midi1_tx_note_off(t + PQN_EIGHTH, CH16, 1, 60);
+	t += PQN_BEAT;
+
+	while (1) {
+		t += 2 * PQN_BAR;
+
+		/* Test Pattern Logic */
+		for (uint8_t value = 0; value < 16; value++) {
+			midi1_tx_control_change(t, CH16, 1, value);
+			t += PQN_EIGHTH;
+		}
+		for (uint8_t value = 60; value < 66; value++) {
+			midi1_tx_note_on(t, CH7, value, 100);
+			t += PQN_EIGHTH;
+		}
+		for (uint8_t value = 60; value < 66; value++) {
+			midi1_tx_note_off(t, CH7, value, 100);
+		}
+
+		/* Stay about a bar ahead of the clock, whatever its tempo */
+		while ((int32_t)(t - midi1_tx_sched_now()) > PQN_BAR) {
+			k_sleep(K_MSEC(100));
+		}
+	}
+	return;
+}
+/* Lowest priority of the application threads */
+K_THREAD_DEFINE(midi1_test_pattern_tid, 1024, midi1_test_pattern_thread, NULL, NULL, NULL, 10, 0,
+		0);
+
+/* EOF */
@@ -0,0 +1,469 @@
+/**
+ * @file usb_midi_tx.c
+ * @brief Deferred USB MIDI 2.0 UMP transmission.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260302
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/counter.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/usb/class/usbd_midi2.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+
+#include "midi1_sysex.h"
+#include "usb_midi_tx.h"
+
+LOG_MODULE_REGISTER(usb_midi_tx, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*
+ * Timestamps come from the free running counter of the clock measurement
+ * (the same one the pulse ingest uses), the generator counter is
+ * reprogrammed by gen_sbpm() on every tempo change.
+ */
+static const struct device *const tx_counter =
+	DEVICE_DT_GET(DT_PHANDLE(DT_NODELABEL(midi1_clock_meas_cntr), counter));
+
+enum usb_midi_tx_kind {
+	TX_UMP = 0,
+	/* Preceded by a JR Timestamp of 'ticks' */
+	TX_UMP_TIMESTAMPED,
+	/* Set Tempo of the pending tempo, the packet is formatted by the thread */
+	TX_TEMPO,
+	/* A SysEx buffer, split in Data 64 packets by the thread */
+	TX_SYSEX,
+};
+
+struct usb_midi_tx_item {
+	struct midi_ump ump;
+	/* Reference held by the queue, only used for TX_SYSEX */
+	struct midi1_sysex *sysex;
+	/* Counter value when queued, only used for TX_UMP_TIMESTAMPED */
+	uint32_t ticks;
+	uint8_t kind;
+};
+
+K_MSGQ_DEFINE(usb_midi_tx_q, sizeof(struct usb_midi_tx_item), USB_MIDI_TX_QUEUE_SIZE, 4);
+
+static const struct device *tx_dev;
+static uint8_t block_group[USB_MIDI_TX_MAX_BLOCKS];
+static atomic_t block_mode[USB_MIDI_TX_MAX_BLOCKS];
+static size_t num_blocks;
+/* Latest generated tempo and whether a TX_TEMPO item is queued for it */
+static atomic_t pending_sbpm;
+static atomic_t tempo_queued;
+static atomic_t tx_ready = ATOMIC_INIT(0);
+/* A multi packet SysEx7 sender owns the first block */
+static atomic_t sysex_hold;
+static uint32_t counter_top = UINT32_MAX;
+/* JR ticks per counter tick in Q32, 31250 / 24 MHz is about 0.0013 */
+static uint64_t jr_mult_q32;
+
+static atomic_t stat_queued;
+static atomic_t stat_dropped;
+static uint32_t stat_sent;
+static uint32_t stat_errors;
+static uint32_t stat_max_batch;
+static uint32_t stat_sysex;
+static atomic_t stat_sysex_truncated;
+static atomic_t stat_sysex_held;
+
+int usb_midi_tx_init(const struct device *usb_midi, const uint8_t *groups, size_t blocks)
+{
+	if (blocks > USB_MIDI_TX_MAX_BLOCKS) {
+		return -EINVAL;
+	}
+	if (!device_is_ready(tx_counter)) {
+		return -ENODEV;
+	}
+	for (size_t i = 0; i < blocks; i++) {
+		block_group[i] = groups[i];
+		atomic_set(&block_mode[i], CONFIG_USB_MIDI_TEMPO_MODE);
+	}
+	num_blocks = blocks;
+	counter_top = counter_get_top_value(tx_counter);
+	jr_mult_q32 = ((uint64_t)UMP_JR_TICKS_PER_S << 32) / counter_get_frequency(tx_counter);
+	tx_dev = usb_midi;
+	return 0;
+}
+
+void usb_midi_tx_set_ready(bool ready)
+{
+	atomic_set(&tx_ready, ready ? 1 : 0);
+	if (ready) {
+		/* The host has no tempo yet */
+		usb_midi_tx_tempo((uint16_t)atomic_get(&pending_sbpm));
+	}
+}
+
+bool usb_midi_tx_is_ready(void)
+{
+	return tx_dev != NULL && atomic_get(&tx_ready);
+}
+
+int usb_midi_tx_set_tempo_mode(size_t block, enum usb_midi_tempo_mode mode)
+{
+	if (block >= num_blocks || mode > USB_MIDI_TEMPO_BOTH) {
+		return -EINVAL;
+	}
+	atomic_set(&block_mode[block], mode);
+	/* A block that just switched to Set Tempo wants the current tempo */
+	usb_midi_tx_tempo((uint16_t)atomic_get(&pending_sbpm));
+	return 0;
+}
+
+enum usb_midi_tempo_mode usb_midi_tx_get_tempo_mode(size_t block)
+{
+	if (block >= num_blocks) {
+		return USB_MIDI_TEMPO_CLOCK;
+	}
+	return (enum usb_midi_tempo_mode)atomic_get(&block_mode[block]);
+}
+
+uint8_t usb_midi_tx_get_group(size_t block)
+{
+	return block < num_blocks ? block_group[block] : 0;
+}
+
+static int tx_put(const struct usb_midi_tx_item *item)
+{
+	if (k_msgq_put(&usb_midi_tx_q, item, K_NO_WAIT)) {
+		atomic_inc(&stat_dropped);
+		return -ENOBUFS;
+	}
+	atomic_inc(&stat_queued);
+	return 0;
+}
+
+int usb_midi_tx_send(const struct midi_ump ump)
+{
+	struct usb_midi_tx_item item = {
+		.ump = ump,
+	};
+
+	return tx_put(&item);
+}
+
+int usb_midi_tx_send_timestamped(const struct midi_ump ump)
+{
+	struct usb_midi_tx_item item = {
+		.ump = ump,
+	};
+
+	if (IS_ENABLED(CONFIG_USB_MIDI_TX_JR_TIMESTAMP)) {
+		(void)counter_get_value(tx_counter, &item.ticks);
+		item.kind = TX_UMP_TIMESTAMPED;
+	}
+	return tx_put(&item);
+}
+
+int usb_midi_tx_sysex(struct midi1_sysex *msg)
+{
+	struct usb_midi_tx_item item = {
+		.sysex = msg,
+		.kind = TX_SYSEX,
+	};
+
+	if (!usb_midi_tx_is_ready() || num_blocks == 0) {
+		return -ENODEV;
+	}
+	if (msg->flags & MIDI1_SYSEX_TRUNCATED) {
+		atomic_inc(&stat_sysex_truncated);
+		return -EINVAL;
+	}
+	if (usb_midi_tx_sysex_held()) {
+		return -EBUSY;
+	}
+	return tx_put(&item);
+}
+
+int usb_midi_tx_sysex_hold(void)
+{
+	return atomic_cas(&sysex_hold, 0, 1) ? 0 : -EBUSY;
+}
+
+void usb_midi_tx_sysex_unhold(void)
+{
+	atomic_clear(&sysex_hold);
+}
+
+bool usb_midi_tx_sysex_held(void)
+{
+	if (!atomic_get(&sysex_hold)) {
+		return false;
+	}
+	atomic_inc(&stat_sysex_held);
+	return true;
+}
+
+void usb_midi_tx_clock(void)
+{
+	for (size_t i = 0; i < num_blocks; i++) {
+		if (atomic_get(&block_mode[i]) == USB_MIDI_TEMPO_SET_TEMPO) {
+			continue;
+		}
+		usb_midi_tx_send_timestamped(
+			UMP_SYS_RT_COMMON(block_group[i], UMP_SYS_TIMING_CLOCK, 0, 0));
+	}
+}
+
+void usb_midi_tx_tempo(uint16_t sbpm)
+{
+	struct usb_midi_tx_item item = {
+		.kind = TX_TEMPO,
+	};
+
+	if (sbpm == 0) {
+		return;
+	}
+	atomic_set(&pending_sbpm, sbpm);
+	/* One queued item is enough, it picks up the latest value */
+	if (atomic_cas(&tempo_queued, 0, 1) && tx_put(&item)) {
+		atomic_clear(&tempo_queued);
+	}
+}
+
+uint32_t usb_midi_tx_free(void)
+{
+	return k_msgq_num_free_get(&usb_midi_tx_q);
+}
+
+void usb_midi_tx_get_stats(struct usb_midi_tx_stats *stats)
+{
+	stats->queued = (uint32_t)atomic_get(&stat_queued);
+	stats->dropped = (uint32_t)atomic_get(&stat_dropped);
+	stats->sent = stat_sent;
+	stats->errors = stat_errors;
+	stats->max_batch = stat_max_batch;
+	stats->sysex = stat_sysex;
+	stats->sysex_truncated = (uint32_t)atomic_get(&stat_sysex_truncated);
+	stats->sysex_held = (uint32_t)atomic_get(&stat_sysex_held);
+}
+
+/*
+ * JR timestamp of a counter value.  The JR clock is kept as a Q32
+ * accumulator advanced by the counter interval so the fraction is never
+ * lost and the 16 bit JR value wraps as it should (every 2.1 s).
+ */
+static uint16_t jr_timestamp(uint32_t ticks)
+{
+	static uint64_t jr_acc_q32;
+	static uint32_t last_ticks;
+	static bool have_last;
+	uint32_t delta;
+
+	if (have_last) {
+		if (ticks >= last_ticks || counter_top == UINT32_MAX) {
+			delta = ticks - last_ticks;
+		} else {
+			delta = ticks + (counter_top - last_ticks) + 1U;
+		}
+		jr_acc_q32 += (uint64_t)delta * jr_mult_q32;
+	}
+	last_ticks = ticks;
+	have_last = true;
+
+	return (uint16_t)(jr_acc_q32 >> 32);
+}
+
+/* Set Tempo of the pending tempo to every block that wants it */
+static uint32_t tx_tempo(void)
+{
+	static uint16_t sent_sbpm;
+	uint32_t sent = 0;
+	uint16_t sbpm;
+	uint32_t tempo_10ns;
+
+	atomic_clear(&tempo_queued);
+	sbpm = (uint16_t)atomic_get(&pending_sbpm);
+	if (sbpm == 0) {
+		return 0;
+	}
+	tempo_10ns = (uint32_t)((UMP_TEMPO_10NS_PER_SBPM + sbpm / 2U) / sbpm);
+
+	for (size_t i = 0; i < num_blocks; i++) {
+		if (atomic_get(&block_mode[i]) == USB_MIDI_TEMPO_CLOCK) {
+			continue;
+		}
+		if (usbd_midi_send(tx_dev, UMP_FLEX_SET_TEMPO_MSG(block_group[i], tempo_10ns))) {
+			stat_errors++;
+			continue;
+		}
+		stat_sent++;
+		sent++;
+	}
+	if (sent) {
+		LOG_DBG("Set Tempo %u sbpm (%u x 10ns), previous %u", sbpm, tempo_10ns, sent_sbpm);
+		sent_sbpm = sbpm;
+	}
+	return sent;
+}
+
+/*
+ * SysEx7 in Data 64 packets straight from the pool buffer, then the
+ * buffer is released.  A message without data bytes is one empty
+ * complete packet.
+ */
+static uint32_t tx_sysex(struct midi1_sysex *msg)
+{
+	uint32_t sent = 0;
+	uint16_t off = 0;
+
+	do {
+		uint8_t b[UMP_DATA64_BYTES] = {0};
+		uint8_t n = (uint8_t)MIN(msg->len - off, UMP_DATA64_BYTES);
+		bool first = off == 0;
+		bool last = off + n >= msg->len;
+		uint8_t status = first ? (last ? UMP_DATA64_COMPLETE : UMP_DATA64_START)
+				       : (last ? UMP_DATA64_END : UMP_DATA64_CONTINUE);
+		struct midi_ump ump;
+
+		memcpy(b, &msg->data[off], n);
+		ump = (struct midi_ump){
+			.data = {(UMP_MT_DATA_64 << 28) | ((block_group[0] & 0x0f) << 24) |
+					 (status << 20) | (n << 16) | (b[0] << 8) | b[1],
+				 ((uint32_t)b[2] << 24) | (b[3] << 16) | (b[4] << 8) | b[5]},
+		};
+		if (usbd_midi_send(tx_dev, ump)) {
+			/* The rest would be a broken message, stop here */
+			stat_errors++;
+			break;
+		}
+		stat_sent++;
+		sent++;
+		off += n;
+	} while (off < msg->len);
+
+	if (off >= msg->len) {
+		stat_sysex++;
+	}
+	midi1_sysex_release(msg);
+	return sent;
+}
+
+static bool tx_one(const struct usb_midi_tx_item *item)
+{
+	if (item->kind == TX_TEMPO) {
+		return tx_tempo() > 0;
+	}
+	if (item->kind == TX_SYSEX) {
+		return tx_sysex(item->sysex) > 0;
+	}
+	if (item->kind == TX_UMP_TIMESTAMPED) {
+		if (usbd_midi_send(tx_dev, UMP_JR_TIMESTAMP(jr_timestamp(item->ticks)))) {
+			stat_errors++;
+			return false;
+		}
+		stat_sent++;
+	}
+	if (usbd_midi_send(tx_dev, item->ump)) {
+		stat_errors++;
+		return false;
+	}
+	stat_sent++;
+	return true;
+}
+
+/* ---------------------------- THREADS ------------------------------------ */
+
+/*
+ * Wait for the first packet, then hand everything that is queued to the
+ * class in one go.  usbd_midi_send() only copies into the class TX
+ * buffer, packets sent back to back end up in the same USB transfer.
+ */
+void usb_midi_tx_thread(void)
+{
+	struct usb_midi_tx_item item;
+
+	while (1) {
+		uint32_t batch = 0;
+
+		k_msgq_get(&usb_midi_tx_q, &item, K_FOREVER);
+		do {
+			if (!usb_midi_tx_is_ready()) {
+				/* Nobody is listening, keep the JR clock running */
+				if (item.kind == TX_UMP_TIMESTAMPED) {
+					(void)jr_timestamp(item.ticks);
+				} else if (item.kind == TX_TEMPO) {
+					atomic_clear(&tempo_queued);
+				} else if (item.kind == TX_SYSEX) {
+					midi1_sysex_release(item.sysex);
+				}
+				continue;
+			}
+			if (tx_one(&item)) {
+				batch++;
+			}
+		} while (k_msgq_get(&usb_midi_tx_q, &item, K_NO_WAIT) == 0);
+
+		if (batch > stat_max_batch) {
+			stat_max_batch = batch;
+		}
+	}
+}
+
+/* Just below the MIDI1 receive thread */
+K_THREAD_DEFINE(usb_midi_tx_tid, 1024, usb_midi_tx_thread, NULL, NULL, NULL, 2, 0, 0);
+
+/* ---------------------------- SHELL -------------------------------------- */
+#ifdef CONFIG_SHELL
+static const char *const tempo_mode_names[] = {
+	[USB_MIDI_TEMPO_CLOCK] = "clock",
+	[USB_MIDI_TEMPO_SET_TEMPO] = "tempo",
+	[USB_MIDI_TEMPO_BOTH] = "both",
+};
+
+static int cmd_midi_usb(const struct shell *sh, size_t argc, char **argv)
+{
+	struct usb_midi_tx_stats st;
+
+	usb_midi_tx_get_stats(&st);
+	shell_print(sh, "USB MIDI %s, queue %u/%d free", usb_midi_tx_is_ready() ? "ready" : "not ready",
+		    usb_midi_tx_free(), USB_MIDI_TX_QUEUE_SIZE);
+	shell_print(sh, "queued %u, sent %u, dropped %u, errors %u, max batch %u", st.queued,
+		    st.sent, st.dropped, st.errors, st.max_batch);
+	shell_print(sh, "sysex %u, truncated %u, held %u", st.sysex, st.sysex_truncated,
+		    st.sysex_held);
+	for (size_t i = 0; i < num_blocks; i++) {
+		shell_print(sh, "  block %u group %u: %s", (unsigned int)i, block_group[i],
+			    tempo_mode_names[usb_midi_tx_get_tempo_mode(i)]);
+	}
+	return 0;
+}
+
+static int cmd_midi_usb_tempo(const struct shell *sh, size_t argc, char **argv)
+{
+	char *end;
+	unsigned long block = strtoul(argv[1], &end, 10);
+
+	for (size_t m = 0; m < ARRAY_SIZE(tempo_mode_names); m++) {
+		if (strcmp(argv[2], tempo_mode_names[m]) != 0) {
+			continue;
+		}
+		if (*end != '\0' || usb_midi_tx_set_tempo_mode(block, (enum usb_midi_tempo_mode)m)) {
+			shell_error(sh, "block 0..%d", (int)num_blocks - 1);
+			return -EINVAL;
+		}
+		shell_print(sh, "block %lu: %s", block, argv[2]);
+		return 0;
+	}
+	shell_error(sh, "use clock (24pqn), tempo (Set Tempo) or both");
+	return -EINVAL;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(midi_usb_cmds,
+	SHELL_CMD_ARG(tempo, NULL, "How a function block gets the tempo <block> <clock|tempo|both>",
+		      cmd_midi_usb_tempo, 3, 0),
+	SHELL_SUBCMD_SET_END);
+
+SHELL_SUBCMD_ADD((midi), usb, &midi_usb_cmds, "USB MIDI TX statistics and function blocks",
+		 cmd_midi_usb, 1, 0);
+#endif
+
+/* EOF */
@@ -0,0 +1,265 @@
+/**
+ * @file usb_midi_tx.h
+ * @brief Deferred USB MIDI 2.0 UMP transmission.
+ *
+ * Timing sensitive code (the 24pqn counter callback) only puts packets in
+ * a message queue, a TX thread hands them to usbd_midi_send() back to
+ * back so the class sends them together in one USB transfer.  A clock can
+ * be preceded by a UMP JR Timestamp taken from the counter when it was
+ * queued, a host uses it to rebuild the pulse timing no matter in which
+ * USB frame the packets arrive.
+ *
+ * Per function block (group terminal block in the devicetree) the tempo
+ * is sent as 24pqn clocks, as UMP Flex Data Set Tempo messages or both.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260302
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef USB_MIDI_TX_H
+#define USB_MIDI_TX_H
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <zephyr/device.h>
+#include <zephyr/audio/midi.h>
+
+/* Number of packets the callback can queue ahead of the TX thread */
+#define USB_MIDI_TX_QUEUE_SIZE 32
+
+/* UMP utility message (MT 0x0) JR Timestamp, 1/31250 s units */
+#define UMP_UTILITY_JR_TIMESTAMP 0x2
+#define UMP_JR_TICKS_PER_S       31250U
+
+#define UMP_JR_TIMESTAMP(ts)                                                                        \
+	(struct midi_ump)                                                                          \
+	{                                                                                          \
+		.data = {(UMP_MT_UTILITY << 28) | (UMP_UTILITY_JR_TIMESTAMP << 20) |               \
+			 ((ts) & 0xffff)}                                                          \
+	}
+
+/* UMP Flex Data (MT 0xD) Set Tempo, status bank 0x00 status 0x00 */
+#define UMP_FLEX_FORMAT_COMPLETE 0x0
+#define UMP_FLEX_ADDRS_GROUP     0x1
+#define UMP_FLEX_BANK_SETUP      0x00
+#define UMP_FLEX_SET_TEMPO       0x00
+
+/* Set Tempo is in 10 ns units per quarter note, 60 s / 10 ns * 100 */
+#define UMP_TEMPO_10NS_PER_SBPM 600000000000ULL
+
+#define UMP_FLEX_SET_TEMPO_MSG(group, tempo_10ns)                                                   \
+	(struct midi_ump)                                                                          \
+	{                                                                                          \
+		.data = {(UMP_MT_FLEX_DATA << 28) | (((group) & 0x0f) << 24) |                    \
+				 (UMP_FLEX_FORMAT_COMPLETE << 22) | (UMP_FLEX_ADDRS_GROUP << 20) | \
+				 (UMP_FLEX_BANK_SETUP << 8) | UMP_FLEX_SET_TEMPO,                  \
+			 (tempo_10ns), 0, 0}                                                       \
+	}
+
+/* UMP Data 64 (MT 0x3) SysEx7, up to 6 bytes per packet */
+#define UMP_DATA64_COMPLETE 0x0
+#define UMP_DATA64_START    0x1
+#define UMP_DATA64_CONTINUE 0x2
+#define UMP_DATA64_END      0x3
+#define UMP_DATA64_BYTES    6
+
+/* Function blocks on the USB MIDI device, one per group terminal block */
+#define USB_MIDI_TX_MAX_BLOCKS 4
+
+enum usb_midi_tempo_mode {
+	/* 24pqn timing clocks only (MIDI 1.0 style) */
+	USB_MIDI_TEMPO_CLOCK = 0,
+	/* Only a Set Tempo when the generated tempo changes */
+	USB_MIDI_TEMPO_SET_TEMPO,
+	USB_MIDI_TEMPO_BOTH,
+};
+
+struct usb_midi_tx_stats {
+	uint32_t queued;
+	uint32_t sent;
+	/* Queue full, counted in the callback */
+	uint32_t dropped;
+	/* usbd_midi_send() failed */
+	uint32_t errors;
+	/* Largest number of packets sent back to back */
+	uint32_t max_batch;
+	/* SysEx messages forwarded, and left out because they were truncated */
+	uint32_t sysex;
+	uint32_t sysex_truncated;
+	/* SysEx messages and jitter records left out while held */
+	uint32_t sysex_held;
+};
+
+struct midi1_sysex;
+
+#ifdef CONFIG_USBD_MIDI2_CLASS
+/**
+ * @brief Set the USB MIDI device and prepare the timestamp counter.
+ *
+ * @param groups first UMP group of every function block
+ * @param num_blocks number of entries in groups
+ * @return 0, -EINVAL for too many blocks or -ENODEV when the counter is
+ *         not ready
+ */
+int usb_midi_tx_init(const struct device *usb_midi, const uint8_t *groups, size_t num_blocks);
+
+/**
+ * @brief Select how a function block receives the tempo.
+ *
+ * @return 0 or -EINVAL for an unknown block
+ */
+int usb_midi_tx_set_tempo_mode(size_t block, enum usb_midi_tempo_mode mode);
+enum usb_midi_tempo_mode usb_midi_tx_get_tempo_mode(size_t block);
+
+/**
+ * @brief First UMP group of a function block, 0 for an unknown block.
+ */
+uint8_t usb_midi_tx_get_group(size_t block);
+
+/**
+ * @brief The device reports ready/not ready, call from ready_cb.
+ *
+ * Packets queued while not ready are discarded by the TX thread.
+ */
+void usb_midi_tx_set_ready(bool ready);
+bool usb_midi_tx_is_ready(void);
+
+/**
+ * @brief Queue a packet, never blocks so it is ISR safe.
+ *
+ * @return 0 or -ENOBUFS when the queue was full (counted as drop)
+ */
+int usb_midi_tx_send(const struct midi_ump ump);
+
+/**
+ * @brief Queue a packet preceded by a JR Timestamp of right now, ISR safe.
+ *
+ * Without CONFIG_USB_MIDI_TX_JR_TIMESTAMP this is usb_midi_tx_send().
+ */
+int usb_midi_tx_send_timestamped(const struct midi_ump ump);
+
+/**
+ * @brief Forward a received SysEx as UMP Data 64 packets on the first block.
+ *
+ * The TX thread takes over the reference of the caller and releases it
+ * when the packets are sent.  A truncated message is not forwarded, the
+ * host would act on a mangled message.
+ *
+ * @return 0, -ENODEV when the device is not ready, -EINVAL for a
+ *         truncated message or -ENOBUFS; the caller keeps its reference
+ *         on an error
+ */
+int usb_midi_tx_sysex(struct midi1_sysex *msg);
+
+/**
+ * @brief Keep other SysEx7 off the first block, for a multi packet sender.
+ *
+ * UMP does not allow the packets of two SysEx7 messages on one group to
+ * interleave.  While held usb_midi_tx_sysex() returns -EBUSY and
+ * usb_midi_tx_sysex_held() tells the jitter stream to leave out its
+ * records, a forwarded message already queued is sent before the
+ * packets of the holder.
+ *
+ * @return 0 or -EBUSY when somebody else holds it
+ */
+int usb_midi_tx_sysex_hold(void);
+void usb_midi_tx_sysex_unhold(void);
+
+/**
+ * @brief Held or not, ISR safe.  True counts the message of the caller
+ * as left out.
+ */
+bool usb_midi_tx_sysex_held(void);
+
+/**
+ * @brief One 24pqn pulse, call from the clock callback.
+ *
+ * Queues a timestamped timing clock for every block that wants clocks.
+ */
+void usb_midi_tx_clock(void);
+
+/**
+ * @brief The generated tempo changed, ISR safe.
+ *
+ * Only the latest value is kept, the TX thread formats the Set Tempo
+ * for every block that wants it, so a ramp sends no more than the TX
+ * thread can keep up with.
+ *
+ * @param sbpm Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ */
+void usb_midi_tx_tempo(uint16_t sbpm);
+
+/**
+ * @brief Free entries in the TX queue, for senders that pace themselves.
+ */
+uint32_t usb_midi_tx_free(void);
+
+void usb_midi_tx_get_stats(struct usb_midi_tx_stats *stats);
+
+#else
+/* Without the USB MIDI2.0 class nothing is ever ready and nothing is sent */
+static inline int usb_midi_tx_init(const struct device *usb_midi, const uint8_t *groups,
+				   size_t num_blocks)
+{
+	return -ENODEV;
+}
+static inline int usb_midi_tx_set_tempo_mode(size_t block, enum usb_midi_tempo_mode mode)
+{
+	return -EINVAL;
+}
+static inline enum usb_midi_tempo_mode usb_midi_tx_get_tempo_mode(size_t block)
+{
+	return USB_MIDI_TEMPO_CLOCK;
+}
+static inline uint8_t usb_midi_tx_get_group(size_t block)
+{
+	return 0;
+}
+static inline void usb_midi_tx_set_ready(bool ready)
+{
+}
+static inline bool usb_midi_tx_is_ready(void)
+{
+	return false;
+}
+static inline int usb_midi_tx_send(const struct midi_ump ump)
+{
+	return -ENODEV;
+}
+static inline int usb_midi_tx_send_timestamped(const struct midi_ump ump)
+{
+	return -ENODEV;
+}
+static inline int usb_midi_tx_sysex(struct midi1_sysex *msg)
+{
+	return -ENODEV;
+}
+static inline int usb_midi_tx_sysex_hold(void)
+{
+	return 0;
+}
+static inline void usb_midi_tx_sysex_unhold(void)
+{
+}
+static inline bool usb_midi_tx_sysex_held(void)
+{
+	return false;
+}
+static inline void usb_midi_tx_clock(void)
+{
+}
+static inline void usb_midi_tx_tempo(uint16_t sbpm)
+{
+}
+static inline uint32_t usb_midi_tx_free(void)
+{
+	return 0;
+}
+static inline void usb_midi_tx_get_stats(struct usb_midi_tx_stats *stats)
+{
+	*stats = (struct usb_midi_tx_stats){0};
+}
+#endif /* CONFIG_USBD_MIDI2_CLASS */
+
+#endif /* USB_MIDI_TX_H */
@@ -0,0 +1,26 @@
+#!/usr/bin/env bash
+# Build the application and the scripted heart rate sensor for nrf52_bsim
+# and put both in ${BSIM_OUT_PATH}/bin.
+#
+# SPDX-License-Identifier: Apache-2.0
+set -ue
+
+: "${ZEPHYR_BASE:?ZEPHYR_BASE must be set to point to the zephyr root directory}"
+: "${BSIM_OUT_PATH:?BSIM_OUT_PATH must be defined}"
+
+here="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+app_root="$(cd "${here}/../../.." && pwd)"
+board="${BOARD:-nrf52_bsim}"
+build_dir="${here}/build"
+
+west build -p always -b "${board}" -d "${build_dir}/central" "${app_root}" -- \
+	-DCONF_FILE="${here}/prj_bench.conf" \
+	-DDTC_OVERLAY_FILE="${here}/nrf52_bsim.overlay"
+cp "${build_dir}/central/zephyr/zephyr.exe" \
+	"${BSIM_OUT_PATH}/bin/bs_${board}_midi_bench_central"
+
+west build -p always -b "${board}" -d "${build_dir}/hrs" "${here}/hrs_peripheral"
+cp "${build_dir}/hrs/zephyr/zephyr.exe" \
+	"${BSIM_OUT_PATH}/bin/bs_${board}_midi_bench_hrs"
+
+# EOF
@@ -0,0 +1,149 @@
+/**
+ * @file main.c
+ * @brief Scripted heart rate sensor for the pipeline benchmark.
+ *
+ * A Heart Rate Service with RR intervals that plays a fixed script of
+ * load levels: a steady heart rate, a ramp, faster notifications and
+ * motion spikes.  The start of every level is printed as a "LOAD" line
+ * so the benchmark can put the "BENCH" lines of the central in context.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260401
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/uuid.h>
+
+/* HRS flags: 8 bit value, RR intervals present */
+#define HRM_FLAGS_RR 0x10
+/* RR intervals are in 1/1024 s */
+#define RR_UNITS_PER_S 1024
+
+struct load_level {
+	const char *name;
+	uint32_t duration_s;
+	uint16_t from_bpm;
+	uint16_t to_bpm;
+	uint16_t notify_ms;
+	/* Every n-th beat is a motion artefact of half the interval, 0 = none */
+	uint16_t spike_every;
+};
+
+static const struct load_level script[] = {
+	{"steady", 30, 70, 70, 1000, 0},
+	{"ramp", 30, 70, 150, 1000, 0},
+	{"fast", 30, 150, 150, 250, 0},
+	{"spikes", 30, 150, 100, 1000, 5},
+	{"steady_end", 30, 100, 100, 1000, 0},
+};
+
+static struct bt_conn *conn;
+static bool notify_on;
+
+static void hrm_ccc_changed(const struct bt_gatt_attr *attr, uint16_t value)
+{
+	notify_on = value == BT_GATT_CCC_NOTIFY;
+}
+
+BT_GATT_SERVICE_DEFINE(hrs_svc, BT_GATT_PRIMARY_SERVICE(BT_UUID_HRS),
+		       BT_GATT_CHARACTERISTIC(BT_UUID_HRS_MEASUREMENT, BT_GATT_CHRC_NOTIFY,
+					      BT_GATT_PERM_NONE, NULL, NULL, NULL),
+		       BT_GATT_CCC(hrm_ccc_changed, BT_GATT_PERM_READ | BT_GATT_PERM_WRITE));
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA_BYTES(BT_DATA_UUID16_ALL, BT_UUID_16_ENCODE(BT_UUID_HRS_VAL)),
+};
+
+static void connected(struct bt_conn *c, uint8_t err)
+{
+	if (!err) {
+		conn = bt_conn_ref(c);
+	}
+}
+
+static void disconnected(struct bt_conn *c, uint8_t reason)
+{
+	if (conn) {
+		bt_conn_unref(conn);
+		conn = NULL;
+	}
+	notify_on = false;
+}
+
+/* Advertise again once the connection object is free */
+static void recycled(void)
+{
+	(void)bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), NULL, 0);
+}
+
+BT_CONN_CB_DEFINE(conn_callbacks) = {
+	.connected = connected,
+	.disconnected = disconnected,
+	.recycled = recycled,
+};
+
+/* Heart rate of a level at ms into it, linear from from_bpm to to_bpm */
+static uint16_t level_bpm(const struct load_level *l, uint32_t ms)
+{
+	int32_t span = (int32_t)l->to_bpm - l->from_bpm;
+
+	return (uint16_t)(l->from_bpm + (span * (int32_t)ms) / (int32_t)(l->duration_s * 1000U));
+}
+
+static void notify(uint16_t bpm, uint16_t rr)
+{
+	uint8_t buf[4] = {HRM_FLAGS_RR, (uint8_t)MIN(bpm, UINT8_MAX)};
+
+	sys_put_le16(rr, &buf[2]);
+	if (conn && notify_on) {
+		(void)bt_gatt_notify(conn, &hrs_svc.attrs[2], buf, sizeof(buf));
+	}
+}
+
+int main(void)
+{
+	uint32_t beats = 0;
+	int err;
+
+	err = bt_enable(NULL);
+	if (err) {
+		printk("Bluetooth init failed (err %d)\n", err);
+		return err;
+	}
+	err = bt_le_adv_start(BT_LE_ADV_CONN_FAST_1, ad, ARRAY_SIZE(ad), NULL, 0);
+	if (err) {
+		printk("Advertising failed (err %d)\n", err);
+		return err;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(script); i++) {
+		const struct load_level *l = &script[i];
+		uint32_t start = k_uptime_get_32();
+
+		printk("LOAD level=%u name=%s t_ms=%u from_bpm=%u to_bpm=%u notify_ms=%u\n",
+		       (uint32_t)i, l->name, start, l->from_bpm, l->to_bpm, l->notify_ms);
+
+		while (k_uptime_get_32() - start < l->duration_s * 1000U) {
+			uint16_t bpm = level_bpm(l, k_uptime_get_32() - start);
+			uint16_t rr = (uint16_t)((60U * RR_UNITS_PER_S) / bpm);
+
+			if (l->spike_every && (++beats % l->spike_every) == 0) {
+				/* A missed or doubled beat as a chest strap sees it when moving */
+				rr /= 2U;
+			}
+			notify(bpm, rr);
+			k_msleep(l->notify_ms);
+		}
+	}
+	printk("LOAD level=end t_ms=%u\n", k_uptime_get_32());
+	return 0;
+}
+
+/* EOF */
@@ -0,0 +1,91 @@
+#!/usr/bin/env bash
+# End to end benchmark of the heart rate to MIDI clock pipeline.
+#
+# The scripted sensor plays its load levels to the application, midi0
+# runs in UART loopback so the generated clock is received again as the
+# serial clock source.  The BENCH lines of the application are summarised
+# per load level of the sensor.
+#
+# SPDX-License-Identifier: Apache-2.0
+source ${ZEPHYR_BASE}/tests/bsim/sh_common.source
+
+simulation_id="midi_bench_pipeline"
+verbosity_level=2
+# The sensor script takes 150 s, one more report after it
+sim_length_us=$((160 * 1000 * 1000))
+log_dir="${BSIM_OUT_PATH}/results/${simulation_id}"
+board="${BOARD:-nrf52_bsim}"
+
+cd ${BSIM_OUT_PATH}/bin
+mkdir -p "${log_dir}"
+
+# The console of both devices is kept for the summary below
+Execute ./bs_${board}_midi_bench_central \
+	-v=${verbosity_level} -s=${simulation_id} -d=0 -RealEncryption=0 \
+	-uart1_loopback > "${log_dir}/central.log"
+
+Execute ./bs_${board}_midi_bench_hrs \
+	-v=${verbosity_level} -s=${simulation_id} -d=1 -RealEncryption=0 \
+	> "${log_dir}/hrs.log"
+
+Execute ./bs_2G4_phy_v1 -v=${verbosity_level} -s=${simulation_id} \
+	-D=2 -sim_length=${sim_length_us}
+
+wait_for_background_jobs
+
+# "LOAD level=N ... t_ms=T" from the sensor, "BENCH seq=S t_ms=T ..." from
+# the application.  Both run on the simulated time so t_ms lines up.
+awk '
+FNR == NR && /LOAD level=/ {
+	for (i = 1; i <= NF; i++) {
+		split($i, kv, "=")
+		if (kv[1] == "level") lvl = kv[2]
+		if (kv[1] == "name") name[lvl] = kv[2]
+		if (kv[1] == "t_ms") start[lvl] = kv[2]
+	}
+	levels[n++] = lvl
+	next
+}
+/BENCH / {
+	delete f
+	for (i = 1; i <= NF; i++) {
+		split($i, kv, "=")
+		f[kv[1]] = kv[2]
+	}
+	lvl = "-"
+	for (j = 0; j < n; j++) {
+		if (f["t_ms"] + 0 >= start[levels[j]] + 0) lvl = levels[j]
+	}
+	if ("latency" in f && f["latency"] == "total") {
+		if (f["max_us"] + 0 > lat[lvl] + 0) lat[lvl] = f["max_us"]
+	} else if ("jitter" in f && f["jitter"] == "gen") {
+		if (f["rms_us"] + 0 > jit[lvl] + 0) jit[lvl] = f["rms_us"]
+	} else if ("thread" in f) {
+		key = lvl SUBSEP f["thread"]
+		if (f["cpu_pm"] + 0 > cpu[key] + 0) cpu[key] = f["cpu_pm"]
+		if (f["stack_used"] + 0 > stk[f["thread"]] + 0) {
+			stk[f["thread"]] = f["stack_used"]
+			stksz[f["thread"]] = f["stack_size"]
+		}
+		thr[f["thread"]] = 1
+	}
+}
+END {
+	for (j = 0; j < n; j++) {
+		l = levels[j]
+		if (l == "end") continue
+		printf "level %s %-10s latency_max_us=%s jitter_rms_us=%s\n", \
+			l, name[l], lat[l], jit[l]
+		for (t in thr) {
+			if ((l SUBSEP t) in cpu) {
+				printf "    %-24s cpu_pm=%s\n", t, cpu[l SUBSEP t]
+			}
+		}
+	}
+	print "stack high-water marks"
+	for (t in thr) {
+		printf "    %-24s %s / %s\n", t, stk[t], stksz[t]
+	}
+}' "${log_dir}/hrs.log" "${log_dir}/central.log" | tee "${log_dir}/summary.txt"
+
+# EOF
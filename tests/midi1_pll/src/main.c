@@ -0,0 +1,191 @@
+/**
+ * @file main.c
+ * @brief midi1_pll benchmark and regression tests, runs on native_sim.
+ *
+ * Every case prints a "PLL_BENCH" line with lock time, largest error,
+ * overshoot, steady state jitter, cycle slips and cycles per call so
+ * filter settings can be compared:
+ *
+ *   west twister -T tests/midi1_pll -p native_sim
+ *   west build -b native_sim tests/midi1_pll -- -DCONFIG_PLL_FILTER_K=8
+ *
+ * The limits below are regression gates for the default Kconfig values.
+ * Cycles per call only mean something on real hardware, the same test
+ * runs on the frdm_rw612.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260216
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+
+#include "midi1_pll.h"
+#include "pll_bench.h"
+
+static const uint32_t recorded_us[] = {
+#ifdef PLL_BENCH_TRACE_FILE
+#include PLL_BENCH_TRACE_FILE
+#else
+#include "trace_sample.inc"
+#endif
+};
+
+static struct pll_trace trace;
+static struct pll_bench_result result;
+
+static void run(enum pll_bench_mode mode)
+{
+	pll_bench_run(&trace, mode, &result);
+	pll_bench_print(&trace, mode, &result);
+}
+
+ZTEST(midi1_pll_bench, test_step_down)
+{
+	/* 120 --> 90 BPM after 10 beats */
+	pll_trace_step(&trace, 12000, 9000, 240, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 250, "freq lock %u", result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 10, "freq overshoot %u%%", result.overshoot_pct);
+
+	/* Beyond the PI capture range, the re-anchor takes this one */
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.slips > 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses < 48, "phase lock %u", result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 10, "phase overshoot %u%%", result.overshoot_pct);
+}
+
+ZTEST(midi1_pll_bench, test_step_up)
+{
+	/* 90 --> 140 BPM after 10 beats */
+	pll_trace_step(&trace, 9000, 14000, 240, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 250, "freq lock %u", result.lock_pulses);
+
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.slips > 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses < 48, "phase lock %u", result.lock_pulses);
+}
+
+ZTEST(midi1_pll_bench, test_step_half)
+{
+	/* 120 --> 64 BPM, the first interval looks like a lost pulse */
+	pll_trace_step(&trace, 12000, 6400, 240, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.slips > 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses < 48, "phase lock %u", result.lock_pulses);
+}
+
+/*
+ * Steps and ramps within the capture range of the PI loop, it has to
+ * settle through its own dynamics without a single cycle slip.
+ */
+ZTEST(midi1_pll_bench, test_small_step_up)
+{
+	/* 120 --> 122 BPM after 10 beats */
+	pll_trace_step(&trace, 12000, 12200, 240, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 100, "freq lock %u", result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 10, "freq overshoot %u%%", result.overshoot_pct);
+
+	run(PLL_BENCH_PHASE);
+	zassert_equal(result.slips, 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses >= 2 && result.lock_pulses < 24, "phase lock %u",
+		     result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 5, "phase overshoot %u%%", result.overshoot_pct);
+}
+
+ZTEST(midi1_pll_bench, test_small_step_down)
+{
+	/* 120 --> 110 BPM after 10 beats */
+	pll_trace_step(&trace, 12000, 11000, 240, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 250, "freq lock %u", result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 10, "freq overshoot %u%%", result.overshoot_pct);
+
+	run(PLL_BENCH_PHASE);
+	zassert_equal(result.slips, 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses >= 2 && result.lock_pulses < 24, "phase lock %u",
+		     result.lock_pulses);
+	zassert_true(result.overshoot_pct <= 5, "phase overshoot %u%%", result.overshoot_pct);
+}
+
+ZTEST(midi1_pll_bench, test_ramp)
+{
+	/* 120 --> 130 BPM over 20 beats, never out of lock while it tracks */
+	pll_trace_ramp(&trace, 12000, 13000, 240, 480, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 720, "freq lock %u", result.lock_pulses);
+
+	run(PLL_BENCH_PHASE);
+	zassert_equal(result.slips, 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses < 48, "phase lock %u", result.lock_pulses);
+	zassert_true(result.max_error_ppm < 2000, "phase tracking %u ppm", result.max_error_ppm);
+}
+
+ZTEST(midi1_pll_bench, test_fast_ramp)
+{
+	/* 120 --> 130 BPM over 4 beats, out of the window while it ramps */
+	pll_trace_ramp(&trace, 12000, 13000, 240, 96, PLL_BENCH_MAX_PULSES);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses < 250, "freq lock %u", result.lock_pulses);
+
+	run(PLL_BENCH_PHASE);
+	zassert_equal(result.slips, 0, "phase slips %u", result.slips);
+	/* Settled within a beat after the end of the ramp */
+	zassert_true(result.lock_pulses < 96 + 24, "phase lock %u", result.lock_pulses);
+	zassert_true(result.max_error_ppm < 10000, "phase tracking %u ppm", result.max_error_ppm);
+	zassert_true(result.overshoot_pct <= 5, "phase overshoot %u%%", result.overshoot_pct);
+}
+
+ZTEST(midi1_pll_bench, test_jitter)
+{
+	/* 120 BPM with 200 us (1%) Gaussian edge jitter */
+	pll_trace_step(&trace, 12000, 12000, 0, PLL_BENCH_MAX_PULSES);
+	pll_trace_add_jitter(&trace, 200, 1);
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.jitter_ppm < 200, "freq jitter %u ppm", result.jitter_ppm);
+
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.jitter_ppm < 800, "phase jitter %u ppm", result.jitter_ppm);
+}
+
+ZTEST(midi1_pll_bench, test_dropped_pulses)
+{
+	/* 120 --> 110 BPM and every 50th pulse lost */
+	pll_trace_step(&trace, 12000, 11000, 240, PLL_BENCH_MAX_PULSES);
+	pll_trace_drop_pulses(&trace, 50);
+
+	/*
+	 * The frequency-only mode sees a double interval for each lost
+	 * pulse, it is only reported here as it is a known weakness.
+	 */
+	run(PLL_BENCH_FREQ);
+
+	/* Every lost pulse is a slip that keeps the period */
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.slips > 0, "phase slips %u", result.slips);
+	zassert_true(result.lock_pulses < 96, "phase lock %u", result.lock_pulses);
+	zassert_true(result.jitter_ppm < 1000, "phase jitter %u ppm", result.jitter_ppm);
+}
+
+ZTEST(midi1_pll_bench, test_recorded)
+{
+	pll_trace_recorded(&trace, "recorded", recorded_us, ARRAY_SIZE(recorded_us));
+
+	run(PLL_BENCH_FREQ);
+	zassert_true(result.lock_pulses != UINT32_MAX, "freq never locked");
+
+	run(PLL_BENCH_PHASE);
+	zassert_true(result.lock_pulses != UINT32_MAX, "phase never locked");
+}
+
+ZTEST_SUITE(midi1_pll_bench, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,273 @@
+/**
+ * @file pll_bench.c
+ * @brief Synthetic and recorded interval traces plus metrics for
+ * benchmarking midi1_pll without hardware.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260216
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/drivers/midi/midi1.h>
+
+#include "midi1_pll.h"
+#include "pll_bench.h"
+
+/* Initial tempo of the PLL, same as the application */
+#define PLL_BENCH_INIT_SBPM 12000
+
+/*
+ * sbpm_to_ticks() lives in the zephyr-midi1 module, on native_sim the
+ * module drivers are normally not built so fall back to the same formula.
+ */
+__weak uint32_t sbpm_to_ticks(uint16_t sbpm, uint32_t clock_freq)
+{
+	/* 60 s * 100 / (sbpm * 24 pulses per quarter) */
+	return (uint32_t)(((uint64_t)clock_freq * 250ULL) / sbpm);
+}
+
+static uint32_t isqrt64(uint64_t x)
+{
+	uint64_t r = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > x) {
+		bit >>= 2;
+	}
+	while (bit) {
+		if (x >= r + bit) {
+			x -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (uint32_t)r;
+}
+
+/* xorshift32, deterministic so runs can be compared */
+static uint32_t xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+/* Approximately N(0, 1) in Q16, sum of 12 uniforms (Irwin-Hall) */
+static int32_t gauss_q16(uint32_t *state)
+{
+	int32_t sum = 0;
+
+	for (int i = 0; i < 12; i++) {
+		sum += (int32_t)(xorshift32(state) & 0xFFFFU);
+	}
+	return sum - 6 * 65536;
+}
+
+static uint32_t us_to_ticks(uint32_t us)
+{
+	return (uint32_t)(((uint64_t)us * PLL_BENCH_CLOCK_FREQ) / 1000000ULL);
+}
+
+void pll_trace_step(struct pll_trace *t, uint16_t from_sbpm, uint16_t to_sbpm, uint32_t step_at,
+		    uint32_t count)
+{
+	uint32_t from = sbpm_to_ticks(from_sbpm, PLL_BENCH_CLOCK_FREQ);
+	uint32_t to = sbpm_to_ticks(to_sbpm, PLL_BENCH_CLOCK_FREQ);
+
+	t->name = "step";
+	t->count = MIN(count, PLL_BENCH_MAX_PULSES);
+	t->settle_from = step_at;
+	for (uint32_t i = 0; i < t->count; i++) {
+		t->ideal[i] = (i < step_at) ? from : to;
+		t->interval[i] = t->ideal[i];
+	}
+}
+
+void pll_trace_ramp(struct pll_trace *t, uint16_t from_sbpm, uint16_t to_sbpm, uint32_t ramp_at,
+		    uint32_t ramp_pulses, uint32_t count)
+{
+	t->name = "ramp";
+	t->count = MIN(count, PLL_BENCH_MAX_PULSES);
+	t->settle_from = ramp_at;
+	for (uint32_t i = 0; i < t->count; i++) {
+		int32_t sbpm = from_sbpm;
+
+		if (i >= ramp_at + ramp_pulses) {
+			sbpm = to_sbpm;
+		} else if (i >= ramp_at) {
+			sbpm += ((int32_t)to_sbpm - (int32_t)from_sbpm) * (int32_t)(i - ramp_at) /
+				(int32_t)ramp_pulses;
+		}
+		t->ideal[i] = sbpm_to_ticks((uint16_t)sbpm, PLL_BENCH_CLOCK_FREQ);
+		t->interval[i] = t->ideal[i];
+	}
+}
+
+void pll_trace_add_jitter(struct pll_trace *t, uint32_t sigma_us, uint32_t seed)
+{
+	uint32_t state = seed ? seed : 0x12345678U;
+	int64_t sigma = us_to_ticks(sigma_us);
+	int32_t prev = 0;
+
+	t->name = "jitter";
+	for (uint32_t i = 0; i < t->count; i++) {
+		/* Jitter moves the edges, an interval sees two of them */
+		int32_t edge = (int32_t)((gauss_q16(&state) * sigma) >> 16);
+
+		t->interval[i] = (uint32_t)((int32_t)t->interval[i] + edge - prev);
+		prev = edge;
+	}
+}
+
+void pll_trace_drop_pulses(struct pll_trace *t, uint32_t every)
+{
+	t->name = "dropped";
+	for (uint32_t i = every - 1U; i + 1U < t->count; i += every) {
+		t->interval[i + 1U] += t->interval[i];
+		t->interval[i] = 0;
+	}
+}
+
+void pll_trace_recorded(struct pll_trace *t, const char *name, const uint32_t *interval_us,
+			uint32_t count)
+{
+	uint64_t sum = 0;
+
+	t->name = name;
+	t->count = MIN(count, PLL_BENCH_MAX_PULSES);
+	t->settle_from = 0;
+	for (uint32_t i = 0; i < t->count; i++) {
+		t->interval[i] = us_to_ticks(interval_us[i]);
+		sum += t->interval[i];
+	}
+	/*
+	 * There is no ground truth in a recording, a one beat (24 pulses)
+	 * centred moving average of the input stands in for it.
+	 */
+	for (uint32_t i = 0; i < t->count; i++) {
+		uint32_t lo = (i >= 12U) ? i - 12U : 0U;
+		uint32_t hi = MIN(i + 12U, t->count);
+
+		sum = 0;
+		for (uint32_t j = lo; j < hi; j++) {
+			sum += t->interval[j];
+		}
+		t->ideal[i] = (uint32_t)(sum / (hi - lo));
+	}
+}
+
+void pll_bench_run(const struct pll_trace *t, enum pll_bench_mode mode,
+		   struct pll_bench_result *r)
+{
+	static int32_t error[PLL_BENCH_MAX_PULSES];
+	static bool valid[PLL_BENCH_MAX_PULSES];
+	struct midi1_pll_data pll = {0};
+	struct midi1_pll_pi_data pll_pi = {0};
+	uint64_t cycles = 0;
+	uint32_t calls = 0;
+	uint32_t timestamp = 0;
+
+	midi1_pll_init(&pll, PLL_BENCH_INIT_SBPM, PLL_BENCH_CLOCK_FREQ);
+	midi1_pll_pi_init(&pll_pi, PLL_BENCH_INIT_SBPM, PLL_BENCH_CLOCK_FREQ);
+
+	for (uint32_t i = 0; i < t->count; i++) {
+		uint32_t out;
+		uint32_t start;
+
+		timestamp += t->interval[i];
+		valid[i] = (t->interval[i] != 0U);
+		if (!valid[i]) {
+			continue;
+		}
+
+		start = k_cycle_get_32();
+		if (mode == PLL_BENCH_FREQ) {
+			midi1_pll_process_interval(&pll, t->interval[i]);
+		} else {
+			midi1_pll_pi_process_timestamp(&pll_pi, timestamp);
+		}
+		cycles += k_cycle_get_32() - start;
+		calls++;
+
+		out = (mode == PLL_BENCH_FREQ) ? (uint32_t)midi1_pll_get_interval_ticks(&pll)
+					       : midi1_pll_pi_get_interval_ticks(&pll_pi);
+		error[i] = (int32_t)out - (int32_t)t->ideal[i];
+	}
+
+	r->cycles_per_call = calls ? (uint32_t)(cycles / calls) : 0U;
+	r->slips = (mode == PLL_BENCH_PHASE) ? pll_pi.slips : 0U;
+
+	/* Lock time: the first pulse after which it never leaves the window */
+	r->lock_pulses = 0;
+	r->max_error_ppm = 0;
+	for (uint32_t i = t->settle_from; i < t->count; i++) {
+		int64_t window = ((int64_t)t->ideal[i] * PLL_BENCH_LOCK_PPM) / 1000000;
+		int64_t err = (error[i] < 0) ? -(int64_t)error[i] : error[i];
+
+		if (!valid[i]) {
+			continue;
+		}
+		if (err > window) {
+			r->lock_pulses = i + 1U - t->settle_from;
+		}
+		r->max_error_ppm = MAX(r->max_error_ppm, (uint32_t)((err * 1000000) / t->ideal[i]));
+	}
+	if (t->settle_from + r->lock_pulses >= t->count) {
+		r->lock_pulses = UINT32_MAX;
+	}
+
+	/* Overshoot past the final tempo, in the direction of the change */
+	int64_t before = t->ideal[t->settle_from ? t->settle_from - 1U : 0U];
+	int64_t after = t->ideal[t->count - 1U];
+	int64_t step = after - before;
+	int64_t worst = 0;
+
+	r->overshoot_pct = 0;
+	if (step != 0) {
+		for (uint32_t i = t->settle_from; i < t->count; i++) {
+			int64_t out = (int64_t)t->ideal[i] + error[i];
+			int64_t past = (step > 0) ? out - after : after - out;
+
+			if (valid[i] && past > worst) {
+				worst = past;
+			}
+		}
+		r->overshoot_pct = (uint32_t)((worst * 100) / (step > 0 ? step : -step));
+	}
+
+	/* Steady state jitter over the last quarter of the trace */
+	uint64_t sq = 0;
+	uint64_t ideal = 0;
+	uint32_t n = 0;
+
+	for (uint32_t i = t->count - t->count / 4U; i < t->count; i++) {
+		if (valid[i]) {
+			sq += (int64_t)error[i] * error[i];
+			ideal += t->ideal[i];
+			n++;
+		}
+	}
+	r->jitter_rms_ticks = n ? isqrt64(sq / n) : 0U;
+	r->jitter_ppm = (n && ideal) ? (uint32_t)(((uint64_t)r->jitter_rms_ticks * 1000000ULL * n) /
+						 ideal)
+				    : 0U;
+}
+
+void pll_bench_print(const struct pll_trace *t, enum pll_bench_mode mode,
+		     const struct pll_bench_result *r)
+{
+	printk("PLL_BENCH %-8s %-5s K=%d G=%d T=%d KP=%d KI=%d lock=%d pulses max=%u ppm overshoot=%u%% "
+	       "jitter=%u ticks (%u ppm) slips=%u cycles/call=%u\n",
+	       t->name, (mode == PLL_BENCH_FREQ) ? "freq" : "phase", CONFIG_PLL_FILTER_K,
+	       CONFIG_PLL_FILTER_GAIN, CONFIG_PLL_TRACK_GAIN, CONFIG_PLL_PI_KP_SHIFT,
+	       CONFIG_PLL_PI_KI_SHIFT, (r->lock_pulses == UINT32_MAX) ? -1 : (int)r->lock_pulses,
+	       r->max_error_ppm, r->overshoot_pct, r->jitter_rms_ticks, r->jitter_ppm, r->slips,
+	       r->cycles_per_call);
+}
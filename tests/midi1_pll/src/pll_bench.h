@@ -0,0 +1,84 @@
+/**
+ * @file pll_bench.h
+ * @brief Synthetic and recorded interval traces plus metrics for
+ * benchmarking midi1_pll without hardware.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260216
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef PLL_BENCH_H
+#define PLL_BENCH_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Same as the 24 MHz ctimer on the FRDM_RW612 */
+#define PLL_BENCH_CLOCK_FREQ 24000000U
+
+/* Longest trace in pulses, 100 beats */
+#define PLL_BENCH_MAX_PULSES 2400
+
+/* "Locked" means within +/- 0.5% of the ideal interval */
+#define PLL_BENCH_LOCK_PPM 5000
+
+enum pll_bench_mode {
+	/* struct midi1_pll_data, midi1_pll_process_interval() */
+	PLL_BENCH_FREQ = 0,
+	/* struct midi1_pll_pi_data, midi1_pll_pi_process_timestamp() */
+	PLL_BENCH_PHASE,
+};
+
+struct pll_trace {
+	const char *name;
+	uint32_t count;
+	/* What the measurement driver reports for each pulse, in ticks */
+	uint32_t interval[PLL_BENCH_MAX_PULSES];
+	/* Ground truth tempo for each pulse, in ticks */
+	uint32_t ideal[PLL_BENCH_MAX_PULSES];
+	/* Pulse where the last tempo change starts, metrics begin here */
+	uint32_t settle_from;
+};
+
+struct pll_bench_result {
+	/* Pulses from settle_from until it stays locked, UINT32_MAX = never */
+	uint32_t lock_pulses;
+	/* Largest interval error from settle_from on, in ppm of the ideal */
+	uint32_t max_error_ppm;
+	/* Largest excursion past the final tempo in % of the step size */
+	uint32_t overshoot_pct;
+	/* Steady state RMS error of the interval over the last quarter */
+	uint32_t jitter_rms_ticks;
+	uint32_t jitter_ppm;
+	/* Average k_cycle_get_32() cycles per process call */
+	uint32_t cycles_per_call;
+	/* Phase mode only: pulses re-anchored as a cycle slip */
+	uint32_t slips;
+};
+
+/* Constant tempo, then a step to another tempo */
+void pll_trace_step(struct pll_trace *t, uint16_t from_sbpm, uint16_t to_sbpm, uint32_t step_at,
+		    uint32_t count);
+
+/* Constant tempo, then a linear ramp over ramp_pulses */
+void pll_trace_ramp(struct pll_trace *t, uint16_t from_sbpm, uint16_t to_sbpm, uint32_t ramp_at,
+		    uint32_t ramp_pulses, uint32_t count);
+
+/* Add Gaussian timing jitter (sigma in us) to the pulse edges */
+void pll_trace_add_jitter(struct pll_trace *t, uint32_t sigma_us, uint32_t seed);
+
+/* Drop every n-th pulse, the next interval then covers both */
+void pll_trace_drop_pulses(struct pll_trace *t, uint32_t every);
+
+/* Load an interval dump in microseconds (one value per pulse) */
+void pll_trace_recorded(struct pll_trace *t, const char *name, const uint32_t *interval_us,
+			uint32_t count);
+
+/* Run a trace through one of the PLL modes and compute the metrics */
+void pll_bench_run(const struct pll_trace *t, enum pll_bench_mode mode,
+		   struct pll_bench_result *r);
+
+/* One line summary on the console */
+void pll_bench_print(const struct pll_trace *t, enum pll_bench_mode mode,
+		     const struct pll_bench_result *r);
+
+#endif /* PLL_BENCH_H */
@@ -0,0 +1,157 @@
+/**
+ * @file main.c
+ * @brief tempo_est regression tests, runs on native_sim.
+ *
+ * Feeds the estimator with synthetic aggregated heart rate tempos, the
+ * way main.c does on every heart rate event, and checks the tempo it
+ * hands to the clock.  The limits are for the default Kconfig values:
+ *
+ *   west twister -T tests/tempo_est -p native_sim
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20260403
+ * license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/ztest.h>
+#include <zephyr/kernel.h>
+
+#include "tempo_est.h"
+
+/* Samples before the filter counts as settled */
+#define SETTLE_SAMPLES 10
+
+struct range {
+	uint16_t min;
+	uint16_t max;
+};
+
+static uint32_t lcg = 1;
+
+/* Reproducible noise in -half .. half */
+static int noise(int half)
+{
+	lcg = lcg * 1103515245U + 12345U;
+	return (int)((lcg >> 16) % (uint32_t)(2 * half + 1)) - half;
+}
+
+static void range_add(struct range *r, uint16_t sbpm)
+{
+	r->min = MIN(r->min, sbpm);
+	r->max = MAX(r->max, sbpm);
+}
+
+static void before(void *fixture)
+{
+	lcg = 1;
+	tempo_est_reset();
+}
+
+ZTEST(tempo_est, test_one_sensor)
+{
+	struct range out = {UINT16_MAX, 0};
+
+	/* 70 BPM with +-0.5 BPM, a notification a second */
+	for (uint32_t k = 0; k < 300; k++) {
+		uint16_t p = tempo_est_update(7000 + noise(50), 1000U * k + noise(10) + 10);
+
+		if (k >= SETTLE_SAMPLES) {
+			range_add(&out, p);
+		}
+	}
+	zassert_true(out.min >= 6900 && out.max <= 7100, "predicted %u..%u", out.min, out.max);
+}
+
+ZTEST(tempo_est, test_two_sensors)
+{
+	struct range out = {UINT16_MAX, 0};
+	struct tempo_est_stats stats;
+	int a = 7000;
+	int b = 7200;
+
+	/*
+	 * 70 and 72 BPM, the second sensor notifies 30 ms after the first.
+	 * The aggregate changes on both, the prediction must not swing
+	 * wider than the aggregate does.
+	 */
+	for (uint32_t k = 0; k < 300; k++) {
+		uint32_t t = 1000U * k + 10;
+
+		a = 7000 + noise(50);
+		(void)tempo_est_update((a + b) / 2, t);
+		b = 7200 + noise(50);
+		uint16_t p = tempo_est_update((a + b) / 2, t + 30 + noise(10));
+
+		if (k >= SETTLE_SAMPLES) {
+			range_add(&out, p);
+		}
+	}
+	tempo_est_get_stats(&stats);
+	zassert_true(out.min >= 7000 && out.max <= 7200, "predicted %u..%u", out.min, out.max);
+	zassert_true(stats.held >= 300, "held %u", stats.held);
+}
+
+ZTEST(tempo_est, test_ramp)
+{
+	struct tempo_est_stats stats;
+	uint16_t p = 0;
+	uint16_t sbpm = 0;
+
+	/* 70 --> 130 BPM at 0.5 BPM per second */
+	for (uint32_t k = 0; k < 120; k++) {
+		sbpm = 7000 + 50 * k;
+		p = tempo_est_update(sbpm, 1000U * k + 10);
+	}
+	tempo_est_get_stats(&stats);
+	zassert_true(stats.trend_sbpm_per_s >= 40 && stats.trend_sbpm_per_s <= 60, "trend %d",
+		     stats.trend_sbpm_per_s);
+	/* A horizon ahead of the last sample, not a step behind it */
+	zassert_true(p >= sbpm && p <= sbpm + 100 + TEMPO_EST_HORIZON_MS / 10, "predicted %u at %u",
+		     p, sbpm);
+}
+
+ZTEST(tempo_est, test_spike)
+{
+	struct tempo_est_stats before_spike;
+	struct tempo_est_stats stats;
+	uint32_t k;
+	uint16_t p;
+
+	for (k = 0; k < 30; k++) {
+		(void)tempo_est_update(9000, 1000U * k + 10);
+	}
+	tempo_est_get_stats(&before_spike);
+
+	/* One motion artefact, left out */
+	p = tempo_est_update(9000 + 2 * TEMPO_EST_GATE_SBPM, 1000U * k++ + 10);
+	tempo_est_get_stats(&stats);
+	zassert_equal(stats.rejected, before_spike.rejected + 1, "spike not rejected");
+	zassert_true(p >= 8950 && p <= 9050, "predicted %u after a spike", p);
+
+	/* The tempo really moved, the filter restarts at the new one */
+	for (int i = 0; i < TEMPO_EST_REJECT_LIMIT; i++) {
+		p = tempo_est_update(12000, 1000U * k++ + 10);
+	}
+	tempo_est_get_stats(&stats);
+	zassert_equal(stats.restarts, before_spike.restarts + 1, "no restart");
+	zassert_equal(p, 12000, "predicted %u after the restart", p);
+}
+
+ZTEST(tempo_est, test_gap)
+{
+	struct tempo_est_stats stats;
+	uint32_t restarts;
+	uint16_t p;
+
+	(void)tempo_est_update(8000, 10);
+	(void)tempo_est_update(8000, 1010);
+	tempo_est_get_stats(&stats);
+	restarts = stats.restarts;
+
+	/* Sensor gone for longer than TEMPO_EST_MAX_GAP_MS */
+	p = tempo_est_update(10000, 1010 + TEMPO_EST_MAX_GAP_MS + 1);
+	tempo_est_get_stats(&stats);
+	zassert_equal(stats.restarts, restarts + 1, "no restart after a gap");
+	zassert_equal(p, 10000, "predicted %u after a gap", p);
+}
+
+ZTEST_SUITE(tempo_est, NULL, NULL, before, NULL, NULL);